@@ -0,0 +1,41 @@
+#version 450
+
+// only the position stream is bound, 12 bytes per vertex
+layout(location = 0) in vec3 position;
+
+// same expression as the shading pass, so depth equal passes exactly where this pass wrote
+invariant gl_Position;
+
+struct Fog {
+	vec4 color;
+	vec4 dist;
+	vec4 densityGradient;
+};
+
+struct Sun {
+	vec4 dir;
+	vec4 color;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projection;
+	mat4 view;
+	mat4 inverseView;
+	vec4 ambientLightColor;
+	Fog fog;
+	Sun sun;
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
+	int numLights;
+} ubo;
+
+layout(push_constant) uniform Push {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+} push;
+
+void main() {
+	gl_Position = ubo.projection * (ubo.view * (push.modelMatrix * vec4(position, 1.0)));
+}
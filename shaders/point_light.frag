@@ -1,13 +1,18 @@
 #version 450
 
 layout(location = 0) in vec2 fragOffset;
+layout(location = 1) flat in vec4 fragColor;
 layout(location = 3) in float visibility;
 
 layout(location = 0) out vec4 outColor;
 
+// specialization constants, see ShaderVariant
+layout(constant_id = 3) const bool ENABLE_FOG = true;
+
 struct Fog {
 	vec4 color;
 	vec4 dist;
+	vec4 densityGradient;
 };
 
 struct Sun {
@@ -15,11 +20,6 @@ struct Sun {
 	vec4 color;
 };
 
-struct PointLight {
-	vec4 position;
-	vec4 color;
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
@@ -27,16 +27,13 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	vec4 ambientLightColor;
 	Fog fog;
 	Sun sun;
-	PointLight pointLights[10];
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
 	int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
-	vec4 position;
-	vec4 color;
-	float radius;
-} push;
-
 const float M_PI = 3.1415926538;
 
 void main() {
@@ -45,7 +42,9 @@ void main() {
 		discard;
 	}
 	float cosDis = 0.5 * (cos(dis * M_PI) + 1.0);
-	outColor = vec4(push.color.xyz + cosDis, cosDis);
+	outColor = vec4(fragColor.xyz + cosDis, cosDis);
 
-	outColor = mix(ubo.fog.color, outColor, visibility);
+	if (ENABLE_FOG) {
+		outColor = mix(ubo.fog.color, outColor, visibility);
+	}
 }
\ No newline at end of file
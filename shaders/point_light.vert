@@ -10,8 +10,12 @@ const vec2 OFFSETS[6] = vec2[](
 );
 
 layout(location = 0) out vec2 fragOffset;
+layout(location = 1) flat out vec4 fragColor;
 layout(location = 3) out float visibility;
 
+// specialization constants, see ShaderVariant
+layout(constant_id = 3) const bool ENABLE_FOG = true;
+
 struct Fog {
 	vec4 color;
 	vec4 dist;
@@ -23,11 +27,6 @@ struct Sun {
 	vec4 color;
 };
 
-struct PointLight {
-	vec4 position;
-	vec4 color;
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
@@ -35,30 +34,44 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	vec4 ambientLightColor;
 	Fog fog;
 	Sun sun;
-	PointLight pointLights[10];
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
 	int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
-	vec4 position;
+struct LightBillboard {
+	vec4 position; // w is the radius
 	vec4 color;
-	float radius;
-} push;
+};
+
+// sorted back-to-front, one instance per light
+layout(std430, set = 1, binding = 0) readonly buffer BillboardBuffer {
+	LightBillboard billboards[];
+} billboardBuffer;
 
 const float LIGHT_RADIUS = 0.05;
 
 void main() {
 	
+	LightBillboard billboard = billboardBuffer.billboards[gl_InstanceIndex];
+
 	fragOffset = OFFSETS[gl_VertexIndex];
+	fragColor = billboard.color;
 	
-	vec4 lightInCameraSpace = ubo.view * vec4(push.position.xyz, 1.0);
-	vec4 positionInCameraSpace = lightInCameraSpace + push.radius * vec4(fragOffset, 0.0, 0.0);
+	vec4 lightInCameraSpace = ubo.view * vec4(billboard.position.xyz, 1.0);
+	vec4 positionInCameraSpace = lightInCameraSpace + billboard.position.w * vec4(fragOffset, 0.0, 0.0);
 
 	gl_Position = ubo.projection * positionInCameraSpace;
 
-	float dist = length(positionInCameraSpace.xyz);
-	visibility = exp(-pow((dist * ubo.fog.densityGradient.x), ubo.fog.densityGradient.y));
-	//visibility = mix(dist, ubo.fog.dist.x, ubo.fog.dist.y);
-	visibility = clamp(visibility, 0, 1);
+	// fully visible in variants without fog
+	visibility = 1.0;
+	if (ENABLE_FOG) {
+		float dist = length(positionInCameraSpace.xyz);
+		visibility = exp(-pow((dist * ubo.fog.densityGradient.x), ubo.fog.densityGradient.y));
+		//visibility = mix(dist, ubo.fog.dist.x, ubo.fog.dist.y);
+		visibility = clamp(visibility, 0, 1);
+	}
 
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+
+// only the position stream is bound
+layout(location = 0) in vec3 position;
+
+layout(push_constant) uniform Push {
+	mat4 lightViewProjection;
+	mat4 modelMatrix;
+} push;
+
+void main() {
+	gl_Position = push.lightViewProjection * (push.modelMatrix * vec4(position, 1.0));
+}
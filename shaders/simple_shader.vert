@@ -10,6 +10,12 @@ layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 layout(location = 3) out float visibility;
 
+// the depth pre-pass computes the same expression, its depth must match bit for bit under depth equal
+invariant gl_Position;
+
+// specialization constants, see ShaderVariant
+layout(constant_id = 3) const bool ENABLE_FOG = true;
+
 struct Fog {
 	vec4 color;
 	vec4 dist;
@@ -21,11 +27,6 @@ struct Sun {
 	vec4 color;
 };
 
-struct PointLight {
-	vec4 position;
-	vec4 color;
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
 	mat4 projection;
 	mat4 view;
@@ -33,7 +34,10 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	vec4 ambientLightColor;
 	Fog fog;
 	Sun sun;
-	PointLight pointLights[10];
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
 	int numLights;
 } ubo;
 
@@ -53,10 +57,14 @@ void main() {
 	fragPosWorld = positionWorld.xyz;
 	fragColor = color;
 
-	float dist = length(positionRelativeToCamera.xyz);
-	visibility = exp(-pow((dist * ubo.fog.densityGradient.x), ubo.fog.densityGradient.y));
-	//visibility = mix(dist, ubo.fog.dist.x, ubo.fog.dist.y);
-	visibility = clamp(visibility, 0, 1);
+	// fully visible in variants without fog
+	visibility = 1.0;
+	if (ENABLE_FOG) {
+		float dist = length(positionRelativeToCamera.xyz);
+		visibility = exp(-pow((dist * ubo.fog.densityGradient.x), ubo.fog.densityGradient.y));
+		//visibility = mix(dist, ubo.fog.dist.x, ubo.fog.dist.y);
+		visibility = clamp(visibility, 0, 1);
+	}
 
 	//visibility = dist;
 
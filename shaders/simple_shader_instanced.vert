@@ -0,0 +1,73 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out float visibility;
+
+// the depth pre-pass computes the same expression, its depth must match bit for bit under depth equal
+invariant gl_Position;
+
+// specialization constants, see ShaderVariant
+layout(constant_id = 3) const bool ENABLE_FOG = true;
+
+struct Fog {
+	vec4 color;
+	vec4 dist;
+	vec4 densityGradient;
+};
+
+struct Sun {
+	vec4 dir;
+	vec4 color;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projection;
+	mat4 view;
+	mat4 inverseView;
+	vec4 ambientLightColor;
+	Fog fog;
+	Sun sun;
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
+	int numLights;
+} ubo;
+
+struct InstanceData {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+	InstanceData instances[];
+} instanceBuffer;
+
+void main() {
+
+	InstanceData instance = instanceBuffer.instances[gl_InstanceIndex];
+
+	vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);
+	vec4 positionRelativeToCamera = ubo.view * positionWorld;
+
+	gl_Position = ubo.projection * (positionRelativeToCamera);
+
+	fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
+	fragPosWorld = positionWorld.xyz;
+	fragColor = color;
+
+	// fully visible in variants without fog
+	visibility = 1.0;
+	if (ENABLE_FOG) {
+		float dist = length(positionRelativeToCamera.xyz);
+		visibility = exp(-pow((dist * ubo.fog.densityGradient.x), ubo.fog.densityGradient.y));
+		visibility = clamp(visibility, 0, 1);
+	}
+}
\ No newline at end of file
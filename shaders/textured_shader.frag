@@ -8,6 +8,12 @@ layout(location = 4) in float visibility;
 
 layout(location = 0) out vec4 outColor;
 
+// specialization constants, see ShaderVariant
+layout(constant_id = 0) const int MAX_LIGHTS = 64;
+layout(constant_id = 1) const bool ENABLE_SUN = true;
+layout(constant_id = 2) const bool ENABLE_SPECULAR = true;
+layout(constant_id = 3) const bool ENABLE_FOG = true;
+
 struct Fog {
 	vec4 color;
 	vec4 dist;
@@ -20,7 +26,7 @@ struct Sun {
 };
 
 struct PointLight {
-	vec4 position;
+	vec4 position; // w is the range
 	vec4 color;
 };
 
@@ -31,17 +37,59 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	vec4 ambientLightColor;
 	Fog fog;
 	Sun sun;
-	PointLight pointLights[10];
+	vec4 clusterScale;
+	uvec4 clusterGrid;
+	mat4 shadowMatrices[4]; // SHADOW_CASCADE_COUNT
+	vec4 cascadeSplits;
 	int numLights;
 } ubo;
 
 layout(set = 0, binding = 1) uniform sampler2D tex;
 
+layout(std430, set = 0, binding = 2) readonly buffer LightBuffer {
+	PointLight lights[];
+} lightBuffer;
+
+layout(std430, set = 0, binding = 3) readonly buffer ClusterBuffer {
+	uint lightCounts[];
+} clusterBuffer;
+
+// clusterGrid.w light indices per cluster, filled by light_cluster.comp
+layout(std430, set = 0, binding = 4) readonly buffer LightIndexBuffer {
+	uint indices[];
+} lightIndexBuffer;
+
+// one layer per cascade, compared against with hardware PCF
+layout(set = 0, binding = 5) uniform sampler2DArrayShadow shadowMap;
+
 layout(push_constant) uniform Push {
 	mat4 modelMatrix;
 	mat4 normalMatrix;
 } push;
 
+// screen tile from the fragment position, depth slice from the log of its view depth
+uint clusterIndex() {
+	float viewDepth = max((ubo.view * vec4(fragPosWorld, 1.0)).z, 1e-4);
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * ubo.clusterScale.xy), ubo.clusterGrid.xy - 1u);
+	uint slice = uint(clamp(log(viewDepth) * ubo.clusterScale.z + ubo.clusterScale.w, 0.0, float(ubo.clusterGrid.z - 1u)));
+	return (slice * ubo.clusterGrid.y + tile.y) * ubo.clusterGrid.x + tile.x;
+}
+
+// fraction of the sun reaching the fragment, from the nearest cascade that covers it
+float sunShadow() {
+	float viewDepth = (ubo.view * vec4(fragPosWorld, 1.0)).z;
+	if (viewDepth > ubo.cascadeSplits[3]) return 1.0;
+
+	int cascade = 0;
+	for (int i = 0; i < 3; i++) {
+		if (viewDepth > ubo.cascadeSplits[i]) cascade = i + 1;
+	}
+
+	// orthographic, so w stays 1
+	vec4 shadowCoord = ubo.shadowMatrices[cascade] * vec4(fragPosWorld, 1.0);
+	return texture(shadowMap, vec4(shadowCoord.xy * 0.5 + 0.5, float(cascade), shadowCoord.z));
+}
+
 void main() {
 
 	vec3 objColor = texture(tex, texCoord).xyz;
@@ -54,26 +102,41 @@ void main() {
 	vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
 	// ================ SUN LIGHT ================
-	vec3 directionToSun = ubo.sun.dir.xyz - fragPosWorld;
-	directionToSun = normalize(directionToSun);
+	if (ENABLE_SUN) {
+		vec3 directionToSun = ubo.sun.dir.xyz - fragPosWorld;
+		directionToSun = normalize(directionToSun);
 
-	// ======== DIFFUSE ========
-	float sunCosAngIncidence = max(dot(surfaceNormal, directionToSun), 0);
-	vec3 sunIntensity = ubo.sun.color.xyz * ubo.sun.color.w;
-	diffuseLight += sunIntensity * sunCosAngIncidence;
+		// ======== DIFFUSE ========
+		float sunCosAngIncidence = max(dot(surfaceNormal, directionToSun), 0);
+		vec3 sunIntensity = ubo.sun.color.xyz * ubo.sun.color.w * sunShadow();
+		diffuseLight += sunIntensity * sunCosAngIncidence;
 
-	// ======== SPECULAR ========
-	vec3 sunHalfAngle = normalize(directionToSun + viewDirection);
-	float sunBlinnTerm = dot(surfaceNormal, sunHalfAngle);
-	sunBlinnTerm = clamp(sunBlinnTerm, 0, 1);
-	sunBlinnTerm = pow(sunBlinnTerm, 256.0);
-	specularLight += sunIntensity * sunBlinnTerm;
+		// ======== SPECULAR ========
+		if (ENABLE_SPECULAR) {
+			vec3 sunHalfAngle = normalize(directionToSun + viewDirection);
+			float sunBlinnTerm = dot(surfaceNormal, sunHalfAngle);
+			sunBlinnTerm = clamp(sunBlinnTerm, 0, 1);
+			sunBlinnTerm = pow(sunBlinnTerm, 256.0);
+			specularLight += sunIntensity * sunBlinnTerm;
+		}
+	}
 
 	// ======== POINT LIGHTS ========
-	for (int i = 0; i < ubo.numLights; i++) {
-		PointLight light = ubo.pointLights[i];
+	// only the lights binned into this fragment's cluster
+	uint cluster = clusterIndex();
+	uint clusterLights = clusterBuffer.lightCounts[cluster];
+	uint firstLight = cluster * ubo.clusterGrid.w;
+
+	// constant trip count so the loop can be unrolled per variant
+	for (int i = 0; i < MAX_LIGHTS; i++) {
+		if (uint(i) >= clusterLights) break;
+
+		PointLight light = lightBuffer.lights[lightIndexBuffer.indices[firstLight + uint(i)]];
 		vec3 directionToLight = light.position.xyz - fragPosWorld;
-		float attenuation = 1.0 / dot(directionToLight, directionToLight); // distance squared
+		float distanceSquared = dot(directionToLight, directionToLight);
+		// windowed so the light fades out at its range instead of ending at a cluster boundary
+		float window = clamp(1.0 - pow(distanceSquared / (light.position.w * light.position.w), 2.0), 0.0, 1.0);
+		float attenuation = window * window / distanceSquared;
 		directionToLight = normalize(directionToLight);
 
 		// ======== DIFFUSE ========
@@ -83,17 +146,21 @@ void main() {
 		diffuseLight += intensity * cosAngIncidence;
 
 		// ======== SPECULAR ========
-		vec3 halfAngle = normalize(directionToLight + viewDirection);
-		float blinnTerm = dot(surfaceNormal, halfAngle);
-		blinnTerm = clamp(blinnTerm, 0, 1);
-		blinnTerm = pow(blinnTerm, 512.0); // higher values = sharper highlights
-		specularLight += intensity * blinnTerm;
+		if (ENABLE_SPECULAR) {
+			vec3 halfAngle = normalize(directionToLight + viewDirection);
+			float blinnTerm = dot(surfaceNormal, halfAngle);
+			blinnTerm = clamp(blinnTerm, 0, 1);
+			blinnTerm = pow(blinnTerm, 512.0); // higher values = sharper highlights
+			specularLight += intensity * blinnTerm;
+		}
 	}
 
 	// Add light to object color
 	outColor = vec4(diffuseLight, 1.0f) * vec4(objColor, 1.0) + vec4(specularLight, 1.0);
 
-	outColor = mix(ubo.fog.color, outColor, visibility);
+	if (ENABLE_FOG) {
+		outColor = mix(ubo.fog.color, outColor, visibility);
+	}
 
 	//outColor = vec4(visibility);
 
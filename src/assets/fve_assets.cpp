@@ -56,6 +56,7 @@ namespace fve {
 		Material mat;
 		mat.pipeline = pipeline;
 		mat.pipelineLayout = pipelineLayout;
+		mat.sortId = static_cast<uint32_t>(materials.size());
 		materials.emplace(matId, mat);
 		return &materials[matId];
 	}
@@ -98,8 +99,9 @@ namespace fve {
 		}
 
 		//Mesh mesh = Mesh(device, vertices, indices);
-		meshes.try_emplace(meshId, device, vertices, indices);
-		return &meshes[meshId];
+		auto& mesh = meshes.try_emplace(meshId, device, vertices, indices).first->second;
+		mesh.sortId = static_cast<uint32_t>(meshes.size() - 1);
+		return &mesh;
 
 	}
 
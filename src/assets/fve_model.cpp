@@ -13,6 +13,8 @@
 #include <iostream>
 #include <cassert>
 #include <limits>
+#include <algorithm>
+#include <cmath>
 
 #ifndef ENGINE_DIR
 #define ENGINE_DIR "../"
@@ -35,7 +37,9 @@ namespace fve {
 
 	Mesh::Mesh(FveDevice& device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
 		createVertexBuffers(device, vertices);
+		createPositionBuffer(device, Builder::splitPositions(vertices));
 		createIndexBuffers(device, indices);
+		bounds = Builder::computeBounds(vertices);
 	}
 
 	Mesh::~Mesh() {}
@@ -108,6 +112,35 @@ namespace fve {
 		device.copyBuffer(stagingBuffer.getAllocatedBuffer().buffer, vertexBuffer->getAllocatedBuffer().buffer, bufferSize);
 	}
 
+	void Mesh::createPositionBuffer(FveDevice& device, const std::vector<glm::vec3>& positions) {
+		uint32_t positionSize = sizeof(positions[0]);
+		VkDeviceSize bufferSize = positionSize * positions.size();
+
+		FveBuffer stagingBuffer{
+			fveAllocator,
+			device,
+			positionSize,
+			static_cast<uint32_t>(positions.size()),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU
+		};
+
+		stagingBuffer.map();
+		stagingBuffer.writeToBuffer((void*)positions.data());
+
+		positionBuffer = std::make_unique<FveBuffer>(
+			fveAllocator,
+			device,
+			positionSize,
+			static_cast<uint32_t>(positions.size()),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			"positionBuffer"
+		);
+
+		device.copyBuffer(stagingBuffer.getAllocatedBuffer().buffer, positionBuffer->getAllocatedBuffer().buffer, bufferSize);
+	}
+
 	void Mesh::createIndexBuffers(FveDevice& device, const std::vector<uint32_t>& indices) {
 		// count the indices, determine if we're using an index buffer for this model
 		indexCount = static_cast<uint32_t>(indices.size());
@@ -150,24 +183,41 @@ namespace fve {
 		device.copyBuffer(stagingBuffer.getAllocatedBuffer().buffer, indexBuffer->getAllocatedBuffer().buffer, bufferSize);
 	}
 
-	void FveModel::draw(VkCommandBuffer commandBuffer) {
-		if (mesh->hasIndexBuffer) {
-			vkCmdDrawIndexed(commandBuffer, mesh->indexCount, 1, 0, 0, 0);
+	void Mesh::draw(FveCommandRecorder& recorder, uint32_t instanceCount, uint32_t firstInstance) {
+		if (hasIndexBuffer) {
+			recorder.drawIndexed(indexCount, instanceCount, 0, 0, firstInstance);
 		}
 		else {
-			vkCmdDraw(commandBuffer, mesh->vertexCount, 1, 0, 0);
+			recorder.draw(vertexCount, instanceCount, 0, firstInstance);
+		}
+	}
+
+	void Mesh::bind(FveCommandRecorder& recorder) {
+		VkBuffer buffers[] = { vertexBuffer->getAllocatedBuffer().buffer };
+		VkDeviceSize offsets[] = { 0 };
+		recorder.bindVertexBuffers(0, 1, buffers, offsets);
+		if (hasIndexBuffer) {
+			recorder.bindIndexBuffer(indexBuffer->getAllocatedBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
 		}
 	}
 
-	void FveModel::bind(VkCommandBuffer commandBuffer) {
-		VkBuffer buffers[] = { mesh->vertexBuffer->getAllocatedBuffer().buffer};
+	void Mesh::bindPositions(FveCommandRecorder& recorder) {
+		VkBuffer buffers[] = { positionBuffer->getAllocatedBuffer().buffer };
 		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
-		if (mesh->hasIndexBuffer) {
-			vkCmdBindIndexBuffer(commandBuffer, mesh->indexBuffer->getAllocatedBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
+		recorder.bindVertexBuffers(0, 1, buffers, offsets);
+		if (hasIndexBuffer) {
+			recorder.bindIndexBuffer(indexBuffer->getAllocatedBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
 		}
 	}
 
+	void FveModel::draw(FveCommandRecorder& recorder) {
+		mesh->draw(recorder);
+	}
+
+	void FveModel::bind(FveCommandRecorder& recorder) {
+		mesh->bind(recorder);
+	}
+
 	std::vector<VkVertexInputBindingDescription> Vertex::getBindingDescriptions() {
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
 		bindingDescriptions[0].binding = 0;
@@ -187,6 +237,19 @@ namespace fve {
 		return attributeDescriptions;
 	}
 
+	std::vector<VkVertexInputBindingDescription> Vertex::getPositionBindingDescriptions() {
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(glm::vec3);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> Vertex::getPositionAttributeDescriptions() {
+		// same location as the full layout, so depth-only shaders declare the position like every other shader
+		return { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } };
+	}
+
 	void Mesh::Builder::loadMesh(const std::string& filepath) {
 
 		std::string enginePath = ENGINE_DIR + filepath;
@@ -253,4 +316,35 @@ namespace fve {
 		// ...
 	}
 
+	MeshBounds Mesh::Builder::computeBounds(const std::vector<Vertex>& vertices) {
+		MeshBounds bounds{};
+		if (vertices.empty()) return bounds;
+
+		bounds.aabbMin = vertices[0].position;
+		bounds.aabbMax = vertices[0].position;
+		for (const auto& vertex : vertices) {
+			bounds.aabbMin = glm::min(bounds.aabbMin, vertex.position);
+			bounds.aabbMax = glm::max(bounds.aabbMax, vertex.position);
+		}
+
+		// sphere around the center of the box, tighter than the box's own circumsphere
+		glm::vec3 center = (bounds.aabbMin + bounds.aabbMax) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (const auto& vertex : vertices) {
+			glm::vec3 offset = vertex.position - center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+
+		bounds.sphere = glm::vec4(center, std::sqrt(radiusSquared));
+		return bounds;
+	}
+
+	std::vector<glm::vec3> Mesh::Builder::splitPositions(const std::vector<Vertex>& vertices) {
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			positions[i] = vertices[i].position;
+		}
+		return positions;
+	}
+
 }
\ No newline at end of file
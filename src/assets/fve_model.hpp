@@ -2,6 +2,7 @@
 
 #include "../core/vulkan/fve_device.hpp"
 #include "../core/vulkan/fve_buffer.hpp"
+#include "../core/vulkan/fve_command_recorder.hpp"
 #include "../core/fve_types.hpp"
 
 #define GLM_FORCE_RADIANS
@@ -13,6 +14,13 @@
 
 namespace fve {
 
+	// mesh space bounding volumes used for culling
+	struct MeshBounds {
+		glm::vec3 aabbMin{ 0.0f };
+		glm::vec3 aabbMax{ 0.0f };
+		glm::vec4 sphere{ 0.0f }; // xyz is the center, w the radius
+	};
+
 	class Mesh {
 	public:
 
@@ -21,6 +29,11 @@ namespace fve {
 			std::vector<uint32_t> indices{};
 
 			void loadMesh(const std::string& filepath);
+
+			static MeshBounds computeBounds(const std::vector<Vertex>& vertices);
+
+			// positions split out of the interleaved vertices, for passes that only need depth
+			static std::vector<glm::vec3> splitPositions(const std::vector<Vertex>& vertices);
 		};
 
 		Mesh() = default;
@@ -34,7 +47,19 @@ namespace fve {
 
 		static Mesh createMeshFromFile(FveDevice& device, const std::string& filepath);
 
+		void bind(FveCommandRecorder& recorder);
+		// binds the position-only stream instead of the full vertices, indices and vertex offsets stay the same
+		void bindPositions(FveCommandRecorder& recorder);
+		void draw(FveCommandRecorder& recorder, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+		// small sequential id used to build render queue sort keys
+		uint32_t sortId = 0;
+
+		MeshBounds bounds{};
+
 		std::unique_ptr<FveBuffer> vertexBuffer;
+		// 12 bytes per vertex rather than sizeof(Vertex), read by the depth pre-pass
+		std::unique_ptr<FveBuffer> positionBuffer;
 		uint32_t vertexCount;
 
 		bool hasIndexBuffer = false;
@@ -43,6 +68,7 @@ namespace fve {
 		uint32_t indexCount;
 	private:
 		void createVertexBuffers(FveDevice& device, const std::vector<Vertex>& vertices);
+		void createPositionBuffer(FveDevice& device, const std::vector<glm::vec3>& positions);
 		void createIndexBuffers(FveDevice& device, const std::vector<uint32_t>& indices);
 	};
 
@@ -50,6 +76,16 @@ namespace fve {
 		VkDescriptorSet textureSet{ VK_NULL_HANDLE }; // no texture by default
 		VkPipeline pipeline;
 		VkPipelineLayout pipelineLayout;
+
+		// render queue sort ids
+		uint32_t pipelineId = 0;
+		uint32_t sortId = 0;
+
+		// blended materials are drawn back-to-front after all opaque ones
+		bool transparent = false;
+
+		// same shading, but reads transforms from the per-frame instance buffer (set 1)
+		Material* instancedVariant = nullptr;
 	};
 
 	class FveModel {
@@ -68,8 +104,8 @@ namespace fve {
 		virtual inline Mesh& getMesh() const;
 		virtual inline Material& getMaterial() const;
 
-		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		void bind(FveCommandRecorder& recorder);
+		void draw(FveCommandRecorder& recorder);
 
 	private:
 		Mesh* mesh;
@@ -0,0 +1,104 @@
+#include "fve_job_system.hpp"
+#include "utils/fve_logger.hpp"
+
+#include <algorithm>
+
+namespace fve {
+
+	u32 FveJobSystem::defaultWorkerCount() {
+		u32 cores = std::max(1u, std::thread::hardware_concurrency());
+		return cores - 1;
+	}
+
+	FveJobSystem::FveJobSystem(u32 workerCount) {
+		workers.reserve(workerCount);
+		for (u32 i = 0; i < workerCount; i++) {
+			// thread 0 is the dispatching thread
+			workers.emplace_back(&FveJobSystem::workerLoop, this, i + 1);
+		}
+
+		FVE_CORE_DEBUG("Job system started with {0} worker threads", workerCount);
+	}
+
+	FveJobSystem::~FveJobSystem() {
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		wakeCondition.notify_all();
+
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	void FveJobSystem::dispatch(u32 jobCount, const Job& job) {
+		if (jobCount == 0) return;
+
+		// not worth waking anyone
+		if (jobCount == 1 || workers.empty()) {
+			for (u32 i = 0; i < jobCount; i++) {
+				job(i, 0);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			currentJob = &job;
+			currentJobCount = jobCount;
+			nextJob.store(0);
+			finishedJobs.store(0);
+			generation++;
+		}
+		wakeCondition.notify_all();
+
+		runJobs(job, jobCount, 0);
+
+		// workers that joined late must also be done with the job before it goes out of scope
+		std::unique_lock<std::mutex> lock{ mutex };
+		doneCondition.wait(lock, [&]() { return finishedJobs.load() == jobCount && activeWorkers == 0; });
+		currentJob = nullptr;
+	}
+
+	void FveJobSystem::runJobs(const Job& job, u32 jobCount, u32 threadIndex) {
+		u32 finished = 0;
+		for (u32 i = nextJob.fetch_add(1); i < jobCount; i = nextJob.fetch_add(1)) {
+			job(i, threadIndex);
+			finished++;
+		}
+
+		if (finished > 0 && finishedJobs.fetch_add(finished) + finished == jobCount) {
+			std::lock_guard<std::mutex> lock{ mutex };
+			doneCondition.notify_all();
+		}
+	}
+
+	void FveJobSystem::workerLoop(u32 threadIndex) {
+		u64 seenGeneration = 0;
+
+		while (true) {
+			const Job* job;
+			u32 jobCount;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wakeCondition.wait(lock, [&]() { return stopping || (generation != seenGeneration && currentJob != nullptr); });
+				if (stopping) return;
+
+				seenGeneration = generation;
+				job = currentJob;
+				jobCount = currentJobCount;
+				activeWorkers++;
+			}
+
+			runJobs(*job, jobCount, threadIndex);
+
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				activeWorkers--;
+			}
+			doneCondition.notify_all();
+		}
+	}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "fve_defines.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Small fork-join thread pool for splitting per-frame work across cores.
+	 *
+	 * dispatch() hands out job indices to the workers and the calling thread alike and returns once
+	 * every job has finished. Every job also receives the index of the thread running it, which is
+	 * stable for the lifetime of the pool, so per-thread resources (command pools, scratch buffers)
+	 * can be indexed without locking. The calling thread is always thread 0.
+	 */
+	class FveJobSystem {
+	public:
+		using Job = std::function<void(u32 jobIndex, u32 threadIndex)>;
+
+		// one worker per core, minus the thread that dispatches
+		static u32 defaultWorkerCount();
+
+		explicit FveJobSystem(u32 workerCount = defaultWorkerCount());
+		~FveJobSystem();
+
+		FveJobSystem(const FveJobSystem&) = delete;
+		FveJobSystem& operator=(const FveJobSystem&) = delete;
+
+		// workers plus the calling thread
+		u32 getThreadCount() const { return static_cast<u32>(workers.size()) + 1; }
+
+		// runs job(i, thread) for every i in [0, jobCount), blocks until all of them are done.
+		// must only be called from one thread at a time
+		void dispatch(u32 jobCount, const Job& job);
+
+	private:
+		void workerLoop(u32 threadIndex);
+		void runJobs(const Job& job, u32 jobCount, u32 threadIndex);
+
+		std::vector<std::thread> workers;
+
+		std::mutex mutex;
+		std::condition_variable wakeCondition;
+		std::condition_variable doneCondition;
+
+		// current dispatch, written under the mutex
+		const Job* currentJob = nullptr;
+		u32 currentJobCount = 0;
+		u64 generation = 0;
+		u32 activeWorkers = 0;
+		bool stopping = false;
+
+		std::atomic<u32> nextJob{ 0 };
+		std::atomic<u32> finishedJobs{ 0 };
+	};
+
+}
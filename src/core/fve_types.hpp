@@ -41,6 +41,10 @@ namespace fve {
 		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
 		static std::vector<VkVertexInputAttributeDescription> geAttributeDescriptions();
 
+		// the position-only stream of a mesh, see Mesh::bindPositions()
+		static std::vector<VkVertexInputBindingDescription> getPositionBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> getPositionAttributeDescriptions();
+
 		bool operator==(const Vertex& other) const {
 			return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
 		}
@@ -0,0 +1,118 @@
+#include "fve_mapped_file.hpp"
+
+#include <utility>
+
+#if FVE_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fve {
+
+	FveMappedFile::~FveMappedFile() {
+		close();
+	}
+
+	FveMappedFile::FveMappedFile(FveMappedFile&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	FveMappedFile& FveMappedFile::operator=(FveMappedFile&& other) noexcept {
+		if (this != &other) {
+			close();
+			std::swap(mapping, other.mapping);
+			std::swap(fileSize, other.fileSize);
+#if FVE_PLATFORM_WINDOWS
+			std::swap(fileHandle, other.fileHandle);
+			std::swap(mappingHandle, other.mappingHandle);
+#endif
+		}
+		return *this;
+	}
+
+#if FVE_PLATFORM_WINDOWS
+
+	bool FveMappedFile::open(const std::string& path) {
+		close();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (fileMapping == nullptr) {
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == nullptr) {
+			CloseHandle(fileMapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		fileHandle = file;
+		mappingHandle = fileMapping;
+		mapping = view;
+		fileSize = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	void FveMappedFile::close() {
+		if (mapping != nullptr) {
+			UnmapViewOfFile(mapping);
+			CloseHandle(mappingHandle);
+			CloseHandle(fileHandle);
+		}
+		mapping = nullptr;
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+		fileSize = 0;
+	}
+
+#else
+
+	bool FveMappedFile::open(const std::string& path) {
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps its own reference to the file
+		::close(fd);
+		if (view == MAP_FAILED) return false;
+
+		mapping = view;
+		fileSize = static_cast<size_t>(info.st_size);
+		return true;
+	}
+
+	void FveMappedFile::close() {
+		if (mapping != nullptr) {
+			munmap(mapping, fileSize);
+		}
+		mapping = nullptr;
+		fileSize = 0;
+	}
+
+#endif
+
+}
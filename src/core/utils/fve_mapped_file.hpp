@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace fve {
+
+	// Read-only memory mapping of a whole file, unmapped when the object goes away.
+	// The pages are only read in as they are touched, nothing is copied up front.
+	class FveMappedFile {
+	public:
+		FveMappedFile() = default;
+		~FveMappedFile();
+
+		FveMappedFile(const FveMappedFile&) = delete;
+		FveMappedFile& operator=(const FveMappedFile&) = delete;
+		FveMappedFile(FveMappedFile&& other) noexcept;
+		FveMappedFile& operator=(FveMappedFile&& other) noexcept;
+
+		// false if the file does not exist or could not be mapped
+		bool open(const std::string& path);
+		void close();
+
+		const void* data() const { return mapping; }
+		size_t size() const { return fileSize; }
+		bool isOpen() const { return mapping != nullptr; }
+
+	private:
+		void* mapping = nullptr;
+		size_t fileSize = 0;
+#if FVE_PLATFORM_WINDOWS
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+
+}
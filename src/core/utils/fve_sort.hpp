@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace fve {
+
+	struct SortItem {
+		u64 key;
+		u32 index;
+	};
+
+	// Stable LSD radix sort of (key, index) pairs, 8 bits per pass.
+	// Passes where every key shares the same digit are skipped, so keys that only
+	// use their low bits (or are already grouped) cost fewer than 8 passes.
+	inline void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+		const size_t count = items.size();
+		if (count < 2) return;
+
+		scratch.resize(count);
+
+		// build all 8 histograms in a single read of the keys
+		std::array<std::array<u32, 256>, 8> histograms{};
+		for (const auto& item : items) {
+			for (u32 pass = 0; pass < 8; pass++) {
+				histograms[pass][(item.key >> (pass * 8)) & 0xFF]++;
+			}
+		}
+
+		SortItem* src = items.data();
+		SortItem* dst = scratch.data();
+
+		for (u32 pass = 0; pass < 8; pass++) {
+			auto& histogram = histograms[pass];
+
+			// every key has the same digit here, the order would not change
+			if (histogram[(src[0].key >> (pass * 8)) & 0xFF] == count) continue;
+
+			// turn the counts into starting offsets
+			u32 offset = 0;
+			for (auto& bucket : histogram) {
+				u32 bucketCount = bucket;
+				bucket = offset;
+				offset += bucketCount;
+			}
+
+			for (size_t i = 0; i < count; i++) {
+				dst[histogram[(src[i].key >> (pass * 8)) & 0xFF]++] = src[i];
+			}
+
+			std::swap(src, dst);
+		}
+
+		// an odd number of passes leaves the result in the scratch buffer
+		if (src != items.data()) {
+			items.swap(scratch);
+		}
+	}
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 
 namespace fve {
@@ -11,4 +13,14 @@ namespace fve {
 		(hashCombine(seed, rest), ...);
 	}
 
+	// 64-bit FNV-1a, cheap and good enough to tell file contents apart
+	inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
 }
\ No newline at end of file
@@ -57,16 +57,19 @@ namespace fve {
     }
 
     FveBuffer::~FveBuffer() {
-        // check the buffer info before it's destroyed
-        VmaAllocationInfo allocInfo{};
-        vmaGetAllocationInfo(allocator, buffer.allocation, &allocInfo);
-        // destroy the buffer
         unmap();
-        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
-        BUFFER_ALLOCATIONS--;
-        FVE_CORE_TRACE("Destroyed buffer! Active allocations: {0}", BUFFER_ALLOCATIONS);
-        // debug
-        if (allocInfo.pUserData) FVE_CORE_TRACE("The buffer destroyed had user pointer data: {0}", (const char*)allocInfo.pUserData);
+        // frames still in flight may read the buffer, it is destroyed once they have retired
+        device.deferDestroy([allocator = allocator, buffer = buffer]() {
+            // check the buffer info before it's destroyed
+            VmaAllocationInfo allocInfo{};
+            vmaGetAllocationInfo(allocator, buffer.allocation, &allocInfo);
+            // debug
+            if (allocInfo.pUserData) FVE_CORE_TRACE("The buffer destroyed had user pointer data: {0}", (const char*)allocInfo.pUserData);
+            // destroy the buffer
+            vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+            BUFFER_ALLOCATIONS--;
+            FVE_CORE_TRACE("Destroyed buffer! Active allocations: {0}", BUFFER_ALLOCATIONS);
+        });
     }
 
     /**
@@ -0,0 +1,89 @@
+#include "fve_command_pools.hpp"
+#include "../utils/fve_logger.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace fve {
+
+	FveCommandPools::FveCommandPools(FveDevice& device, u32 frameCount, u32 threadCount)
+		: device{ device }, frameCount{ frameCount }, threadCount{ threadCount }, pools(frameCount * threadCount) {
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = device.findPhysicalQueueFamilies().graphicsFamily;
+		// buffers are only ever reset through their pool
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		for (auto& pool : pools) {
+			if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &pool.pool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create command pool!");
+			}
+		}
+
+		FVE_CORE_DEBUG("Created {0} command pools ({1} frames x {2} threads)", pools.size(), frameCount, threadCount);
+	}
+
+	FveCommandPools::~FveCommandPools() {
+		// destroying a pool frees its buffers
+		for (auto& pool : pools) {
+			vkDestroyCommandPool(device.device(), pool.pool, nullptr);
+		}
+	}
+
+	void FveCommandPools::resetFrame(u32 frameIndex) {
+		assert(frameIndex < frameCount && "Frame index out of range");
+
+		for (u32 thread = 0; thread < threadCount; thread++) {
+			ThreadPool& pool = getPool(frameIndex, thread);
+
+			// nothing recorded from this pool since the last reset
+			if (pool.used[0] == 0 && pool.used[1] == 0) continue;
+
+			if (vkResetCommandPool(device.device(), pool.pool, 0) != VK_SUCCESS) {
+				throw std::runtime_error("failed to reset command pool!");
+			}
+			pool.used[0] = 0;
+			pool.used[1] = 0;
+			pool.stats.resets++;
+		}
+	}
+
+	VkCommandBuffer FveCommandPools::acquire(u32 frameIndex, u32 threadIndex, VkCommandBufferLevel level) {
+		assert(frameIndex < frameCount && "Frame index out of range");
+		assert(threadIndex < threadCount && "Thread index out of range");
+
+		ThreadPool& pool = getPool(frameIndex, threadIndex);
+		const u32 slot = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1;
+		auto& buffers = pool.buffers[slot];
+
+		if (pool.used[slot] == buffers.size()) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = level;
+			allocInfo.commandPool = pool.pool;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate command buffers!");
+			}
+			buffers.push_back(commandBuffer);
+			pool.stats.allocations++;
+		}
+
+		pool.stats.handOuts++;
+		return buffers[pool.used[slot]++];
+	}
+
+	FveCommandPools::Stats FveCommandPools::getStats() const {
+		Stats total{};
+		for (const auto& pool : pools) {
+			total.allocations += pool.stats.allocations;
+			total.resets += pool.stats.resets;
+			total.handOuts += pool.stats.handOuts;
+		}
+		return total;
+	}
+
+}
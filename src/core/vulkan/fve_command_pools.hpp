@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+#include "fve_device.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Command pools for per-frame recording, one per frame in flight and recording thread.
+	 *
+	 * A pool is only ever touched by the thread whose index it belongs to, so handing out buffers
+	 * needs no locking. Buffers are never freed individually: once a frame has retired on the device's
+	 * frame timeline, resetFrame() resets all of that frame's pools with vkResetCommandPool and their
+	 * buffers are handed out again in the same order the next time the frame comes around.
+	 */
+	class FveCommandPools {
+	public:
+		struct Stats {
+			u64 allocations = 0; // buffers created with vkAllocateCommandBuffers
+			u64 resets = 0; // vkResetCommandPool calls
+			u64 handOuts = 0; // buffers returned by acquire(), recycled or not
+		};
+
+		FveCommandPools(FveDevice& device, u32 frameCount, u32 threadCount);
+		~FveCommandPools();
+
+		FveCommandPools(const FveCommandPools&) = delete;
+		FveCommandPools& operator=(const FveCommandPools&) = delete;
+
+		// recycles every buffer handed out for the frame, its previous submission must have completed
+		void resetFrame(u32 frameIndex);
+
+		// a buffer in the initial state, only valid until the frame is reset again.
+		// must be called from the thread that owns threadIndex
+		VkCommandBuffer acquire(u32 frameIndex, u32 threadIndex, VkCommandBufferLevel level);
+
+		u32 getThreadCount() const { return threadCount; }
+
+		// sums the per-pool counters, call while no thread is recording
+		Stats getStats() const;
+
+	private:
+		// padded to a cache line so threads bumping their counters do not share one
+		struct alignas(64) ThreadPool {
+			VkCommandPool pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> buffers[2]; // primary, secondary
+			u32 used[2]{};
+			Stats stats{};
+		};
+
+		ThreadPool& getPool(u32 frameIndex, u32 threadIndex) { return pools[frameIndex * threadCount + threadIndex]; }
+
+		FveDevice& device;
+		u32 frameCount;
+		u32 threadCount;
+		std::vector<ThreadPool> pools;
+	};
+
+}
@@ -0,0 +1,92 @@
+#include "fve_command_recorder.hpp"
+
+namespace fve {
+
+	RecordStats& RecordStats::operator+=(const RecordStats& other) {
+		drawCalls += other.drawCalls;
+		indirectDraws += other.indirectDraws;
+		instances += other.instances;
+		triangles += other.triangles;
+		dispatches += other.dispatches;
+		pipelineBinds += other.pipelineBinds;
+		descriptorBinds += other.descriptorBinds;
+		pushConstantBytes += other.pushConstantBytes;
+		bufferBinds += other.bufferBinds;
+		return *this;
+	}
+
+	void FveRecordTotals::add(const RecordStats& stats) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		totals += stats;
+	}
+
+	RecordStats FveRecordTotals::take() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		RecordStats result = totals;
+		totals = {};
+		return result;
+	}
+
+	FveCommandRecorder::~FveCommandRecorder() {
+		if (totals) totals->add(stats);
+	}
+
+	void FveCommandRecorder::bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline) {
+		vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+		stats.pipelineBinds++;
+	}
+
+	void FveCommandRecorder::bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, u32 firstSet, u32 setCount,
+		const VkDescriptorSet* sets, u32 dynamicOffsetCount, const u32* dynamicOffsets) {
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, firstSet, setCount, sets, dynamicOffsetCount, dynamicOffsets);
+		stats.descriptorBinds += setCount;
+	}
+
+	void FveCommandRecorder::pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, u32 offset, u32 size, const void* values) {
+		vkCmdPushConstants(commandBuffer, layout, stages, offset, size, values);
+		stats.pushConstantBytes += size;
+	}
+
+	void FveCommandRecorder::bindVertexBuffers(u32 firstBinding, u32 bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets) {
+		vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, buffers, offsets);
+		stats.bufferBinds += bindingCount;
+	}
+
+	void FveCommandRecorder::bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+		vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+		stats.bufferBinds++;
+	}
+
+	void FveCommandRecorder::draw(u32 vertexCount, u32 instanceCount, u32 firstVertex, u32 firstInstance) {
+		vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+		stats.drawCalls++;
+		stats.instances += instanceCount;
+		stats.triangles += static_cast<u64>(vertexCount / 3) * instanceCount;
+	}
+
+	void FveCommandRecorder::drawIndexed(u32 indexCount, u32 instanceCount, u32 firstIndex, int32_t vertexOffset, u32 firstInstance) {
+		vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		stats.drawCalls++;
+		stats.instances += instanceCount;
+		stats.triangles += static_cast<u64>(indexCount / 3) * instanceCount;
+	}
+
+	void FveCommandRecorder::drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, u32 drawCount, u32 stride) {
+		vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+		stats.drawCalls++;
+		stats.indirectDraws += drawCount;
+	}
+
+	void FveCommandRecorder::drawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset,
+		u32 maxDrawCount, u32 stride) {
+		vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+		stats.drawCalls++;
+		stats.indirectDraws += maxDrawCount;
+	}
+
+	void FveCommandRecorder::dispatch(u32 groupCountX, u32 groupCountY, u32 groupCountZ) {
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+		stats.dispatches++;
+	}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+
+namespace fve {
+
+	// what was recorded, counted on the CPU. indirect draws only know their count on the GPU,
+	// so their instances and triangles are not included
+	struct RecordStats {
+		u64 drawCalls = 0; // draw commands, an indirect one counts once
+		u64 indirectDraws = 0; // what the indirect commands may draw at most, the count variant may draw fewer
+		u64 instances = 0;
+		u64 triangles = 0; // assumes triangle lists
+		u64 dispatches = 0;
+		u64 pipelineBinds = 0;
+		u64 descriptorBinds = 0;
+		u64 pushConstantBytes = 0;
+		u64 bufferBinds = 0; // vertex and index buffers
+
+		RecordStats& operator+=(const RecordStats& other);
+	};
+
+	// sums the stats of recorders on any thread
+	class FveRecordTotals {
+	public:
+		void add(const RecordStats& stats);
+		// returns the sum so far and starts over
+		RecordStats take();
+
+	private:
+		std::mutex mutex;
+		RecordStats totals{};
+	};
+
+	/*
+	 * Thin wrapper around a VkCommandBuffer that counts the state changes and draws recorded through it.
+	 *
+	 * One recorder belongs to one thread, its counts go to the totals when it is destroyed. It converts
+	 * to the command buffer, so commands it does not wrap are recorded directly and left uncounted.
+	 */
+	class FveCommandRecorder {
+	public:
+		FveCommandRecorder(VkCommandBuffer commandBuffer, FveRecordTotals* totals = nullptr)
+			: commandBuffer{ commandBuffer }, totals{ totals } {}
+		~FveCommandRecorder();
+
+		FveCommandRecorder(const FveCommandRecorder&) = delete;
+		FveCommandRecorder& operator=(const FveCommandRecorder&) = delete;
+
+		operator VkCommandBuffer() const { return commandBuffer; }
+		VkCommandBuffer get() const { return commandBuffer; }
+
+		void bindPipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+		void bindDescriptorSets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, u32 firstSet, u32 setCount,
+			const VkDescriptorSet* sets, u32 dynamicOffsetCount = 0, const u32* dynamicOffsets = nullptr);
+		void pushConstants(VkPipelineLayout layout, VkShaderStageFlags stages, u32 offset, u32 size, const void* values);
+		void bindVertexBuffers(u32 firstBinding, u32 bindingCount, const VkBuffer* buffers, const VkDeviceSize* offsets);
+		void bindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+
+		void draw(u32 vertexCount, u32 instanceCount, u32 firstVertex, u32 firstInstance);
+		void drawIndexed(u32 indexCount, u32 instanceCount, u32 firstIndex, int32_t vertexOffset, u32 firstInstance);
+		void drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, u32 drawCount, u32 stride);
+		void drawIndexedIndirectCount(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset,
+			u32 maxDrawCount, u32 stride);
+		void dispatch(u32 groupCountX, u32 groupCountY, u32 groupCountZ);
+
+		const RecordStats& getStats() const { return stats; }
+
+	private:
+		VkCommandBuffer commandBuffer;
+		FveRecordTotals* totals;
+		RecordStats stats{};
+	};
+
+}
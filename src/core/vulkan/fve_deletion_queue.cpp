@@ -0,0 +1,50 @@
+#include "fve_deletion_queue.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace fve {
+
+	FveDeletionQueue::~FveDeletionQueue() {
+		assert(entries.empty() && "Deletion queue must be flushed before it is destroyed");
+	}
+
+	void FveDeletionQueue::push(u64 lastFrame, DestroyFn destroy) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		entries.push_back({ lastFrame, std::move(destroy) });
+		pushed++;
+	}
+
+	u32 FveDeletionQueue::collect(u64 completedFrame) {
+		std::vector<Entry> ready;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			auto retired = std::stable_partition(entries.begin(), entries.end(),
+				[&](const Entry& entry) { return entry.lastFrame > completedFrame; });
+			ready.assign(std::make_move_iterator(retired), std::make_move_iterator(entries.end()));
+			entries.erase(retired, entries.end());
+			released += ready.size();
+		}
+
+		// outside the lock, a destroy may queue more work
+		for (auto& entry : ready) {
+			entry.destroy();
+		}
+		return static_cast<u32>(ready.size());
+	}
+
+	void FveDeletionQueue::flush() {
+		// entries pushed by a destroy are run as well
+		while (collect(~0ull) > 0) {}
+	}
+
+	FveDeletionQueue::Stats FveDeletionQueue::getStats() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats{};
+		stats.pushed = pushed;
+		stats.released = released;
+		stats.pending = static_cast<u32>(entries.size());
+		return stats;
+	}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Destruction of GPU objects deferred until the GPU is done with them.
+	 *
+	 * Every entry is tagged with the frame timeline value of the last frame that may use the object.
+	 * collect() is handed the value the GPU has reached and runs the entries at or below it, in the
+	 * order they were pushed. Entries may be pushed from any thread.
+	 *
+	 * The queue knows nothing about the device, FveDevice owns one and feeds it its frame timeline.
+	 */
+	class FveDeletionQueue {
+	public:
+		using DestroyFn = std::function<void()>;
+
+		struct Stats {
+			u64 pushed = 0;
+			u64 released = 0;
+			u32 pending = 0;
+		};
+
+		FveDeletionQueue() = default;
+		~FveDeletionQueue();
+
+		FveDeletionQueue(const FveDeletionQueue&) = delete;
+		FveDeletionQueue& operator=(const FveDeletionQueue&) = delete;
+
+		void push(u64 lastFrame, DestroyFn destroy);
+
+		// runs what completedFrame has retired, returns how many entries ran
+		u32 collect(u64 completedFrame);
+		// runs everything, the caller makes sure the device is idle
+		void flush();
+
+		Stats getStats() const;
+
+	private:
+		struct Entry {
+			u64 lastFrame;
+			DestroyFn destroy;
+		};
+
+		mutable std::mutex mutex;
+		std::vector<Entry> entries;
+		u64 pushed = 0;
+		u64 released = 0;
+	};
+
+}
@@ -7,7 +7,10 @@
 #include <vma/vk_mem_alloc.h>
 
 // std headers
+#include <cassert>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -59,14 +62,24 @@ namespace fve {
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
-		createCommandPool();
+		createFrameTimeline();
+		createPipelineCache();
 		FveMemory::init(*this);
 	}
 
 	FveDevice::~FveDevice() {
 		FVE_CORE_TRACE("Destroying device");
 
-		vkDestroyCommandPool(device_, commandPool, nullptr);
+		flushDeletions();
+
+		savePipelineCache();
+		vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+
+		for (auto& [thread, context] : uploadContexts) {
+			vkDestroySemaphore(device_, context.timeline, nullptr);
+			vkDestroyCommandPool(device_, context.pool, nullptr);
+		}
+		vkDestroySemaphore(device_, frameTimeline_, nullptr);
 		vkDestroyDevice(device_, nullptr);
 
 		if (enableValidationLayers) {
@@ -143,6 +156,68 @@ namespace fve {
 
 		vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
 		FVE_CORE_DEBUG("physical device: {0}", properties.deviceName);
+
+		if (properties.apiVersion >= VK_API_VERSION_1_1) {
+			VkPhysicalDeviceIDProperties idProperties{};
+			idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &idProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice_, &properties2);
+
+			memcpy(driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+		}
+
+		queryOptionalFeatures();
+	}
+
+	void FveDevice::queryOptionalFeatures() {
+		VkPhysicalDeviceFeatures supported;
+		vkGetPhysicalDeviceFeatures(physicalDevice_, &supported);
+
+		enabledFeatures = {};
+		enabledFeatures.samplerAnisotropy = VK_TRUE;
+		enabledFeatures.multiDrawIndirect = supported.multiDrawIndirect;
+		enabledFeatures.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+		// statistics queries stay active across secondary buffers, so they are only of use with both
+		const VkBool32 pipelineStatistics = supported.pipelineStatisticsQuery && supported.inheritedQueries;
+		enabledFeatures.pipelineStatisticsQuery = pipelineStatistics;
+		enabledFeatures.inheritedQueries = pipelineStatistics;
+
+		enabledFeatures12 = {};
+		enabledFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		// the 1.2 feature struct may only be chained on devices that know about it
+		if (properties.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceVulkan12Features supported12{};
+			supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+			VkPhysicalDeviceFeatures2 supported2{};
+			supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supported2.pNext = &supported12;
+			vkGetPhysicalDeviceFeatures2(physicalDevice_, &supported2);
+
+			enabledFeatures12.drawIndirectCount = supported12.drawIndirectCount;
+			// frame pacing depends on it, isDeviceSuitable() rejects devices without it
+			enabledFeatures12.timelineSemaphore = VK_TRUE;
+		}
+
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memProperties);
+		lazilyAllocatedMemory = false;
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+				lazilyAllocatedMemory = true;
+			}
+		}
+
+		FVE_CORE_DEBUG("multiDrawIndirect: {0}, drawIndirectFirstInstance: {1}, drawIndirectCount: {2}, lazily allocated memory: {3}, pipeline statistics: {4}",
+			enabledFeatures.multiDrawIndirect,
+			enabledFeatures.drawIndirectFirstInstance,
+			enabledFeatures12.drawIndirectCount,
+			lazilyAllocatedMemory,
+			enabledFeatures.pipelineStatisticsQuery);
 	}
 
 	void FveDevice::createLogicalDevice() {
@@ -161,16 +236,22 @@ namespace fve {
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
-		VkPhysicalDeviceFeatures deviceFeatures = {};
-		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		// core features go through VkPhysicalDeviceFeatures2 so the 1.2 features can be chained
+		VkPhysicalDeviceFeatures2 deviceFeatures = {};
+		deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		deviceFeatures.features = enabledFeatures;
+		if (properties.apiVersion >= VK_API_VERSION_1_2) {
+			deviceFeatures.pNext = &enabledFeatures12;
+		}
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &deviceFeatures;
 
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-		createInfo.pEnabledFeatures = &deviceFeatures;
+		createInfo.pEnabledFeatures = nullptr;
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
 		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -192,18 +273,171 @@ namespace fve {
 		vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
 	}
 
-	void FveDevice::createCommandPool() {
-		QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+	// written in front of the driver's own cache data
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t dataSize;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t driverUUID[VK_UUID_SIZE];
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505646; // "FVPC"
+
+	bool FveDevice::isPipelineCacheCompatible(const std::vector<char>& data) {
+		if (data.size() < sizeof(PipelineCacheFileHeader)) return false;
+
+		PipelineCacheFileHeader header;
+		memcpy(&header, data.data(), sizeof(header));
+
+		if (header.magic != PIPELINE_CACHE_MAGIC ||
+			header.dataSize != data.size() - sizeof(header) ||
+			header.vendorID != properties.vendorID ||
+			header.deviceID != properties.deviceID ||
+			header.driverVersion != properties.driverVersion ||
+			memcmp(header.driverUUID, driverUUID, VK_UUID_SIZE) != 0 ||
+			memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			return false;
+		}
 
-		VkCommandPoolCreateInfo poolInfo = {};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-		poolInfo.flags =
-			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		// the driver's header must agree as well, some drivers crash on foreign data instead of ignoring it
+		VkPipelineCacheHeaderVersionOne driverHeader;
+		if (header.dataSize < sizeof(driverHeader)) return false;
+		memcpy(&driverHeader, data.data() + sizeof(header), sizeof(driverHeader));
 
-		if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create command pool!");
+		return driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			driverHeader.vendorID == properties.vendorID &&
+			driverHeader.deviceID == properties.deviceID &&
+			memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	VkSemaphore FveDevice::createTimelineSemaphore() {
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+
+		VkSemaphore semaphore;
+		if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timeline semaphore!");
+		}
+		return semaphore;
+	}
+
+	void FveDevice::createFrameTimeline() {
+		frameTimeline_ = createTimelineSemaphore();
+	}
+
+	uint64_t FveDevice::completedFrame() {
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(device_, frameTimeline_, &value) != VK_SUCCESS) {
+			throw std::runtime_error("failed to read the frame timeline!");
+		}
+
+		// other threads may have read a newer value in the meantime
+		uint64_t known = retiredFrame.load();
+		while (known < value && !retiredFrame.compare_exchange_weak(known, value)) {}
+		return value;
+	}
+
+	void FveDevice::waitForFrame(uint64_t frame) {
+		if (frame <= retiredFrame.load()) return;
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &frameTimeline_;
+		waitInfo.pValues = &frame;
+		// the frame only counts as retired once the wait actually succeeded, a lost device never gets there
+		if (vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+			throw std::runtime_error("failed to wait for a frame to retire!");
+		}
+
+		uint64_t known = retiredFrame.load();
+		while (known < frame && !retiredFrame.compare_exchange_weak(known, frame)) {}
+	}
+
+	void FveDevice::flushDeletions() {
+		vkDeviceWaitIdle(device_);
+		deletionQueue.flush();
+	}
+
+	void FveDevice::createPipelineCache() {
+		std::vector<char> data;
+
+		std::ifstream file{ PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary };
+		if (file.is_open()) {
+			data.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(data.data(), data.size());
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+		if (isPipelineCacheCompatible(data)) {
+			cacheInfo.initialDataSize = data.size() - sizeof(PipelineCacheFileHeader);
+			cacheInfo.pInitialData = data.data() + sizeof(PipelineCacheFileHeader);
+			FVE_CORE_DEBUG("Loaded pipeline cache ({0} bytes)", cacheInfo.initialDataSize);
+		}
+		else if (!data.empty()) {
+			FVE_CORE_WARN("Discarding pipeline cache {0}, it was written by a different device or driver", PIPELINE_CACHE_PATH);
+		}
+		else {
+			FVE_CORE_DEBUG("No pipeline cache found, pipelines will be compiled from scratch");
+		}
+
+		if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+	}
+
+	void FveDevice::savePipelineCache() {
+		size_t dataSize = 0;
+		if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) return;
+
+		std::vector<char> data(sizeof(PipelineCacheFileHeader) + dataSize);
+		if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, data.data() + sizeof(PipelineCacheFileHeader)) != VK_SUCCESS) {
+			FVE_CORE_WARN("Failed to read back pipeline cache data");
+			return;
+		}
+
+		PipelineCacheFileHeader header{};
+		header.magic = PIPELINE_CACHE_MAGIC;
+		header.dataSize = static_cast<uint32_t>(dataSize);
+		header.vendorID = properties.vendorID;
+		header.deviceID = properties.deviceID;
+		header.driverVersion = properties.driverVersion;
+		memcpy(header.driverUUID, driverUUID, VK_UUID_SIZE);
+		memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+		memcpy(data.data(), &header, sizeof(header));
+
+		// write next to the old cache and swap it in, so a crash mid-write never leaves a torn file behind
+		const std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+		{
+			std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+			file.write(data.data(), sizeof(header) + dataSize);
+			if (!file) {
+				FVE_CORE_WARN("Failed to write pipeline cache {0}", tempPath);
+				return;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+		if (error) {
+			FVE_CORE_WARN("Failed to replace pipeline cache: {0}", error.message());
+			std::filesystem::remove(tempPath, error);
+			return;
 		}
+
+		FVE_CORE_DEBUG("Saved pipeline cache ({0} bytes)", dataSize);
 	}
 
 	void FveDevice::createSurface() { window.createWindowSurface(instance_, &surface_); }
@@ -222,8 +456,24 @@ namespace fve {
 		VkPhysicalDeviceFeatures supportedFeatures;
 		vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+		bool timelineSemaphores = false;
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceVulkan12Features supported12{};
+			supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+			VkPhysicalDeviceFeatures2 supported2{};
+			supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supported2.pNext = &supported12;
+			vkGetPhysicalDeviceFeatures2(device, &supported2);
+
+			timelineSemaphores = supported12.timelineSemaphore;
+		}
+
 		return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-			supportedFeatures.samplerAnisotropy;
+			supportedFeatures.samplerAnisotropy && timelineSemaphores;
 	}
 
 	void FveDevice::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
@@ -402,6 +652,17 @@ namespace fve {
 		throw std::runtime_error("failed to find supported format!");
 	}
 
+	VkImageAspectFlags FveDevice::depthAspects(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		}
+	}
+
 	uint32_t FveDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memProperties);
@@ -454,36 +715,86 @@ namespace fve {
 		createBuffer(size, usage, target.buffer, target.allocation, vmaUsage, debugFlag);
 	}
 
-	VkCommandBuffer FveDevice::beginSingleTimeCommands() {
+	FveDevice::UploadContext& FveDevice::getUploadContext() {
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+
+		// references into the map stay valid when other threads add their context
+		UploadContext& context = uploadContexts[std::this_thread::get_id()];
+		if (context.pool != VK_NULL_HANDLE) return context;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = findPhysicalQueueFamilies().graphicsFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		if (vkCreateCommandPool(device_, &poolInfo, nullptr, &context.pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
+
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = commandPool;
+		allocInfo.commandPool = context.pool;
 		allocInfo.commandBufferCount = 1;
 
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+		if (vkAllocateCommandBuffers(device_, &allocInfo, &context.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers!");
+		}
+
+		context.timeline = createTimelineSemaphore();
+
+		return context;
+	}
+
+	VkCommandBuffer FveDevice::beginSingleTimeCommands() {
+		UploadContext& context = getUploadContext();
+
+		// the previous submission was waited for in endSingleTimeCommands
+		vkResetCommandPool(device_, context.pool, 0);
 
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-		return commandBuffer;
+		vkBeginCommandBuffer(context.commandBuffer, &beginInfo);
+		return context.commandBuffer;
 	}
 
 	void FveDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 		vkEndCommandBuffer(commandBuffer);
 
+		UploadContext& context = getUploadContext();
+		assert(context.commandBuffer == commandBuffer && "Single time commands must end on the thread that began them");
+
+		const uint64_t value = ++context.submitted;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &value;
+
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &context.timeline;
 
-		vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue_);
+		{
+			std::lock_guard<std::mutex> lock{ queueMutex };
+			vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
+		}
 
-		vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+		// only waits for this submission instead of draining the whole queue
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &context.timeline;
+		waitInfo.pValues = &value;
+		if (vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+			throw std::runtime_error("failed to wait for single time commands!");
+		}
 	}
 
 	void FveDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
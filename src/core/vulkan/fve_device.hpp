@@ -2,11 +2,16 @@
 
 #include "../fve_window.hpp"
 #include "../fve_types.hpp"
+#include "fve_deletion_queue.hpp"
 
 #include <vma/vk_mem_alloc.h>
 
 // std lib headers
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace fve {
@@ -43,24 +48,51 @@ namespace fve {
 		FveDevice& operator=(FveDevice&&) = delete;
 
 		VkInstance instance() { return instance_; }
-		VkCommandPool getCommandPool() { return commandPool; }
 		VkPhysicalDevice physicalDevice() { return physicalDevice_; }
 		VkDevice device() { return device_; }
 		VkSurfaceKHR surface() { return surface_; }
 		VkQueue graphicsQueue() { return graphicsQueue_; }
 		VkQueue presentQueue() { return presentQueue_; }
+		// shared by all pipeline creation, persisted to disk between runs
+		VkPipelineCache pipelineCache() { return pipelineCache_; }
+		// vkQueueSubmit and vkQueuePresentKHR need external synchronization on the queue
+		std::mutex& getQueueMutex() { return queueMutex; }
+
+		// frame N signals N on this timeline semaphore once its commands have completed. it belongs to the
+		// device so the count carries on across swap chain recreation
+		VkSemaphore frameTimeline() { return frameTimeline_; }
+		// highest frame number the GPU has finished, frames are numbered from 1
+		uint64_t completedFrame();
+		bool isFrameRetired(uint64_t frame) { return frame <= retiredFrame.load() || frame <= completedFrame(); }
+		void waitForFrame(uint64_t frame);
+		// the frame the CPU is recording, it may use anything that exists right now
+		uint64_t recordingFrame() const { return submittedFrame.load() + 1; }
+		// called once frame is on the queue
+		void markFrameSubmitted(uint64_t frame) { submittedFrame.store(frame); }
+
+		// destroy runs once lastFrame has retired, by default the frame being recorded. may be called from any thread
+		void deferDestroy(FveDeletionQueue::DestroyFn destroy) { deletionQueue.push(recordingFrame(), std::move(destroy)); }
+		void deferDestroy(uint64_t lastFrame, FveDeletionQueue::DestroyFn destroy) { deletionQueue.push(lastFrame, std::move(destroy)); }
+		// releases what the GPU is done with, once per frame
+		void collectDeletions() { deletionQueue.collect(completedFrame()); }
+		// waits for the device and releases everything, has to run before the allocator is destroyed
+		void flushDeletions();
+		FveDeletionQueue::Stats getDeletionStats() const { return deletionQueue.getStats(); }
 
 		SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice_); }
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 		QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice_); }
 		VkFormat findSupportedFormat(
 			const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+		// every aspect of a depth format, barriers on depth-stencil images have to name both
+		static VkImageAspectFlags depthAspects(VkFormat format);
 
 		// Buffer Helper Functions
 		void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VmaAllocation& allocation, VmaMemoryUsage vmaUsage, const char* debugFlag = "defaultDebugFlag");
 		AllocatedBuffer allocateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage vmaUsage, const char* debugFlag = "defaultDebugFlag");
 		void allocateBuffer(AllocatedBuffer& target, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage vmaUsage, const char* debugFlag = "defaultDebugFlag");
 
+		// may be called from any thread, each thread records into its own recycled pool
 		VkCommandBuffer beginSingleTimeCommands();
 		void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 		void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -74,6 +106,15 @@ namespace fve {
 			VmaAllocationInfo& allocInfo,
 			VkImage& image);
 
+		// optional features used by the GPU-driven path, queried before device creation
+		bool supportsMultiDrawIndirect() const { return enabledFeatures.multiDrawIndirect == VK_TRUE; }
+		bool supportsDrawIndirectFirstInstance() const { return enabledFeatures.drawIndirectFirstInstance == VK_TRUE; }
+		bool supportsDrawIndirectCount() const { return enabledFeatures12.drawIndirectCount == VK_TRUE; }
+		// pipeline statistics queries that secondary command buffers can run inside, see FveFrameCounters
+		bool supportsPipelineStatistics() const { return enabledFeatures.pipelineStatisticsQuery == VK_TRUE; }
+		// memory that is only backed once a transient attachment actually needs it, found on tilers
+		bool supportsLazilyAllocatedMemory() const { return lazilyAllocatedMemory; }
+
 		VkPhysicalDeviceProperties properties;
 
 	private:
@@ -82,7 +123,12 @@ namespace fve {
 		void createSurface();
 		void pickPhysicalDevice();
 		void createLogicalDevice();
-		void createCommandPool();
+		void createPipelineCache();
+		void savePipelineCache();
+		void createFrameTimeline();
+		VkSemaphore createTimelineSemaphore();
+		bool isPipelineCacheCompatible(const std::vector<char>& data);
+		void queryOptionalFeatures();
 
 		// helper functions
 		bool isDeviceSuitable(VkPhysicalDevice device);
@@ -94,9 +140,22 @@ namespace fve {
 		bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
+		// one-off submissions of a single thread, the pool is reset instead of freeing the buffer.
+		// submission N of the thread signals N on its own timeline
+		struct UploadContext {
+			VkCommandPool pool = VK_NULL_HANDLE;
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkSemaphore timeline = VK_NULL_HANDLE;
+			uint64_t submitted = 0;
+		};
+		UploadContext& getUploadContext();
+
 		VkDebugUtilsMessengerEXT debugMessenger;
 		FveWindow& window;
-		VkCommandPool commandPool;
+
+		std::mutex queueMutex;
+		std::mutex uploadMutex;
+		std::unordered_map<std::thread::id, UploadContext> uploadContexts;
 
 		VkInstance instance_;
 		VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
@@ -104,9 +163,23 @@ namespace fve {
 		VkSurfaceKHR surface_;
 		VkQueue graphicsQueue_;
 		VkQueue presentQueue_;
+		VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+		VkSemaphore frameTimeline_ = VK_NULL_HANDLE;
+		// last value read from frameTimeline_, spares the query for frames known to be done
+		std::atomic<uint64_t> retiredFrame{ 0 };
+		std::atomic<uint64_t> submittedFrame{ 0 };
+		FveDeletionQueue deletionQueue;
+		// identifies the driver build, so its cache is discarded after a driver update
+		uint8_t driverUUID[VK_UUID_SIZE]{};
+
+		VkPhysicalDeviceFeatures enabledFeatures{};
+		VkPhysicalDeviceVulkan12Features enabledFeatures12{};
+		bool lazilyAllocatedMemory = false;
 
 		const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 		const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+		static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
 	};
 
 }  // namespace lve
\ No newline at end of file
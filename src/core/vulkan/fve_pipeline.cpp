@@ -3,86 +3,137 @@
 #include "../../assets/fve_assets.hpp"
 #include "../../core/utils/fve_logger.hpp"
 
-#include <fstream>
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
-
-#ifndef ENGINE_DIR
-#define ENGINE_DIR "../"
-#endif
+#include <cstddef>
+#include <iterator>
 
 namespace fve {
 
+	// pipelines are numbered in creation order for render queue sort keys
+	static uint32_t nextPipelineId = 0;
+
+	PipelineConfigInfo::PipelineConfigInfo(const PipelineConfigInfo& other) {
+		*this = other;
+	}
+
+	PipelineConfigInfo& PipelineConfigInfo::operator=(const PipelineConfigInfo& other) {
+		bindingDescriptions = other.bindingDescriptions;
+		attributeDescriptions = other.attributeDescriptions;
+		viewportInfo = other.viewportInfo;
+		inputAssemblyInfo = other.inputAssemblyInfo;
+		rasterizationInfo = other.rasterizationInfo;
+		multisampleInfo = other.multisampleInfo;
+		colorBlendAttachment = other.colorBlendAttachment;
+		colorBlendInfo = other.colorBlendInfo;
+		depthStencilInfo = other.depthStencilInfo;
+		dynamicStateEnables = other.dynamicStateEnables;
+		dynamicStateInfo = other.dynamicStateInfo;
+		pipelineLayout = other.pipelineLayout;
+		renderPass = other.renderPass;
+		subpass = other.subpass;
+		variant = other.variant;
+
+		colorBlendInfo.pAttachments = &colorBlendAttachment;
+		dynamicStateInfo.pDynamicStates = dynamicStateEnables.data();
+		return *this;
+	}
+
 	FvePipeline::FvePipeline(FveDevice& device, const std::string& vertFilePath,
 		const std::string& fragFilePath, const PipelineConfigInfo& configInfo, const std::string& materialName) : fveDevice{ device } {
-		createGraphicsPipeline(vertFilePath, fragFilePath, configInfo, materialName);
+		createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
+		registerMaterial(materialName);
 	}
 
-	FvePipeline::~FvePipeline() {
-		vkDestroyShaderModule(fveDevice.device(), vertShaderModule, nullptr);
-		vkDestroyShaderModule(fveDevice.device(), fragShaderModule, nullptr);
-		vkDestroyPipeline(fveDevice.device(), graphicsPipeline, nullptr);
+	FvePipeline::FvePipeline(FveDevice& device, const std::string& vertFilePath,
+		const std::string& fragFilePath, const PipelineConfigInfo& configInfo) : fveDevice{ device } {
+		createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
 	}
 
-	std::vector<char> FvePipeline::readFile(const std::string& filepath) {
+	FvePipeline::~FvePipeline() {
+		for (auto& [key, variant] : variants) {
+			vkDestroyPipeline(fveDevice.device(), variant, nullptr);
+		}
+	}
 
-		std::string enginePath = ENGINE_DIR + filepath;
+	void FvePipeline::createGraphicsPipeline(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo) {
 
-		std::ifstream file{ enginePath, std::ios::ate | std::ios::binary };
+		assert(
+			configInfo.pipelineLayout != VK_NULL_HANDLE &&
+			"Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
+		assert(
+			configInfo.renderPass != VK_NULL_HANDLE &&
+			"Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-		if (!file.is_open()) {
-			throw std::runtime_error("failed to open file " + filepath);
+		vertShader = fveShaderCache.acquire(fveDevice, vertFilePath);
+		if (!fragFilePath.empty()) {
+			fragShader = fveShaderCache.acquire(fveDevice, fragFilePath);
 		}
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+		config = std::make_unique<PipelineConfigInfo>(configInfo);
+		name = fragShader ? vertFilePath + " + " + fragFilePath : vertFilePath;
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		file.close();
+		graphicsPipeline = createVariant(config->variant);
 
-		return buffer;
+		pipelineLayout = configInfo.pipelineLayout;
+		transparent = configInfo.colorBlendAttachment.blendEnable == VK_TRUE;
 
 	}
 
-	void FvePipeline::createGraphicsPipeline(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo, const std::string& materialName) {
+	VkPipeline FvePipeline::findVariant(const ShaderVariant& variant) {
+		std::lock_guard<std::mutex> lock{ variantMutex };
+		auto it = variants.find(variant.key());
+		return it != variants.end() ? it->second : VK_NULL_HANDLE;
+	}
 
-		assert(
-			configInfo.pipelineLayout != VK_NULL_HANDLE &&
-			"Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
-		assert(
-			configInfo.renderPass != VK_NULL_HANDLE &&
-			"Cannot create graphics pipeline: no renderPass provided in configInfo");
+	VkPipeline FvePipeline::createVariant(const ShaderVariant& variant) {
+		const PipelineConfigInfo& configInfo = *config;
 
-		auto vertCode = readFile(vertFilePath);
-		auto fragCode = readFile(fragFilePath);
+		// ids match the constant_id layout qualifiers in the shaders, stages ignore the ones they don't declare
+		const VkSpecializationMapEntry specializationEntries[] = {
+			{ 0, offsetof(ShaderVariant, maxLights), sizeof(u32) },
+			{ 1, offsetof(ShaderVariant, sunLight), sizeof(VkBool32) },
+			{ 2, offsetof(ShaderVariant, specular), sizeof(VkBool32) },
+			{ 3, offsetof(ShaderVariant, fog), sizeof(VkBool32) },
+		};
 
-		FVE_CORE_DEBUG("Vertex Shader Code Size:   {0} bytes", vertCode.size());
-		FVE_CORE_DEBUG("Fragment Shader Code Size: {0} bytes", fragCode.size());
+		assert(variant.maxLights > 0 && variant.maxLights <= static_cast<u32>(MAX_LIGHTS_PER_CLUSTER) && "Shader variant exceeds the cluster light lists");
 
-		createShaderModule(vertCode, &vertShaderModule);
-		createShaderModule(fragCode, &fragShaderModule);
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(std::size(specializationEntries));
+		specializationInfo.pMapEntries = specializationEntries;
+		specializationInfo.dataSize = sizeof(ShaderVariant);
+		specializationInfo.pData = &variant;
 
 		VkPipelineShaderStageCreateInfo shaderStages[2];
 		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		shaderStages[0].module = vertShaderModule;
+		shaderStages[0].module = vertShader->module;
 		shaderStages[0].pName = "main";
 		shaderStages[0].flags = 0;
 		shaderStages[0].pNext = nullptr;
-		shaderStages[0].pSpecializationInfo = nullptr;
+		shaderStages[0].pSpecializationInfo = &specializationInfo;
 		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shaderStages[1].module = fragShaderModule;
+		shaderStages[1].module = fragShader ? fragShader->module : VK_NULL_HANDLE;
 		shaderStages[1].pName = "main";
 		shaderStages[1].flags = 0;
 		shaderStages[1].pNext = nullptr;
-		shaderStages[1].pSpecializationInfo = nullptr;
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
 
 		auto& bindingDescriptions = configInfo.bindingDescriptions;
 		auto& attributeDescriptions = configInfo.attributeDescriptions;
 
+		// everything opaque already has its depth from the pre-pass, only the nearest surface is shaded.
+		// blended pipelines are not part of the pre-pass and keep their own depth state
+		VkPipelineDepthStencilStateCreateInfo depthStencilInfo = configInfo.depthStencilInfo;
+		if (variant.depthEqual && configInfo.colorBlendAttachment.blendEnable == VK_FALSE) {
+			depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			depthStencilInfo.depthWriteEnable = VK_FALSE;
+		}
+
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -92,7 +143,7 @@ namespace fve {
 
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
+		pipelineInfo.stageCount = fragShader ? 2 : 1;
 		pipelineInfo.pStages = shaderStages;
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 		pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
@@ -100,7 +151,7 @@ namespace fve {
 		pipelineInfo.pRasterizationState = &configInfo.rasterizationInfo;
 		pipelineInfo.pMultisampleState = &configInfo.multisampleInfo;
 		pipelineInfo.pColorBlendState = &configInfo.colorBlendInfo;
-		pipelineInfo.pDepthStencilState = &configInfo.depthStencilInfo;
+		pipelineInfo.pDepthStencilState = &depthStencilInfo;
 		pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
 
 		pipelineInfo.layout = configInfo.pipelineLayout;
@@ -110,27 +161,68 @@ namespace fve {
 		pipelineInfo.basePipelineIndex = -1;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(fveDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+		VkPipeline pipeline;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (vkCreateGraphicsPipelines(fveDevice.device(), fveDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
+		FVE_CORE_DEBUG("Created pipeline {0} (variant {1:016x}) in {2:.3f} ms", name, variant.key(),
+			std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count());
+
+		// the same variant may have been requested twice, the first one compiled is kept
+		std::lock_guard<std::mutex> lock{ variantMutex };
+		auto [it, inserted] = variants.emplace(variant.key(), pipeline);
+		if (!inserted) {
+			vkDestroyPipeline(fveDevice.device(), pipeline, nullptr);
+		}
+		return it->second;
+	}
 
-		fveAssets.createMaterial(graphicsPipeline, configInfo.pipelineLayout, materialName);
+	void FvePipeline::registerMaterial(const std::string& materialName) {
+		Material* material = fveAssets.createMaterial(graphicsPipeline, pipelineLayout, materialName);
+		material->pipelineId = nextPipelineId++;
+		material->transparent = transparent;
+	}
 
+	void FvePipeline::bind(FveCommandRecorder& recorder) {
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 	}
 
-	void FvePipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	// ================ Compute Pipeline ================
 
-		if (vkCreateShaderModule(fveDevice.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create shader module");
+	FveComputePipeline::FveComputePipeline(FveDevice& device, const std::string& compFilePath, VkPipelineLayout pipelineLayout) : fveDevice{ device } {
+
+		assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+		compShader = fveShaderCache.acquire(fveDevice, compFilePath);
+
+		VkPipelineShaderStageCreateInfo shaderStage{};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module = compShader->module;
+		shaderStage.pName = "main";
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = shaderStage;
+		pipelineInfo.layout = pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		if (vkCreateComputePipelines(fveDevice.device(), fveDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute pipeline!");
 		}
+		FVE_CORE_DEBUG("Created compute pipeline {0} in {1:.3f} ms", compFilePath,
+			std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count());
+	}
+
+	FveComputePipeline::~FveComputePipeline() {
+		vkDestroyPipeline(fveDevice.device(), computePipeline, nullptr);
 	}
 
-	void FvePipeline::bind(VkCommandBuffer commandBuffer) {
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	void FveComputePipeline::bind(FveCommandRecorder& recorder) {
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
 	}
 
 	void FvePipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
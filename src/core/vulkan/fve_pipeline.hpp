@@ -1,16 +1,41 @@
 #pragma once
 
 #include "fve_device.hpp"
+#include "fve_shader_cache.hpp"
+#include "fve_command_recorder.hpp"
+#include "../fve_defines.hpp"
+#include "../utils/fve_utils.hpp"
+#include "../../fve_constants.hpp"
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace fve {
 
+	// Specialization constants shared by every lit shader, see constant_id 0-3 in the GLSL.
+	// Each combination is its own pipeline, so the driver can fold the toggles away and unroll the light loop.
+	struct ShaderVariant {
+		u32 maxLights = MAX_LIGHTS_PER_CLUSTER; // lights shaded per fragment, from the front of its cluster's list
+		VkBool32 sunLight = VK_TRUE;
+		VkBool32 specular = VK_TRUE;
+		VkBool32 fog = VK_TRUE;
+		// not a constant: opaque pipelines drawn after a depth pre-pass test EQUAL and leave depth alone
+		VkBool32 depthEqual = VK_FALSE;
+
+		u64 key() const { return fnv1a(this, sizeof(ShaderVariant)); }
+
+		// for software rasterizers and integrated GPUs
+		static ShaderVariant lowEnd() { return { 8, VK_TRUE, VK_FALSE, VK_FALSE, VK_FALSE }; }
+	};
+
 	struct PipelineConfigInfo {
 		PipelineConfigInfo() = default;
-		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
-		PipelineConfigInfo& operator=(const PipelineConfigInfo&) = delete;
+		// copies point at their own blend attachment and dynamic states
+		PipelineConfigInfo(const PipelineConfigInfo& other);
+		PipelineConfigInfo& operator=(const PipelineConfigInfo& other);
 
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
@@ -26,8 +51,10 @@ namespace fve {
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		ShaderVariant variant{};
 	};
 
+	// an empty fragment shader path builds a vertex-only pipeline, for depth-only passes
 	class FvePipeline {
 	public:
 		FvePipeline(FveDevice& device, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo, const std::string& materialName);
@@ -36,21 +63,60 @@ namespace fve {
 		FvePipeline(const FvePipeline&) = delete;
 		FvePipeline& operator=(const FvePipeline&) = delete;
 
-		void bind(VkCommandBuffer commandBuffer);
+		void bind(FveCommandRecorder& recorder);
+
+		// built from the variant in the config the pipeline was created with
+		VkPipeline getBasePipeline() const { return graphicsPipeline; }
+
+		// the same pipeline specialized differently, VK_NULL_HANDLE until FvePipelineQueue::addVariant() built it.
+		// variants are kept until the pipeline is destroyed
+		VkPipeline findVariant(const ShaderVariant& variant);
 
 		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 		static void enableAlphaBlending(PipelineConfigInfo& configInfo);
 		
 	private:
-		static std::vector<char> readFile(const std::string& filepath);
+		// compiles without registering a material, safe to call from any thread
+		FvePipeline(FveDevice& device, const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo);
+
 		FveDevice& fveDevice;
 		VkPipeline graphicsPipeline;
-		VkShaderModule vertShaderModule;
-		VkShaderModule fragShaderModule;
+		// shared with every other pipeline built from the same SPIR-V
+		std::shared_ptr<FveShaderModule> vertShader;
+		std::shared_ptr<FveShaderModule> fragShader;
+		VkPipelineLayout pipelineLayout;
+		bool transparent;
+
+		// kept to build further variants later
+		std::unique_ptr<PipelineConfigInfo> config;
+		std::string name;
+		// variants are compiled on the queue's threads and looked up on the main thread
+		std::mutex variantMutex;
+		std::unordered_map<u64, VkPipeline> variants;
 
-		void createGraphicsPipeline(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo, const std::string& materialName);
+		void createGraphicsPipeline(const std::string& vertFilePath, const std::string& fragFilePath, const PipelineConfigInfo& configInfo);
+		// safe to call from any thread
+		VkPipeline createVariant(const ShaderVariant& variant);
+		// the asset registry is not thread safe, so this always runs on the main thread
+		void registerMaterial(const std::string& materialName);
 
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+		friend class FvePipelineQueue;
+	};
+
+	class FveComputePipeline {
+	public:
+		FveComputePipeline(FveDevice& device, const std::string& compFilePath, VkPipelineLayout pipelineLayout);
+		~FveComputePipeline();
+
+		FveComputePipeline(const FveComputePipeline&) = delete;
+		FveComputePipeline& operator=(const FveComputePipeline&) = delete;
+
+		void bind(FveCommandRecorder& recorder);
+
+	private:
+		FveDevice& fveDevice;
+		VkPipeline computePipeline;
+		std::shared_ptr<FveShaderModule> compShader;
 	};
 
 
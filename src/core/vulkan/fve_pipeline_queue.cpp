@@ -0,0 +1,183 @@
+#include "fve_pipeline_queue.hpp"
+#include "../utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace fve {
+
+	u32 FvePipelineQueue::spareThreadCount(u32 busyThreads) {
+		u32 cores = std::max(1u, std::thread::hardware_concurrency());
+		return cores > busyThreads ? cores - busyThreads : 1;
+	}
+
+	FvePipelineQueue::FvePipelineQueue(FveDevice& device, u32 maxThreads) : device{ device }, maxThreads{ std::max(1u, maxThreads) } {
+		FVE_CORE_DEBUG("Pipeline queue compiles on up to {0} threads", this->maxThreads);
+	}
+
+	FvePipelineQueue::~FvePipelineQueue() {
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+
+		// workers finish the pipeline they are on and leave the rest
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	FvePipelineQueue::Handle FvePipelineQueue::add(const std::string& vertFilePath, const std::string& fragFilePath, std::unique_ptr<PipelineConfigInfo> configInfo, const std::string& materialName) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Handle handle = static_cast<Handle>(requests.size());
+
+		Request& request = requests.emplace_back();
+		request.vertFilePath = vertFilePath;
+		request.fragFilePath = fragFilePath;
+		request.configInfo = std::move(configInfo);
+		request.materialName = materialName;
+
+		startWorker();
+		return handle;
+	}
+
+	FvePipelineQueue::Handle FvePipelineQueue::addVariant(FvePipeline& pipeline, const ShaderVariant& variant) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Handle handle = static_cast<Handle>(requests.size());
+
+		Request& request = requests.emplace_back();
+		request.basePipeline = &pipeline;
+		request.variant = variant;
+		request.variantPipeline = pipeline.findVariant(variant);
+
+		if (request.variantPipeline != VK_NULL_HANDLE) {
+			// toggling back to a variant used before costs nothing, keep it out of the workers' way
+			request.done = true;
+			doneRequests++;
+			return handle;
+		}
+
+		startWorker();
+		return handle;
+	}
+
+	bool FvePipelineQueue::isReady(Handle handle) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		assert(handle < requests.size() && "Unknown pipeline handle");
+
+		Request& request = requests[handle];
+		if (request.done && request.error) {
+			std::rethrow_exception(request.error);
+		}
+		return request.done;
+	}
+
+	VkPipeline FvePipelineQueue::getVariant(Handle handle) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		assert(handle < requests.size() && "Unknown pipeline handle");
+
+		Request& request = requests[handle];
+		assert(request.done && request.basePipeline != nullptr && "Pipeline variant is not ready");
+		return request.variantPipeline;
+	}
+
+	void FvePipelineQueue::waitIdle() {
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (compileNext(lock)) {}
+		doneCondition.wait(lock, [&]() { return doneRequests == requests.size(); });
+	}
+
+	void FvePipelineQueue::startWorker() {
+		// running workers pick the request up once they are done, otherwise one more is started
+		joinExitedWorkers();
+		if (runningWorkers < maxThreads) {
+			runningWorkers++;
+			workers.emplace_back(&FvePipelineQueue::workerLoop, this);
+		}
+	}
+
+	std::unique_ptr<FvePipeline> FvePipelineQueue::wait(Handle handle) {
+		std::unique_lock<std::mutex> lock{ mutex };
+		assert(handle < requests.size() && "Unknown pipeline handle");
+
+		Request& request = requests[handle];
+		assert(request.basePipeline == nullptr && "Variants are polled, not waited on");
+
+		auto start = std::chrono::high_resolution_clock::now();
+		// help out instead of idling, sleep only once everything is being compiled
+		while (!request.done) {
+			if (!compileNext(lock)) {
+				doneCondition.wait(lock, [&]() { return request.done; });
+			}
+		}
+		float waitMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (request.error) {
+			std::rethrow_exception(request.error);
+		}
+
+		assert(request.pipeline != nullptr && "Pipeline was already taken from the queue");
+
+		FVE_CORE_DEBUG("Pipeline {0} ready after waiting {1:.3f} ms", request.materialName, waitMilliseconds);
+
+		request.pipeline->registerMaterial(request.materialName);
+		return std::move(request.pipeline);
+	}
+
+	bool FvePipelineQueue::compileNext(std::unique_lock<std::mutex>& lock) {
+		// variants that already existed were done when they were added
+		while (nextRequest < requests.size() && requests[nextRequest].done) {
+			nextRequest++;
+		}
+		if (nextRequest == requests.size()) return false;
+		Request& request = requests[nextRequest++];
+
+		// only this thread touches the request until it is marked done
+		lock.unlock();
+		std::unique_ptr<FvePipeline> pipeline;
+		VkPipeline variantPipeline = VK_NULL_HANDLE;
+		std::exception_ptr error;
+		try {
+			if (request.basePipeline != nullptr) {
+				variantPipeline = request.basePipeline->createVariant(request.variant);
+			}
+			else {
+				pipeline.reset(new FvePipeline(device, request.vertFilePath, request.fragFilePath, *request.configInfo));
+			}
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		request.pipeline = std::move(pipeline);
+		request.variantPipeline = variantPipeline;
+		request.error = error;
+		request.configInfo.reset();
+		request.done = true;
+		doneRequests++;
+		doneCondition.notify_all();
+		return true;
+	}
+
+	void FvePipelineQueue::joinExitedWorkers() {
+		// an exited worker no longer needs the lock, joining it here can't deadlock
+		for (auto id : exitedWorkers) {
+			auto it = std::find_if(workers.begin(), workers.end(), [&](const std::thread& worker) { return worker.get_id() == id; });
+			assert(it != workers.end() && "Exited worker is not in the queue");
+			it->join();
+			workers.erase(it);
+		}
+		exitedWorkers.clear();
+	}
+
+	void FvePipelineQueue::workerLoop() {
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (!stopping && compileNext(lock)) {}
+
+		runningWorkers--;
+		exitedWorkers.push_back(std::this_thread::get_id());
+	}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+#include "fve_device.hpp"
+#include "fve_pipeline.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Compiles graphics pipelines on background threads.
+	 *
+	 * Systems add their pipelines up front and carry on. Each add starts a worker while fewer than
+	 * the thread limit are running, and a worker exits as soon as nothing is left to compile, so no
+	 * compile threads stay around to compete with the job system during frames. Everything goes
+	 * through the device's pipeline cache, which is internally synchronized, so no extra locking is
+	 * needed around it.
+	 *
+	 * A system later waits only on its own handles. The waiting thread compiles pending pipelines
+	 * itself in the meantime, and registers the material once its own is done since the asset
+	 * registry is not thread safe. Materials are therefore numbered in wait order, not in the
+	 * order the pipelines happen to finish.
+	 *
+	 * Shader variants of a finished pipeline go through the same workers. The frame loop only polls
+	 * them and keeps drawing with the current pipeline until the variant is ready.
+	 */
+	class FvePipelineQueue {
+	public:
+		using Handle = u32;
+
+		// the cores left over by threads that are already busy, at least one
+		static u32 spareThreadCount(u32 busyThreads);
+
+		FvePipelineQueue(FveDevice& device, u32 maxThreads);
+		~FvePipelineQueue();
+
+		FvePipelineQueue(const FvePipelineQueue&) = delete;
+		FvePipelineQueue& operator=(const FvePipelineQueue&) = delete;
+
+		// the config is heap allocated since it points into itself, it lives until the pipeline is compiled
+		Handle add(const std::string& vertFilePath, const std::string& fragFilePath, std::unique_ptr<PipelineConfigInfo> configInfo, const std::string& materialName);
+
+		// blocks until the pipeline is compiled and hands it over, rethrows if compilation failed.
+		// must be called exactly once per handle, from the main thread
+		std::unique_ptr<FvePipeline> wait(Handle handle);
+
+		// compiles another specialization of a pipeline taken from the queue, the pipeline must outlive
+		// the request. a variant that was built before is ready right away
+		Handle addVariant(FvePipeline& pipeline, const ShaderVariant& variant);
+		// never blocks, rethrows if compilation failed
+		bool isReady(Handle handle);
+		// the compiled variant, owned by its pipeline. the handle must be ready
+		VkPipeline getVariant(Handle handle);
+
+		// blocks until every request is compiled, before the pipelines variants are built from go away
+		void waitIdle();
+
+	private:
+		struct Request {
+			std::string vertFilePath;
+			std::string fragFilePath;
+			std::unique_ptr<PipelineConfigInfo> configInfo;
+			std::string materialName;
+
+			// set for variant requests instead of the paths and config
+			FvePipeline* basePipeline = nullptr;
+			ShaderVariant variant{};
+			VkPipeline variantPipeline = VK_NULL_HANDLE;
+
+			std::unique_ptr<FvePipeline> pipeline;
+			std::exception_ptr error;
+			bool done = false;
+		};
+
+		// starts a worker for a new request unless enough are running, expects the lock held
+		void startWorker();
+		void workerLoop();
+		// takes the next pending request and compiles it with the lock released, false if none is pending
+		bool compileNext(std::unique_lock<std::mutex>& lock);
+		// joins the workers that ran out of work, expects the lock held
+		void joinExitedWorkers();
+
+		FveDevice& device;
+		u32 maxThreads;
+
+		std::vector<std::thread> workers;
+		std::vector<std::thread::id> exitedWorkers;
+		u32 runningWorkers = 0;
+
+		std::mutex mutex;
+		std::condition_variable doneCondition;
+
+		// a deque so requests keep their address while more are added
+		std::deque<Request> requests;
+		size_t nextRequest = 0;
+		size_t doneRequests = 0;
+		bool stopping = false;
+	};
+
+}
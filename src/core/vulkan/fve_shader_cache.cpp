@@ -0,0 +1,107 @@
+#include "fve_shader_cache.hpp"
+#include "../utils/fve_mapped_file.hpp"
+#include "../utils/fve_utils.hpp"
+#include "../utils/fve_logger.hpp"
+
+#include <stdexcept>
+#include <system_error>
+
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
+
+namespace fve {
+
+	FveShaderCache fveShaderCache;
+
+	std::shared_ptr<FveShaderModule> FveShaderCache::acquire(FveDevice& device, const std::string& filepath) {
+		std::string enginePath = ENGINE_DIR + filepath;
+
+		std::error_code sizeError;
+		std::error_code timeError;
+		std::uintmax_t fileSize = std::filesystem::file_size(enginePath, sizeError);
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(enginePath, timeError);
+		if (sizeError || timeError) {
+			throw std::runtime_error("failed to open file " + filepath);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			auto it = paths.find(enginePath);
+			if (it != paths.end() && it->second.fileSize == fileSize && it->second.writeTime == writeTime) {
+				if (auto module = findModule(it->second.hash)) {
+					stats.pathHits++;
+					return module;
+				}
+			}
+		}
+
+		// mapping, hashing and module creation happen outside the lock so compile threads don't queue up here
+		FveMappedFile file;
+		if (!file.open(enginePath)) {
+			throw std::runtime_error("failed to open file " + filepath);
+		}
+		if (file.size() % sizeof(uint32_t) != 0) {
+			throw std::runtime_error("invalid SPIR-V size in " + filepath);
+		}
+
+		u64 hash = fnv1a(file.data(), file.size());
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			paths[enginePath] = { hash, fileSize, writeTime };
+			if (auto module = findModule(hash)) {
+				stats.contentHits++;
+				return module;
+			}
+		}
+
+		VkShaderModuleCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = file.size();
+		// mappings are page aligned, which satisfies SPIR-V's word alignment
+		createInfo.pCode = static_cast<const uint32_t*>(file.data());
+
+		VkShaderModule shaderModule;
+		if (vkCreateShaderModule(device.device(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create shader module");
+		}
+
+		VkDevice vkDevice = device.device();
+		std::shared_ptr<FveShaderModule> module{ new FveShaderModule{ shaderModule, hash, file.size() }, [vkDevice](FveShaderModule* module) {
+			vkDestroyShaderModule(vkDevice, module->module, nullptr);
+			delete module;
+		} };
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		// another thread may have created the same module in the meantime, ours is dropped again then
+		if (auto existing = findModule(hash)) {
+			stats.contentHits++;
+			return existing;
+		}
+
+		modules[hash] = module;
+		stats.modulesCreated++;
+		FVE_CORE_DEBUG("Created shader module {0} ({1} bytes)", filepath, file.size());
+		return module;
+	}
+
+	std::shared_ptr<FveShaderModule> FveShaderCache::findModule(u64 hash) {
+		auto it = modules.find(hash);
+		if (it == modules.end()) return nullptr;
+
+		auto module = it->second.lock();
+		if (!module) {
+			// every pipeline using it is gone, the entry would only pile up
+			modules.erase(it);
+		}
+		return module;
+	}
+
+	FveShaderCache::Stats FveShaderCache::getStats() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		return stats;
+	}
+
+}
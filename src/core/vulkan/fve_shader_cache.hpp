@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../fve_defines.hpp"
+#include "fve_device.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fve {
+
+	struct FveShaderModule {
+		VkShaderModule module = VK_NULL_HANDLE;
+		u64 hash = 0;
+		size_t codeSize = 0;
+	};
+
+	/*
+	 * Shares VkShaderModules between every pipeline that uses the same SPIR-V.
+	 *
+	 * Lookups go by path first: as long as the file's size and modification time are unchanged the
+	 * module is returned without touching the file at all. Otherwise the file is memory mapped and
+	 * hashed, and identical contents under another path reuse the existing module as well.
+	 * Modules are reference counted, the last pipeline to release one destroys it, so the cache
+	 * itself only holds weak references. Safe to use from the pipeline compile threads.
+	 */
+	class FveShaderCache {
+	public:
+		struct Stats {
+			u32 pathHits = 0; // served without any file I/O
+			u32 contentHits = 0; // file was read but an identical module already existed
+			u32 modulesCreated = 0;
+		};
+
+		std::shared_ptr<FveShaderModule> acquire(FveDevice& device, const std::string& filepath);
+
+		Stats getStats();
+
+	private:
+		struct PathEntry {
+			u64 hash;
+			std::uintmax_t fileSize;
+			std::filesystem::file_time_type writeTime;
+		};
+
+		// the live module with these contents, drops the entry once it expired. expects the lock held
+		std::shared_ptr<FveShaderModule> findModule(u64 hash);
+
+		std::mutex mutex;
+		std::unordered_map<std::string, PathEntry> paths;
+		std::unordered_map<u64, std::weak_ptr<FveShaderModule>> modules;
+		Stats stats{};
+	};
+
+	extern FveShaderCache fveShaderCache;
+
+}
@@ -3,32 +3,47 @@
 #include "../../core/utils/fve_logger.hpp"
 
 // std
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 
 namespace fve {
 
-	FveSwapChain::FveSwapChain(FveDevice& deviceRef, VkExtent2D extent)
-		: device{ deviceRef }, windowExtent{ extent } {
+	FveSwapChain::FveSwapChain(FveDevice& deviceRef, VkExtent2D extent, const Config& config)
+		: device{ deviceRef }, windowExtent{ extent }, config{ config } {
 		init();
 	}
 
-	FveSwapChain::FveSwapChain(FveDevice& deviceRef, VkExtent2D extent, std::shared_ptr<FveSwapChain> previous)
-		: device{ deviceRef }, windowExtent{ extent }, oldSwapChain{ previous } {
+	FveSwapChain::FveSwapChain(FveDevice& deviceRef, VkExtent2D extent, std::shared_ptr<FveSwapChain> previous, const Config& config)
+		: device{ deviceRef }, windowExtent{ extent }, config{ config }, oldSwapChain{ previous } {
 		init();
 		// clean up old swap chain
 		oldSwapChain = nullptr;
 	}
 
+	const char* FveSwapChain::latencyModeName(LatencyMode mode) {
+		switch (mode) {
+		case LatencyMode::LowLatency: return "low latency";
+		case LatencyMode::Throughput: return "throughput";
+		case LatencyMode::VSync: return "vsync";
+		}
+		return "unknown";
+	}
+
 	void FveSwapChain::init() {
+		assert(config.framesInFlight >= 1 && config.framesInFlight <= MAX_FRAMES_IN_FLIGHT && "Frames in flight out of range");
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
+		createSceneImage();
 		createDepthResources();
 		createFramebuffers();
 		createSyncObjects();
@@ -47,41 +62,53 @@ namespace fve {
 			swapChain = nullptr;
 		}
 
-		for (int i = 0; i < depthImages.size(); i++) {
-			vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-			vmaDestroyImage(fveAllocator, depthImages[i], depthImageAllocations[i]);
-		}
-		depthImageAllocations.clear();
+		vkDestroyImageView(device.device(), sceneImageView, nullptr);
+		vmaDestroyImage(fveAllocator, sceneImage, sceneImageAllocation);
+		vkDestroyImageView(device.device(), depthImageView, nullptr);
+		vmaDestroyImage(fveAllocator, depthImage, depthImageAllocation);
 
-		for (auto framebuffer : swapChainFramebuffers) {
-			vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
-		}
+		vkDestroyFramebuffer(device.device(), sceneFramebuffer, nullptr);
 
 		vkDestroyRenderPass(device.device(), renderPass, nullptr);
+		vkDestroyRenderPass(device.device(), loadRenderPass, nullptr);
 
 		// cleanup synchronization objects
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < config.framesInFlight; i++) {
 			vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
 			vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(device.device(), inFlightFences[i], nullptr);
 		}
 
 		FVE_CORE_TRACE("Swap chain destroyed");
 	}
 
-	VkResult FveSwapChain::acquireNextImage(uint32_t* imageIndex) {
-		vkWaitForFences(
-			device.device(),
-			1,
-			&inFlightFences[currentFrame],
-			VK_TRUE,
-			std::numeric_limits<uint64_t>::max());
+	void FveSwapChain::recreateDepthAttachment(bool sampledDepth, uint64_t lastFrame) {
+		// the store op is part of the render passes and the framebuffer holds the old view
+		device.deferDestroy(lastFrame, [vkDevice = device.device(), image = depthImage, allocation = depthImageAllocation, view = depthImageView,
+			framebuffer = sceneFramebuffer, pass = renderPass, loadPass = loadRenderPass]() {
+			vkDestroyFramebuffer(vkDevice, framebuffer, nullptr);
+			vkDestroyRenderPass(vkDevice, pass, nullptr);
+			vkDestroyRenderPass(vkDevice, loadPass, nullptr);
+			vkDestroyImageView(vkDevice, view, nullptr);
+			vmaDestroyImage(fveAllocator, image, allocation);
+		});
+
+		config.sampledDepth = sampledDepth;
+		createRenderPass();
+		createDepthResources();
+		createFramebuffers();
+	}
+
+	VkResult FveSwapChain::acquireNextImage(uint32_t* imageIndex, uint64_t frame) {
+		// the frame that last used this slot's semaphores, and the caller's per frame resources
+		if (frame > config.framesInFlight) {
+			device.waitForFrame(frame - config.framesInFlight);
+		}
 
 		VkResult result = vkAcquireNextImageKHR(
 			device.device(),
 			swapChain,
 			std::numeric_limits<uint64_t>::max(),
-			imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
+			imageAvailableSemaphores[frame % config.framesInFlight],  // must be a not signaled semaphore
 			VK_NULL_HANDLE,
 			imageIndex);
 
@@ -89,17 +116,33 @@ namespace fve {
 	}
 
 	VkResult FveSwapChain::submitCommandBuffers(
-		const VkCommandBuffer* buffers, uint32_t* imageIndex) {
-		if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-			vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
+		const VkCommandBuffer* buffers, uint32_t* imageIndex, uint64_t frame) {
+		const size_t slot = frame % config.framesInFlight;
+
+		// images may be acquired out of order, the last frame drawing to this one has to be done
+		if (imageFrames[*imageIndex] != 0) {
+			device.waitForFrame(imageFrames[*imageIndex]);
 		}
-		imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+		imageFrames[*imageIndex] = frame;
+
+		// the values of binary semaphores are ignored
+		uint64_t waitValues[] = { 0 };
+		uint64_t signalValues[] = { 0, frame };
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = 1;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = 2;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
 
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[slot] };
+		// the image is first touched by the copy from the scene, everything before it may run early
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_TRANSFER_BIT };
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
@@ -107,15 +150,17 @@ namespace fve {
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = buffers;
 
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
+		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[slot], device.frameTimeline() };
+		submitInfo.signalSemaphoreCount = 2;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
-		vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-		if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-			VK_SUCCESS) {
+		// upload threads submit to the same queue
+		std::lock_guard<std::mutex> queueLock{ device.getQueueMutex() };
+
+		if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		device.markFrameSubmitted(frame);
 
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -131,8 +176,6 @@ namespace fve {
 
 		auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
 		return result;
 	}
 
@@ -143,7 +186,11 @@ namespace fve {
 		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 		VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+		// the fewest images keep the queue to the display short, a spare one lets rendering run ahead
+		uint32_t imageCount = swapChainSupport.capabilities.minImageCount;
+		if (config.latencyMode != LatencyMode::LowLatency) {
+			imageCount++;
+		}
 		if (swapChainSupport.capabilities.maxImageCount > 0 &&
 			imageCount > swapChainSupport.capabilities.maxImageCount) {
 			imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -158,7 +205,7 @@ namespace fve {
 		createInfo.imageColorSpace = surfaceFormat.colorSpace;
 		createInfo.imageExtent = extent;
 		createInfo.imageArrayLayers = 1;
-		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 		QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
 		uint32_t queueFamilyIndices[] = { indices.graphicsFamily, indices.presentFamily };
@@ -196,6 +243,8 @@ namespace fve {
 
 		swapChainImageFormat = surfaceFormat.format;
 		swapChainExtent = extent;
+		sceneExtent.width = static_cast<uint32_t>(std::ceil(extent.width * config.maxRenderScale));
+		sceneExtent.height = static_cast<uint32_t>(std::ceil(extent.height * config.maxRenderScale));
 		
 		FVE_CORE_TRACE("Created a new swap chain");
 	}
@@ -222,14 +271,25 @@ namespace fve {
 	}
 
 	void FveSwapChain::createRenderPass() {
+		renderPass = createScenePass(false);
+		// compatible pass that continues a frame started with renderPass
+		loadRenderPass = createScenePass(true);
+	}
+
+	VkRenderPass FveSwapChain::createCompatibleRenderPass() {
+		return createScenePass(false);
+	}
+
+	VkRenderPass FveSwapChain::createScenePass(bool keepContents) {
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = findDepthFormat();
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.loadOp = keepContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		// kept for the depth pyramid and for passes that resume the frame, both only happen with sampled depth
+		depthAttachment.storeOp = config.sampledDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.initialLayout = keepContents ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
 		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference depthAttachmentRef{};
@@ -239,12 +299,13 @@ namespace fve {
 		VkAttachmentDescription colorAttachment = {};
 		colorAttachment.format = getSwapChainImageFormat();
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.loadOp = keepContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.initialLayout = keepContents ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		// the render graph moves it on to the copy into the swap chain image
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentRef = {};
 		colorAttachmentRef.attachment = 0;
@@ -258,11 +319,21 @@ namespace fve {
 
 		VkSubpassDependency dependency = {};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.srcAccessMask = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 		dependency.dstSubpass = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		if (keepContents) {
+			dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
+		else {
+			// the depth attachment is shared, so the clear also waits for the previous frame's depth writes
+			dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		}
 
 		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 		VkRenderPassCreateInfo renderPassInfo = {};
@@ -274,110 +345,157 @@ namespace fve {
 		renderPassInfo.dependencyCount = 1;
 		renderPassInfo.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+		VkRenderPass pass;
+		if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &pass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass!");
 		}
+		return pass;
 	}
 
 	void FveSwapChain::createFramebuffers() {
-		swapChainFramebuffers.resize(imageCount());
-		for (size_t i = 0; i < imageCount(); i++) {
-			std::array<VkImageView, 2> attachments = { swapChainImageViews[i], depthImageViews[i] };
-
-			VkExtent2D swapChainExtent = getSwapChainExtent();
-			VkFramebufferCreateInfo framebufferInfo = {};
-			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			framebufferInfo.renderPass = renderPass;
-			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-			framebufferInfo.pAttachments = attachments.data();
-			framebufferInfo.width = swapChainExtent.width;
-			framebufferInfo.height = swapChainExtent.height;
-			framebufferInfo.layers = 1;
-
-			if (vkCreateFramebuffer(
-				device.device(),
-				&framebufferInfo,
-				nullptr,
-				&swapChainFramebuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to create framebuffer!");
-			}
+		std::array<VkImageView, 2> attachments = { sceneImageView, depthImageView };
+
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = renderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
+		framebufferInfo.width = sceneExtent.width;
+		framebufferInfo.height = sceneExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(
+			device.device(),
+			&framebufferInfo,
+			nullptr,
+			&sceneFramebuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create framebuffer!");
+		}
+	}
+
+	void FveSwapChain::createSceneImage() {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = sceneExtent.width;
+		imageInfo.extent.height = sceneExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// the source of the upscaling copy into the swap chain image
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.flags = 0;
+
+		VmaAllocationCreateInfo allocCreateInfo{};
+		allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		VmaAllocationInfo allocInfo{};
+
+		device.createImageWithInfo(
+			imageInfo,
+			allocCreateInfo,
+			sceneImageAllocation,
+			allocInfo,
+			sceneImage);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = sceneImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = swapChainImageFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &sceneImageView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
 		}
 	}
 
 	void FveSwapChain::createDepthResources() {
 		VkFormat depthFormat = findDepthFormat();
 		swapChainDepthFormat = depthFormat;
-		VkExtent2D swapChainExtent = getSwapChainExtent();
-
-		depthImages.resize(imageCount());
-		depthImageAllocations.resize(imageCount());
-		depthImageViews.resize(imageCount());
-
-		for (int i = 0; i < depthImages.size(); i++) {
-			VkImageCreateInfo imageInfo{};
-			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			imageInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageInfo.extent.width = swapChainExtent.width;
-			imageInfo.extent.height = swapChainExtent.height;
-			imageInfo.extent.depth = 1;
-			imageInfo.mipLevels = 1;
-			imageInfo.arrayLayers = 1;
-			imageInfo.format = depthFormat;
-			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			imageInfo.flags = 0;
-
-			VmaAllocationCreateInfo allocCreateInfo{};
-			allocCreateInfo.memoryTypeBits = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-
-			VmaAllocationInfo allocInfo{};
-
-			device.createImageWithInfo(
-				imageInfo,
-				allocCreateInfo,
-				depthImageAllocations[i],
-				allocInfo,
-				depthImages[i]);
-
-			VkImageViewCreateInfo viewInfo{};
-			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			viewInfo.image = depthImages[i];
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			viewInfo.format = depthFormat;
-			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			viewInfo.subresourceRange.baseMipLevel = 0;
-			viewInfo.subresourceRange.levelCount = 1;
-			viewInfo.subresourceRange.baseArrayLayer = 0;
-			viewInfo.subresourceRange.layerCount = 1;
 
-			if (vkCreateImageView(device.device(), &viewInfo, nullptr, &depthImageViews[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to create texture image view!");
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = sceneExtent.width;
+		imageInfo.extent.height = sceneExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = depthFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.flags = 0;
+
+		VmaAllocationCreateInfo allocCreateInfo{};
+		allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		if (config.sampledDepth) {
+			// sampled by the depth pyramid build
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		}
+		else {
+			// never stored, so tilers can keep it on chip and skip backing it with memory at all
+			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			if (device.supportsLazilyAllocatedMemory()) {
+				allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
 			}
 		}
+
+		VmaAllocationInfo allocInfo{};
+
+		device.createImageWithInfo(
+			imageInfo,
+			allocCreateInfo,
+			depthImageAllocation,
+			allocInfo,
+			depthImage);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = depthImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = depthFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &depthImageView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+
+		FVE_CORE_DEBUG("Depth attachment {0}x{1}, {2}",
+			sceneExtent.width,
+			sceneExtent.height,
+			config.sampledDepth ? "sampled" : (device.supportsLazilyAllocatedMemory() ? "transient, lazily allocated" : "transient"));
 	}
 
 	void FveSwapChain::createSyncObjects() {
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+		imageAvailableSemaphores.resize(config.framesInFlight);
+		renderFinishedSemaphores.resize(config.framesInFlight);
+		imageFrames.assign(imageCount(), 0);
 
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fenceInfo = {};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		for (size_t i = 0; i < config.framesInFlight; i++) {
 			if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
 				VK_SUCCESS ||
 				vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-				VK_SUCCESS ||
-				vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+				VK_SUCCESS) {
 				throw std::runtime_error("failed to create synchronization objects for a frame!");
 			}
 		}
@@ -397,19 +515,28 @@ namespace fve {
 
 	VkPresentModeKHR FveSwapChain::chooseSwapPresentMode(
 		const std::vector<VkPresentModeKHR>& availablePresentModes) {
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-				FVE_CORE_DEBUG("Present mode: Mailbox");
-				return availablePresentMode;
-			}
+		// fifo is always available and ends every list
+		std::vector<VkPresentModeKHR> preferred;
+		switch (config.latencyMode) {
+		case LatencyMode::LowLatency:
+			preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+			break;
+		case LatencyMode::Throughput:
+			preferred = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR };
+			break;
+		case LatencyMode::VSync:
+			preferred = { VK_PRESENT_MODE_FIFO_KHR };
+			break;
 		}
 
-		// for (const auto &availablePresentMode : availablePresentModes) {
-		// 	if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-		// 		FVE_CORE_DEBUG("Present mode: Immediate");
-		// 		return availablePresentMode;
-		// 	}
-		// }
+		for (VkPresentModeKHR presentMode : preferred) {
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end()) {
+				FVE_CORE_DEBUG("Present mode: {0} for {1}",
+					presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR ? "Immediate" : (presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? "Mailbox" : "V-Sync"),
+					latencyModeName(config.latencyMode));
+				return presentMode;
+			}
+		}
 
 		FVE_CORE_DEBUG("Present mode: V-Sync");
 		return VK_PRESENT_MODE_FIFO_KHR;
@@ -436,7 +563,7 @@ namespace fve {
 		return device.findSupportedFormat(
 			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 	}
 
 }  // namespace lve
@@ -14,18 +14,68 @@ namespace fve {
 
 class FveSwapChain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  FveSwapChain(FveDevice &deviceRef, VkExtent2D windowExtent);
-  FveSwapChain(FveDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<FveSwapChain> previous);
+  // upper bound of Config::framesInFlight
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+
+  // each mode picks the present mode and the number of images together
+  enum class LatencyMode {
+    // immediate where available with the fewest images, frames show as soon as they are done and may tear
+    LowLatency,
+    // mailbox with a spare image, rendering never waits for the display and stale frames are dropped
+    Throughput,
+    // fifo with a spare image, every frame is shown without tearing and rendering waits once the queue is full
+    VSync
+  };
+
+  struct Config {
+    // frames the CPU may record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT
+    uint32_t framesInFlight = 2;
+    LatencyMode latencyMode = LatencyMode::Throughput;
+    // keeps the depth attachment after the render pass so it can be sampled, otherwise it is a
+    // transient attachment that may never leave tile memory
+    bool sampledDepth = true;
+    // the scene attachments are this times the swap chain extent, frames render to a part of them
+    float maxRenderScale = 1.0f;
+
+    bool operator==(const Config &other) const {
+      return framesInFlight == other.framesInFlight && latencyMode == other.latencyMode &&
+             sampledDepth == other.sampledDepth && maxRenderScale == other.maxRenderScale;
+    }
+    bool operator!=(const Config &other) const { return !(*this == other); }
+  };
+
+  static const char *latencyModeName(LatencyMode mode);
+
+  FveSwapChain(FveDevice &deviceRef, VkExtent2D windowExtent, const Config &config);
+  FveSwapChain(FveDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<FveSwapChain> previous, const Config &config);
   ~FveSwapChain();
 
   FveSwapChain(const FveSwapChain &) = delete;
   FveSwapChain &operator=(const FveSwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
+  // the scene is drawn offscreen and copied to the swap chain image before presenting
+  VkFramebuffer getFramebuffer() { return sceneFramebuffer; }
   VkRenderPass getRenderPass() { return renderPass; }
+  // same attachments as getRenderPass(), but keeps their contents so a frame can resume drawing
+  VkRenderPass getLoadRenderPass() { return loadRenderPass; }
+  // a pass compatible with the render passes of this and every later swap chain, for building
+  // pipelines that outlive it. the caller destroys it
+  VkRenderPass createCompatibleRenderPass();
+  VkImage getImage(int index) { return swapChainImages[index]; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  // color attachment of the scene, left in COLOR_ATTACHMENT_OPTIMAL by the render passes
+  VkImage getSceneImage() { return sceneImage; }
+  VkExtent2D getSceneExtent() { return sceneExtent; }
+  // one depth attachment shared by every swap chain image, frames are ordered by the render pass dependencies
+  VkImage getDepthImage() { return depthImage; }
+  VkImageView getDepthImageView() { return depthImageView; }
+  // what barriers on the depth image cover, the view only sees depth
+  VkImageAspectFlags getDepthAspects() const { return FveDevice::depthAspects(swapChainDepthFormat); }
+  bool hasSampledDepth() const { return config.sampledDepth; }
+  const Config &getConfig() const { return config; }
+  // swaps in a sampled or a transient depth attachment together with the render passes and the framebuffer
+  // built on it, the swap chain images stay. the old ones are destroyed once lastFrame has retired
+  void recreateDepthAttachment(bool sampledDepth, uint64_t lastFrame);
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -37,8 +87,10 @@ class FveSwapChain {
   }
   VkFormat findDepthFormat();
 
-  VkResult acquireNextImage(uint32_t *imageIndex);
-  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  // frame is the caller's frame number, counted from 1. acquiring waits until frame - framesInFlight
+  // has retired on the device's frame timeline, the submission signals frame on it
+  VkResult acquireNextImage(uint32_t *imageIndex, uint64_t frame);
+  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint64_t frame);
 
   bool compareSwapFormats(const FveSwapChain& swapChain) const {
       return    swapChain.swapChainDepthFormat == swapChainDepthFormat &&
@@ -49,8 +101,10 @@ class FveSwapChain {
     void init();
     void createSwapChain();
     void createImageViews();
+    void createSceneImage();
     void createDepthResources();
     void createRenderPass();
+    VkRenderPass createScenePass(bool keepContents);
     void createFramebuffers();
     void createSyncObjects();
 
@@ -65,27 +119,35 @@ class FveSwapChain {
   VkFormat swapChainDepthFormat;
   VkExtent2D swapChainExtent;
 
-  std::vector<VkFramebuffer> swapChainFramebuffers;
+  VkExtent2D sceneExtent;
+
+  VkFramebuffer sceneFramebuffer;
   VkRenderPass renderPass;
+  VkRenderPass loadRenderPass;
+
+  VkImage sceneImage = VK_NULL_HANDLE;
+  VmaAllocation sceneImageAllocation = VK_NULL_HANDLE;
+  VkImageView sceneImageView = VK_NULL_HANDLE;
 
-  std::vector<VkImage> depthImages;
-  std::vector<VmaAllocation> depthImageAllocations;
-  std::vector<VkImageView> depthImageViews;
+  VkImage depthImage = VK_NULL_HANDLE;
+  VmaAllocation depthImageAllocation = VK_NULL_HANDLE;
+  VkImageView depthImageView = VK_NULL_HANDLE;
 
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
   FveDevice &device;
   VkExtent2D windowExtent;
+  Config config;
 
   VkSwapchainKHR swapChain;
   std::shared_ptr<FveSwapChain> oldSwapChain;
 
+  // indexed by frame % framesInFlight
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> imagesInFlight;
-  size_t currentFrame = 0;
+  // last frame that rendered to each image, 0 if none has yet
+  std::vector<uint64_t> imageFrames;
 };
 
 }  // namespace lve
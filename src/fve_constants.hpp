@@ -5,4 +5,12 @@ namespace fve {
 	const int WIDTH = 1920;
 	const int HEIGHT = 1080;
 
+	// capacity of the point light buffer the clusters are built from
+	const int MAX_LIGHTS = 8192;
+	// length of a cluster's light list, shader variants may shade fewer per fragment
+	const int MAX_LIGHTS_PER_CLUSTER = 64;
+
+	// cascades of the sun's shadow map, nearest first
+	const int SHADOW_CASCADE_COUNT = 4;
+
 }
\ No newline at end of file
@@ -56,6 +56,12 @@ namespace fve {
 		std::unique_ptr<PointLightComponent> pointLight = nullptr;
 		std::shared_ptr<TextureComponent> texture = nullptr;
 
+		// drawn by the indirect render system instead of the render queue
+		bool gpuDriven = false;
+
+		// static objects go into the SAH built part of the scene BVH and are never updated
+		bool isStatic = false;
+
 	private:
 		id_t id;
 
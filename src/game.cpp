@@ -5,9 +5,15 @@
 #include "render/systems/simple_render_system.hpp"
 #include "render/systems/point_light_system.hpp"
 #include "render/systems/textured_render_system.hpp"
+#include "render/systems/indirect_render_system.hpp"
+#include "render/systems/depth_prepass_system.hpp"
 #include "render/fve_camera.hpp"
+#include "render/fve_shadow_maps.hpp"
+#include "render/fve_render_graph.hpp"
 #include "core/vulkan/fve_buffer.hpp"
 #include "core/vulkan/fve_memory.hpp"
+#include "core/vulkan/fve_pipeline_queue.hpp"
+#include "core/vulkan/fve_shader_cache.hpp"
 #include "assets/fve_assets.hpp"
 #include "core/fve_initializers.hpp"
 #include "fve_constants.hpp"
@@ -24,25 +30,60 @@
 #include <iostream>
 #include <cassert>
 #include <chrono>
+#include <algorithm>
 #include <array>
+#include <random>
+#include <type_traits>
 
 namespace fve {
 
-	Game::Game(FveWindow& window, FveDevice& device) : window{ window }, device{ device } {
+	STATIC_ASSERT((std::is_same<FveBvh::id_t, FveGameObject::id_t>::value), "The scene BVH must use game object ids.");
 
+	// fewer queue batches than this per recording job are not worth another secondary buffer
+	static constexpr u32 MIN_BATCHES_PER_JOB = 64;
+
+	// the opaque pipelines test depth EQUAL against the pre-pass while it is on
+	static ShaderVariant shaderVariant(bool lowEndShaders, bool depthPrepass) {
+		ShaderVariant variant = lowEndShaders ? ShaderVariant::lowEnd() : ShaderVariant{};
+		variant.depthEqual = depthPrepass ? VK_TRUE : VK_FALSE;
+		return variant;
+	}
+
+	// world space box of an object's mesh bounds
+	static Aabb worldBounds(FveGameObject& obj) {
+		const MeshBounds& bounds = obj.model->getMesh().bounds;
+		return Aabb::transform(bounds.aabbMin, bounds.aabbMax, obj.transform.mat4());
+	}
+
+	Game::Game(FveWindow& window, FveDevice& device, const Config& config) : window{ window }, device{ device }, config{ config } {
+
+		const int frameCount = static_cast<int>(renderer.getFramesInFlight());
 		const int numSystems = 2;
+		// light buffer, cluster light counts and cluster light lists
+		const int numClusterBindings = 3;
+		// the textured set's texture comes on top of the shadow map
+		const int numImageBindings = frameCount * (numSystems + 1);
 
 		globalPool = FveDescriptorPool::Builder(device)
-			.setMaxSets(FveSwapChain::MAX_FRAMES_IN_FLIGHT * numSystems)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, FveSwapChain::MAX_FRAMES_IN_FLIGHT)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, FveSwapChain::MAX_FRAMES_IN_FLIGHT)
+			.setMaxSets(frameCount * numSystems)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numImageBindings)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * numSystems * numClusterBindings)
 			.build();
 		globalSetLayout = FveDescriptorSetLayout::Builder(device)
 			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.build();
 		texturedSetLayout = FveDescriptorSetLayout::Builder(device)
 			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
 			.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.build();
 	}
 
@@ -56,7 +97,9 @@ namespace fve {
 
 	void Game::run() {
 
-		std::vector<std::unique_ptr<FveBuffer>> uboBuffers(FveSwapChain::MAX_FRAMES_IN_FLIGHT);
+		const u32 frameCount = renderer.getFramesInFlight();
+
+		std::vector<std::unique_ptr<FveBuffer>> uboBuffers(frameCount);
 		for (int i = 0; i < uboBuffers.size(); i++) {
 			uboBuffers[i] = std::make_unique<FveBuffer>(
 				fveAllocator,
@@ -76,24 +119,68 @@ namespace fve {
 		loadTextures();
 
 		// ================ PREPARE RENDERING SYSTEMS ================
-		SimpleRenderSystem simpleRenderSystem{ device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout() };
-		PointLightSystem pointLightSystem{ device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout() };
-		TexturedRenderSystem texturedRenderSystem{ device, renderer.getSwapChainRenderPass(), texturedSetLayout->getDescriptorSetLayout() };
+
+		// draws are collected here each frame and recorded in sorted order
+		FveRenderQueue renderQueue{ device, frameCount };
+
+		// graphics pipelines compile in the background while the rest of startup carries on,
+		// on the cores the job system leaves over
+		FvePipelineQueue pipelineQueue{ device, FvePipelineQueue::spareThreadCount(jobSystem.getThreadCount()) };
+
+		// software rasterizers and integrated GPUs start out with the cheap shader variant
+		bool lowEndShaders = device.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+			device.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+		// off by default, it only pays for itself when shading is expensive
+		bool depthPrepass = false;
+		const ShaderVariant initialVariant = shaderVariant(lowEndShaders, depthPrepass);
+
+		SimpleRenderSystem simpleRenderSystem{ device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), renderQueue.getInstanceSetLayout(), pipelineQueue, initialVariant };
+		PointLightSystem pointLightSystem{ device, frameCount, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), pipelineQueue, initialVariant };
+		TexturedRenderSystem texturedRenderSystem{ device, renderer.getSwapChainRenderPass(), texturedSetLayout->getDescriptorSetLayout(), renderQueue.getInstanceSetLayout(), pipelineQueue, initialVariant };
+		DepthPrepassSystem depthPrepassSystem{ device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), renderQueue.getInstanceSetLayout(), pipelineQueue };
+		// built from each frame's depth and tested against by the GPU-driven path
+		FveDepthPyramid depthPyramid{ device };
+		resizeDepthPyramid(depthPyramid);
+
+		IndirectRenderSystem indirectRenderSystem{ device, frameCount, renderQueue.getInstanceSetLayout(), depthPyramid };
+
+		// point lights are binned into view space clusters each frame, the lit shaders read their cluster's list
+		FveLightClusters lightClusters{ device, frameCount };
+
+		// the sun's cascades, drawn before the main pass and sampled by the lit shaders
+		FveShadowMaps shadowMaps{ device, pipelineQueue };
+		const VkDescriptorImageInfo shadowInfo = shadowMaps.descriptorInfo();
+
+		// rebuilt every frame from the passes it needs, its barriers replace the ones the systems recorded
+		FveRenderGraph renderGraph{ device };
 
 		// thing
-		std::vector<VkDescriptorSet> globalDescriptorSets(FveSwapChain::MAX_FRAMES_IN_FLIGHT);
+		std::vector<VkDescriptorSet> globalDescriptorSets(frameCount);
 		for (int i = 0; i < globalDescriptorSets.size(); i++) {
 			auto bufferInfo = uboBuffers[i]->descriptorInfo();
+			auto lightInfo = lightClusters.lightsInfo(i);
+			auto countInfo = lightClusters.countsInfo(i);
+			auto indexInfo = lightClusters.indicesInfo(i);
 			FveDescriptorWriter(*globalSetLayout, *globalPool)
 				.writeBuffer(0, &bufferInfo)
+				.writeBuffer(2, &lightInfo)
+				.writeBuffer(3, &countInfo)
+				.writeBuffer(4, &indexInfo)
+				.writeImage(5, &shadowInfo)
 				.build(globalDescriptorSets[i]);
 		}
 
 		VkSampler sampler = *fveAssets.createSampler(device, VK_FILTER_LINEAR, "default_sampler");
 
-		std::vector<VkDescriptorSet> texturedDescriptorSets(FveSwapChain::MAX_FRAMES_IN_FLIGHT);
+		// the textured descriptor sets are stored on its material
+		texturedRenderSystem.waitForPipelines(pipelineQueue);
+
+		std::vector<VkDescriptorSet> texturedDescriptorSets(frameCount);
 		for (int i = 0; i < texturedDescriptorSets.size(); i++) {
 			auto bufferInfo = uboBuffers[i]->descriptorInfo();
+			auto lightInfo = lightClusters.lightsInfo(i);
+			auto countInfo = lightClusters.countsInfo(i);
+			auto indexInfo = lightClusters.indicesInfo(i);
 
 			Material* texturedMat = fveAssets.getMaterial("texturedmaterial");
 
@@ -105,14 +192,38 @@ namespace fve {
 			FveDescriptorWriter(*texturedSetLayout, *globalPool)
 				.writeBuffer(0, &bufferInfo)
 				.writeImage(1, &imageBufferInfo)
+				.writeBuffer(2, &lightInfo)
+				.writeBuffer(3, &countInfo)
+				.writeBuffer(4, &indexInfo)
+				.writeImage(5, &shadowInfo)
 				.build(texturedDescriptorSets[i]);
 
 			texturedMat->textureSet = texturedDescriptorSets[i];
 		}
 
 		// ================ PREPARE SCENE ================
+		// models reference the default material
+		simpleRenderSystem.waitForPipelines(pipelineQueue);
 		loadGameObjects();
-		
+		buildSceneBvh();
+
+		// static opaque objects move to the GPU-driven path when the device allows it
+		if (IndirectRenderSystem::isSupported(device)) {
+			indirectRenderSystem.registerObjects(gameObjects);
+		}
+		else {
+			FVE_CORE_WARN("drawIndirectFirstInstance not supported, drawing everything through the render queue");
+		}
+
+		pointLightSystem.waitForPipelines(pipelineQueue);
+		depthPrepassSystem.waitForPipelines(pipelineQueue);
+		shadowMaps.waitForPipelines(pipelineQueue);
+
+		const FveShaderCache::Stats shaderStats = fveShaderCache.getStats();
+		FVE_CORE_DEBUG("Shader modules created: {0}, reused by path: {1}, reused by content: {2}",
+			shaderStats.modulesCreated,
+			shaderStats.pathHits,
+			shaderStats.contentHits);
 
 		FveCamera camera{};
 		camera.setViewTarget(glm::vec3(-1, -2, 2), glm::vec3(0.0f, 0.0f, 2.5f));
@@ -120,13 +231,38 @@ namespace fve {
 		auto viewerObject = FveGameObject::createGameObject();
 		viewerObject.transform.translation.z = -2.5f;
 		MovementController cameraController{};
+		cameraController.lowEndShaders = lowEndShaders;
+		// what the controls last asked for, the variant in use lags behind until it is compiled
+		bool requestedLowEndShaders = lowEndShaders;
+		bool requestedDepthPrepass = depthPrepass;
+		bool variantPending = false;
 		cameraController.init(window.getGLFWwindow(), fve::WIDTH, fve::HEIGHT);
 
+		// the scene gives up to half its resolution in each direction to hold 60 frames a second
+		FveDynamicResolution::Settings resolutionSettings{};
+		resolutionSettings.minScale = 0.5f;
+		resolutionSettings.maxScale = 1.0f;
+		resolutionSettings.targetFrameMs = 1000.0f / 60.0f;
+		renderer.setResolutionSettings(resolutionSettings);
+		cameraController.dynamicResolution = resolutionSettings.enabled;
+
+		// generous for the demo scene, a frame beyond it points at batching or culling gone wrong
+		FveFrameCounters::Budget frameBudget{};
+		frameBudget.drawCalls = 2000;
+		frameBudget.pipelineBinds = 100;
+		frameBudget.descriptorBinds = 500;
+		renderer.getFrameCounters().setBudget(frameBudget);
+
 		auto currentTime = std::chrono::high_resolution_clock::now();
 
 		// persistent uniforms
 		GlobalUbo ubo{};
 
+		// BVH culling counters, logged every few seconds
+		FrameStats frameStats{};
+		float statsTimer = 0.0f;
+		u32 statsFrames = 0;
+
 		// game loop
 		while (!window.shouldClose()) {
 			glfwPollEvents();
@@ -139,10 +275,62 @@ namespace fve {
 			cameraController.moveInPlaneXZ(window.getGLFWwindow(), frameTime, viewerObject);
 			camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
 
+			if (cameraController.occlusionCulling != indirectRenderSystem.isOcclusionCullingEnabled()) {
+				indirectRenderSystem.setOcclusionCulling(cameraController.occlusionCulling);
+				// the pyramid went stale while occlusion culling was off
+				depthPyramid.invalidate();
+				FVE_CORE_DEBUG("Occlusion culling {0}", cameraController.occlusionCulling ? "enabled" : "disabled");
+			}
+
+			if (cameraController.dynamicResolution != renderer.getResolutionSettings().enabled) {
+				FveDynamicResolution::Settings resolutionSettings = renderer.getResolutionSettings();
+				resolutionSettings.enabled = cameraController.dynamicResolution;
+				renderer.setResolutionSettings(resolutionSettings);
+				FVE_CORE_DEBUG("Dynamic resolution {0}", cameraController.dynamicResolution ? "enabled" : "disabled");
+			}
+
+			// only the depth pyramid reads depth after the main pass, without it depth can stay transient
+			renderer.setSampledDepth(indirectRenderSystem.isOcclusionCullingEnabled() && indirectRenderSystem.getObjectCount() > 0);
+
 			if (auto commandBuffer = renderer.beginFrame()) {
 				// ================ PREPARE ================
 				int frameIndex = renderer.getFrameIndex();
 
+				// the depth attachment is new after a resize or a switch between sampled and transient depth
+				if (renderer.hasSampledDepth() && renderer.getSwapChainGeneration() != pyramidSwapChainGeneration) {
+					resizeDepthPyramid(depthPyramid);
+				}
+
+				// variants compile on the pipeline queue while the frames keep drawing with the current ones
+				if (cameraController.lowEndShaders != requestedLowEndShaders || cameraController.depthPrepass != requestedDepthPrepass) {
+					requestedLowEndShaders = cameraController.lowEndShaders;
+					requestedDepthPrepass = cameraController.depthPrepass;
+					const ShaderVariant variant = shaderVariant(requestedLowEndShaders, requestedDepthPrepass);
+					simpleRenderSystem.requestShaderVariant(variant, pipelineQueue);
+					texturedRenderSystem.requestShaderVariant(variant, pipelineQueue);
+					pointLightSystem.requestShaderVariant(variant, pipelineQueue);
+					variantPending = true;
+				}
+
+				// every system switches in the same frame, the pre-pass has to match the depth test of all of them
+				if (variantPending &&
+					simpleRenderSystem.isShaderVariantReady(pipelineQueue) &&
+					texturedRenderSystem.isShaderVariantReady(pipelineQueue) &&
+					pointLightSystem.isShaderVariantReady(pipelineQueue)) {
+					if (requestedLowEndShaders != lowEndShaders) {
+						FVE_CORE_DEBUG("Using {0} shader variants", requestedLowEndShaders ? "low-end" : "full");
+					}
+					if (requestedDepthPrepass != depthPrepass) {
+						FVE_CORE_DEBUG("Depth pre-pass {0}", requestedDepthPrepass ? "enabled" : "disabled");
+					}
+					lowEndShaders = requestedLowEndShaders;
+					depthPrepass = requestedDepthPrepass;
+					simpleRenderSystem.applyShaderVariant(pipelineQueue);
+					texturedRenderSystem.applyShaderVariant(pipelineQueue);
+					pointLightSystem.applyShaderVariant(pipelineQueue);
+					variantPending = false;
+				}
+
 				FrameInfo frameInfo{
 					frameIndex,
 					frameTime,
@@ -150,9 +338,16 @@ namespace fve {
 					camera,
 					globalDescriptorSets[frameIndex],
 					texturedDescriptorSets[frameIndex],
-					gameObjects
+					gameObjects,
+					renderQueue,
+					frameStats,
+					visibleObjects,
+					&renderer.getProfiler(),
+					&renderer.getFrameCounters().getRecordTotals()
 				};
 
+				frameStats = {};
+
 				// ================ INPUT ================
 				// camera controls
 				float aspect = renderer.getAspectRatio();
@@ -164,36 +359,268 @@ namespace fve {
 				ubo.projection = camera.getProjection();
 				ubo.view = camera.getView();
 				ubo.inverseView = camera.getInverseView();
-				pointLightSystem.update(frameInfo, ubo);
+				lightClusters.updateUbo(ubo, renderer.getRenderExtent(), camera);
+				pointLightSystem.update(frameInfo, ubo, lightClusters);
 
 				// update the sun position
 				auto rotateLight = glm::rotate(glm::mat4(1.0f), frameInfo.frameTime * 0.25f, { 0.0f, 0.0f, -1.0f });
 				ubo.sun.lightDirection = rotateLight * ubo.sun.lightDirection;
 
+				// decides which cascades need drawing, cached ones only follow the sun in steps
+				shadowMaps.update(ubo, camera, sceneBvh);
+
 				// write the uniform changes
 				uboBuffers[frameIndex]->writeToBuffer(&ubo);
 				uboBuffers[frameIndex]->flush();
 
-				// ================ RENDER ================
-				
-				// begin offscreen shadow pass
-				// render shadow casting objects
-				// end offscreen shadow pass
+				// ================ CULL ================
+				updateSceneBvh();
+				visibleObjects.clear();
+				sceneBvh.queryFrustum(camera.getFrustum(), visibleObjects);
+				frameStats.visibleObjects = static_cast<u32>(visibleObjects.size());
+				frameStats.culledObjects = sceneBvh.size() - frameStats.visibleObjects;
 
-				renderer.beginSwapChainRenderPass(commandBuffer);
+				// ================ RENDER ================
 
-				// order matters with transparent objects involved
+				// collect this frame's draws and sort them by state and depth
+				renderQueue.begin(frameIndex);
 				simpleRenderSystem.renderGameObjects(frameInfo);
 				texturedRenderSystem.renderGameObjects(frameInfo);
-				pointLightSystem.render(frameInfo);
+				renderQueue.sort();
+
+				const bool occlusionPass = indirectRenderSystem.isOcclusionCullingEnabled() && indirectRenderSystem.getObjectCount() > 0;
+
+				// record the pass on every core: the depth pre-pass if enabled, the GPU-driven draws, the sorted
+				// queue split into contiguous ranges, then the lights unless the occlusion pass draws them later.
+				// order matters with transparent objects involved, and executing the buffers in job order keeps it
+				auto recordStart = std::chrono::high_resolution_clock::now();
+
+				renderQueue.beginFlush();
+				const u32 batchCount = renderQueue.getBatchCount();
+				const u32 rangeCount = std::min(jobSystem.getThreadCount(), (batchCount + MIN_BATCHES_PER_JOB - 1) / MIN_BATCHES_PER_JOB);
+				const u32 prepassJobs = depthPrepass ? 1 : 0;
+				const u32 jobCount = prepassJobs + 1 + rangeCount + (occlusionPass ? 0 : 1);
+
+				secondaryBuffers.resize(jobCount);
+				jobSystem.dispatch(jobCount, [&](u32 jobIndex, u32 threadIndex) {
+					VkCommandBuffer secondary = renderer.beginSecondaryCommandBuffer(threadIndex);
+					FrameInfo jobFrameInfo = frameInfo;
+					jobFrameInfo.commandBuffer = secondary;
+
+					if (jobIndex < prepassJobs) {
+						// depth only, so one job covers the whole queue
+						depthPrepassSystem.render(jobFrameInfo, indirectRenderSystem, 0, batchCount);
+					}
+					else if (jobIndex == prepassJobs) {
+						indirectRenderSystem.render(jobFrameInfo);
+					}
+					else if (jobIndex <= prepassJobs + rangeCount) {
+						u32 range = jobIndex - prepassJobs - 1;
+						u32 firstBatch = batchCount * range / rangeCount;
+						u32 endBatch = batchCount * (range + 1) / rangeCount;
+						// simple and textured objects, the queue sorts their draws together
+						FveGpuProfiler::Scope scope{ frameInfo.profiler, secondary, "queued draws" };
+						FveCommandRecorder recorder{ secondary, frameInfo.recordTotals };
+						renderQueue.recordBatches(recorder, firstBatch, endBatch - firstBatch);
+					}
+					else {
+						pointLightSystem.render(jobFrameInfo);
+					}
+
+					renderer.endSecondaryCommandBuffer(secondary);
+					secondaryBuffers[jobIndex] = secondary;
+				});
+				renderQueue.endFlush();
+
+				frameStats.recordMilliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(
+					std::chrono::high_resolution_clock::now() - recordStart).count();
+
+				// ================ RENDER GRAPH ================
+				using Usage = FveRenderGraph::Usage;
+				using PassBuilder = FveRenderGraph::PassBuilder;
+
+				renderGraph.reset();
+				auto shadowMap = renderGraph.importImage("shadow map", shadowMaps.getImage(), VK_IMAGE_ASPECT_DEPTH_BIT, Usage::FragmentSampled);
+				auto sceneColor = renderGraph.importImage("scene color", renderer.getSceneImage(), VK_IMAGE_ASPECT_COLOR_BIT, Usage::ColorAttachment);
+				auto depth = renderGraph.importImage("depth", renderer.getDepthImage(), renderer.getDepthAspects(), Usage::DepthAttachment);
+				auto pyramid = renderGraph.importImage("depth pyramid", depthPyramid.getImage(), VK_IMAGE_ASPECT_COLOR_BIT, Usage::ComputeStorage);
+				auto clusterCounts = renderGraph.importBuffer("cluster counts", lightClusters.countsInfo(frameIndex).buffer, Usage::FragmentStorage);
+				auto clusterIndices = renderGraph.importBuffer("cluster indices", lightClusters.indicesInfo(frameIndex).buffer, Usage::FragmentStorage);
+				auto drawCommands = renderGraph.importBuffer("indirect draws", indirectRenderSystem.getDrawCommands(frameIndex), Usage::Indirect);
+
+				// cached cascades and the pyramid are used by later frames
+				renderGraph.markOutput(shadowMap);
+				renderGraph.markOutput(pyramid);
+
+				// offscreen shadow passes, only for the cascades update() marked
+				if (shadowMaps.needsRender()) {
+					renderGraph.addPass("shadows",
+						[&](PassBuilder& pass) { pass.write(shadowMap, Usage::DepthAttachment); },
+						[&](VkCommandBuffer cmd) {
+							FveCommandRecorder recorder{ cmd, frameInfo.recordTotals };
+							shadowMaps.render(recorder, gameObjects, sceneBvh);
+						});
+				}
+
+				// systems record through a FrameInfo, the passes hand them the graph's buffer in it
+				auto passFrameInfo = [&](VkCommandBuffer cmd) {
+					FrameInfo passInfo = frameInfo;
+					passInfo.commandBuffer = cmd;
+					return passInfo;
+				};
+
+				// generate the GPU-driven draws before the render pass begins
+				renderGraph.addPass("indirect cull",
+					[&](PassBuilder& pass) {
+						pass.write(drawCommands, Usage::ComputeStorage);
+						if (indirectRenderSystem.isOcclusionCullingEnabled()) {
+							pass.read(pyramid, Usage::ComputeStorage);
+						}
+					},
+					[&](VkCommandBuffer cmd) {
+						FrameInfo passInfo = passFrameInfo(cmd);
+						indirectRenderSystem.prepare(passInfo);
+					});
+
+				renderGraph.addPass("light clusters",
+					[&](PassBuilder& pass) {
+						pass.write(clusterCounts, Usage::ComputeStorage);
+						pass.write(clusterIndices, Usage::ComputeStorage);
+					},
+					[&](VkCommandBuffer cmd) {
+						FveCommandRecorder recorder{ cmd, frameInfo.recordTotals };
+						lightClusters.build(recorder, frameIndex, camera, static_cast<u32>(ubo.numLights));
+					});
+
+				auto readLighting = [&](PassBuilder& pass) {
+					pass.read(shadowMap, Usage::FragmentSampled);
+					pass.read(clusterCounts, Usage::FragmentStorage);
+					pass.read(clusterIndices, Usage::FragmentStorage);
+					pass.read(drawCommands, Usage::Indirect);
+					pass.write(sceneColor, Usage::ColorAttachment);
+					pass.write(depth, Usage::DepthAttachment);
+				};
+
+				renderGraph.addPass("main", readLighting, [&](VkCommandBuffer cmd) {
+					renderer.beginSwapChainRenderPass(cmd, false, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+					vkCmdExecuteCommands(cmd, jobCount, secondaryBuffers.data());
+					renderer.endSwapChainRenderPass(cmd);
+				});
+
+				// everything opaque so far is an occluder, rebuild the pyramid from it and draw what it revealed
+				if (occlusionPass) {
+					renderGraph.addPass("depth pyramid",
+						[&](PassBuilder& pass) {
+							pass.read(depth, Usage::ComputeSampled);
+							pass.write(pyramid, Usage::ComputeStorage);
+						},
+						[&](VkCommandBuffer cmd) {
+							FveCommandRecorder recorder{ cmd, frameInfo.recordTotals };
+							depthPyramid.build(recorder, renderer.getRenderExtent(), camera.getProjection() * camera.getView());
+						});
+
+					renderGraph.addPass("disoccluded cull",
+						[&](PassBuilder& pass) {
+							pass.read(pyramid, Usage::ComputeStorage);
+							pass.write(drawCommands, Usage::ComputeStorage);
+						},
+						[&](VkCommandBuffer cmd) {
+							FrameInfo passInfo = passFrameInfo(cmd);
+							indirectRenderSystem.prepareDisoccluded(passInfo);
+						});
+
+					renderGraph.addPass("disoccluded", readLighting, [&](VkCommandBuffer cmd) {
+						FrameInfo passInfo = passFrameInfo(cmd);
+						renderer.beginSwapChainRenderPass(cmd, true);
+						if (depthPrepass) {
+							depthPrepassSystem.renderDisoccluded(passInfo, indirectRenderSystem);
+						}
+						indirectRenderSystem.renderDisoccluded(passInfo);
+						pointLightSystem.render(passInfo);
+						renderer.endSwapChainRenderPass(cmd);
+					});
+				}
+
+				// the swap chain image is synchronized by the copy's own barriers and the frame's semaphores
+				renderGraph.addPass("upscale",
+					[&](PassBuilder& pass) {
+						pass.read(sceneColor, Usage::Transfer);
+						pass.sideEffects();
+					},
+					[&](VkCommandBuffer cmd) { renderer.upscaleToSwapChain(cmd); });
+
+				if (renderGraph.compile()) {
+					renderGraph.dump();
+				}
+				renderGraph.execute(commandBuffer, &renderer.getProfiler());
 
-				renderer.endSwapChainRenderPass(commandBuffer);
 				renderer.endFrame();
 
+				statsTimer += frameTime;
+				statsFrames++;
+				if (statsTimer >= 2.0f) {
+					FVE_CORE_DEBUG("Objects visible: {0}, culled: {1}, GPU-driven: {2}, occluded: {3}, disoccluded: {4}, occlusion {5}, {6:.3f} ms/frame, recorded in {7:.3f} ms on {8} threads",
+						frameStats.visibleObjects,
+						frameStats.culledObjects,
+						frameStats.gpuDrivenObjects,
+						frameStats.occludedObjects,
+						frameStats.disoccludedObjects,
+						indirectRenderSystem.isOcclusionCullingEnabled() ? "on" : "off",
+						1000.0f * statsTimer / statsFrames,
+						frameStats.recordMilliseconds,
+						jobSystem.getThreadCount());
+
+					const FveCommandPools::Stats poolStats = renderer.getCommandPoolStats();
+					FVE_CORE_DEBUG("Command buffers allocated: {0}, pool resets: {1}, handed out: {2}",
+						poolStats.allocations,
+						poolStats.resets,
+						poolStats.handOuts);
+
+					const FveLightClusters::Stats clusterStats = lightClusters.getStats();
+					FVE_CORE_DEBUG("Lights: {0}, clusters occupied: {1}/{2}, {3:.2f} lights per occupied cluster, max {4}, overflowed: {5}",
+						clusterStats.lights,
+						clusterStats.occupiedClusters,
+						FveLightClusters::CLUSTER_COUNT,
+						clusterStats.occupiedClusters > 0 ? static_cast<float>(clusterStats.lightReferences) / clusterStats.occupiedClusters : 0.0f,
+						clusterStats.maxClusterLights,
+						clusterStats.overflowedClusters);
+
+					const FveDynamicResolution::Stats resolutionStats = renderer.getResolutionStats();
+					const VkExtent2D renderExtent = renderer.getRenderExtent();
+					const VkExtent2D swapChainExtent = renderer.getSwapChainExtent();
+					FVE_CORE_DEBUG("Render scale: {0:.2f} ({1}x{2} of {3}x{4}), GPU frame {5:.3f} ms, target {6:.3f} ms, dynamic resolution {7}",
+						resolutionStats.scale,
+						renderExtent.width,
+						renderExtent.height,
+						swapChainExtent.width,
+						swapChainExtent.height,
+						resolutionStats.gpuFrameMs,
+						renderer.getResolutionSettings().targetFrameMs,
+						renderer.getResolutionSettings().enabled ? "on" : "off");
+
+					renderer.getProfiler().dump();
+
+					renderer.getFrameCounters().dump();
+					renderer.getFrameCounters().resetStats();
+
+					const FveShadowMaps::Stats shadowStats = shadowMaps.getStats();
+					FVE_CORE_DEBUG("Shadow cascades drawn: {0} in {1} frames, cached: {2}, {3} casters",
+						shadowStats.cascadesDrawn,
+						shadowStats.frames,
+						shadowStats.cachedCascadesDrawn,
+						shadowStats.casters);
+					shadowMaps.resetStats();
+					statsTimer = 0.0f;
+					statsFrames = 0;
+				}
+
 			}
 
 		}
 
+		// variants still compiling point into the systems' pipelines
+		pipelineQueue.waitIdle();
+
 		// wait for the GPU to finish whatever it was doing when the user exits the game
 		vkDeviceWaitIdle(device.device());
 
@@ -208,6 +635,41 @@ namespace fve {
 
 	}
 
+	void Game::resizeDepthPyramid(FveDepthPyramid& depthPyramid) {
+		depthPyramid.resize(renderer.getSceneExtent(), renderer.getDepthImageView());
+		pyramidSwapChainGeneration = renderer.getSwapChainGeneration();
+	}
+
+	void Game::buildSceneBvh() {
+		std::vector<std::pair<FveBvh::id_t, Aabb>> staticObjects;
+		dynamicObjects.clear();
+		sceneBvh.clear();
+
+		for (auto& kv : gameObjects) {
+			auto& obj = kv.second;
+			if (obj.model == nullptr) continue;
+
+			if (obj.isStatic) {
+				staticObjects.push_back({ kv.first, worldBounds(obj) });
+			}
+			else {
+				sceneBvh.insertDynamic(kv.first, worldBounds(obj));
+				dynamicObjects.push_back(kv.first);
+			}
+		}
+
+		sceneBvh.buildStatic(staticObjects);
+
+		FVE_CORE_DEBUG("Scene BVH: {0} static, {1} dynamic objects", staticObjects.size(), dynamicObjects.size());
+	}
+
+	void Game::updateSceneBvh() {
+		// only moving objects are touched, and most moves stay inside their fat boxes
+		for (auto id : dynamicObjects) {
+			sceneBvh.updateDynamic(id, worldBounds(gameObjects.at(id)));
+		}
+	}
+
 	void Game::loadGameObjects() {
 
 		// LOAD MESHES
@@ -224,6 +686,7 @@ namespace fve {
 		
 		{
 			auto flatVase = FveGameObject::createGameObject();
+			flatVase.isStatic = true;
 			flatVase.model = flatVaseModel;
 			flatVase.transform.translation = { -0.5f, 0.5f, 0.0f };
 			flatVase.transform.scale = { 3.0f, 1.5f, 3.0f };
@@ -232,6 +695,7 @@ namespace fve {
 
 		{
 			auto smoothVase = FveGameObject::createGameObject();
+			smoothVase.isStatic = true;
 			smoothVase.model = smoothVaseModel;
 			smoothVase.transform.translation = { 0.5f, 0.5f, 0.0f };
 			smoothVase.transform.scale = { 3.0f, 1.5f, 3.0f };
@@ -264,11 +728,30 @@ namespace fve {
 			gameObjects.emplace(pointLight.getId(), std::move(pointLight));
 		}
 
+		// LIGHT FIELD
+		// dim lights just above the floor, enough of them to need clustering
+		const u32 fieldLights = std::min(config.lightFieldSize, static_cast<u32>(MAX_LIGHTS) - static_cast<u32>(lightColors.size()));
+		if (fieldLights < config.lightFieldSize) {
+			FVE_CORE_WARN("Light field clamped to {0} lights", fieldLights);
+		}
+
+		std::mt19937 random{ 1337 };
+		std::uniform_real_distribution<float> planeDistribution{ -10.0f, 10.0f };
+		std::uniform_real_distribution<float> heightDistribution{ 0.0f, 0.4f };
+		std::uniform_real_distribution<float> colorDistribution{ 0.1f, 1.0f };
+		for (u32 i = 0; i < fieldLights; i++) {
+			auto pointLight = FveGameObject::makePointLight(0.05f, 0.03f);
+			pointLight.color = { colorDistribution(random), colorDistribution(random), colorDistribution(random) };
+			pointLight.transform.translation = { planeDistribution(random), heightDistribution(random), planeDistribution(random) };
+			gameObjects.emplace(pointLight.getId(), std::move(pointLight));
+		}
+
 		// CREATE SOMETHING WITH A TEXTURE
 
 		// TEXTURE THE FLOOR
 		{
 			auto floor = FveGameObject::createGameObject();
+			floor.isStatic = true;
 			floor.model = floorModel;
 			floor.transform.translation = { 0.0f, 0.5f, 0.0f };
 			floor.transform.scale = { 3.0f, 1.0f, 3.0f };
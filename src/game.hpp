@@ -1,10 +1,14 @@
 #pragma once
 
 #include "core/fve_window.hpp"
+#include "core/fve_job_system.hpp"
 #include "core/vulkan/fve_device.hpp"
 #include "render/fve_renderer.hpp"
 #include "fve_game_object.hpp"
 #include "core/vulkan/fve_descriptors.hpp"
+#include "render/fve_bvh.hpp"
+#include "render/fve_depth_pyramid.hpp"
+#include "render/fve_light_clusters.hpp"
 
 #include <vma/vk_mem_alloc.h>
 #include <spdlog/spdlog.h>
@@ -17,7 +21,16 @@ namespace fve {
 	class Game {
 	public:
 
-		Game(FveWindow& window, FveDevice& device);
+		// chosen per deployment, fixed for the game's lifetime
+		struct Config {
+			// small lights scattered over the scene on top of the ring of lights
+			u32 lightFieldSize = 0;
+			// 1 to FveSwapChain::MAX_FRAMES_IN_FLIGHT, fewer trade throughput for input latency
+			u32 framesInFlight = 2;
+			FveSwapChain::LatencyMode latencyMode = FveSwapChain::LatencyMode::Throughput;
+		};
+
+		Game(FveWindow& window, FveDevice& device, const Config& config = Config{});
 		~Game();
 
 		void init();
@@ -27,7 +40,10 @@ namespace fve {
 	
 		FveWindow& window;
 		FveDevice& device;
-		FveRenderer renderer{window, device};
+		Config config;
+		// created before the renderer, which needs a command pool per job thread
+		FveJobSystem jobSystem{};
+		FveRenderer renderer{ window, device, jobSystem.getThreadCount(), config.framesInFlight, config.latencyMode };
 
 		// note: order of declarations matters
 		std::unique_ptr<FveDescriptorPool> globalPool{};
@@ -36,11 +52,25 @@ namespace fve {
 
 		FveGameObject::Map gameObjects;
 
+		// every object with a model, queried each frame for the objects inside the frustum
+		FveBvh sceneBvh;
+		std::vector<FveGameObject::id_t> dynamicObjects;
+		std::vector<FveGameObject::id_t> visibleObjects;
+
+		// filled by the recording jobs each frame, executed in job order
+		std::vector<VkCommandBuffer> secondaryBuffers;
+
+		// swap chain the depth pyramid was last sized for
+		u32 pyramidSwapChainGeneration = 0;
+
 		Game(const Game&) = delete;
 		Game& operator=(const Game&) = delete;
 
 		void loadTextures();
 		void loadGameObjects();
+		void resizeDepthPyramid(FveDepthPyramid& depthPyramid);
+		void buildSceneBvh();
+		void updateSceneBvh();
 	};
 
 }
\ No newline at end of file
@@ -5,13 +5,17 @@
 #include "fve_constants.hpp"
 #include "core/fve_globals.hpp"
 #include "core/utils/fve_logger.hpp"
+#include "render/fve_bvh_bench.hpp"
+#include "render/fve_render_graph_check.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 
-void runGame() {
+void runGame(const fve::Game::Config& config) {
     
     fve::FveLogger::init();
     fve::FVE_CORE_WARN("Initialized logger!");
@@ -21,22 +25,76 @@ void runGame() {
     fve::FveDevice device{ window };
 
     {
-        fve::Game game{ window, device };
+        fve::Game game{ window, device, config };
         game.run();
     }
 
+    // buffers and images destroyed by the game are only queued for deletion
+    device.flushDeletions();
     vmaDestroyAllocator(fve::fveAllocator);
 
 }
 
+bool checkRenderGraph() {
+
+    fve::FveLogger::init();
+
+    fve::FveWindow window{ fve::WIDTH, fve::HEIGHT, "First Vulkan Game" };
+    fve::FveDevice device{ window };
+
+    bool passed = fve::runRenderGraphCheck(device);
+
+    device.flushDeletions();
+    vmaDestroyAllocator(fve::fveAllocator);
+    return passed;
+
+}
+
 void waitOnExit() {
     while (std::cin.get() != '\n');
 }
 
-int main() {
+int main(int argc, char** argv) {
+
+    fve::Game::Config config{};
+
+    // benchmarks run headless, no window or device is created
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--bench-bvh") == 0) {
+            fve::FveLogger::init();
+            fve::runBvhBenchmark(100000);
+            return EXIT_SUCCESS;
+        }
+        // checks the transient aliasing of the render graph, this one needs a window and device
+        if (std::strcmp(argv[i], "--check-render-graph") == 0) {
+            try {
+                return checkRenderGraph() ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+        // extra point lights scattered over the scene, to stress the light clustering
+        if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+            config.lightFieldSize = static_cast<fve::u32>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            const unsigned long frames = std::strtoul(argv[++i], nullptr, 10);
+            config.framesInFlight = static_cast<fve::u32>(std::clamp(frames, 1ul, static_cast<unsigned long>(fve::FveSwapChain::MAX_FRAMES_IN_FLIGHT)));
+        }
+        // low, throughput or vsync
+        if (std::strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (std::strcmp(mode, "low") == 0) config.latencyMode = fve::FveSwapChain::LatencyMode::LowLatency;
+            else if (std::strcmp(mode, "throughput") == 0) config.latencyMode = fve::FveSwapChain::LatencyMode::Throughput;
+            else if (std::strcmp(mode, "vsync") == 0) config.latencyMode = fve::FveSwapChain::LatencyMode::VSync;
+            else std::cerr << "Unknown latency mode " << mode << ", expected low, throughput or vsync\n";
+        }
+    }
 
     try {
-        runGame();
+        runGame(config);
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
@@ -25,6 +25,30 @@ namespace fve {
 		mouseDeltaY = ypos - lastMouseY;
 		lastMouseX = xpos;
 		lastMouseY = ypos;*/
+
+		bool togglePressed = glfwGetKey(window, keys.toggleOcclusion) == GLFW_PRESS;
+		if (togglePressed && !toggleOcclusionHeld) {
+			occlusionCulling = !occlusionCulling;
+		}
+		toggleOcclusionHeld = togglePressed;
+
+		bool lowEndPressed = glfwGetKey(window, keys.toggleLowEndShaders) == GLFW_PRESS;
+		if (lowEndPressed && !toggleLowEndShadersHeld) {
+			lowEndShaders = !lowEndShaders;
+		}
+		toggleLowEndShadersHeld = lowEndPressed;
+
+		bool prepassPressed = glfwGetKey(window, keys.toggleDepthPrepass) == GLFW_PRESS;
+		if (prepassPressed && !toggleDepthPrepassHeld) {
+			depthPrepass = !depthPrepass;
+		}
+		toggleDepthPrepassHeld = prepassPressed;
+
+		bool resolutionPressed = glfwGetKey(window, keys.toggleDynamicResolution) == GLFW_PRESS;
+		if (resolutionPressed && !toggleDynamicResolutionHeld) {
+			dynamicResolution = !dynamicResolution;
+		}
+		toggleDynamicResolutionHeld = resolutionPressed;
 	}
 
 	void MovementController::moveInPlaneXZ(GLFWwindow* window, float dt, FveGameObject& gameObject) {
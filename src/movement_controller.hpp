@@ -14,6 +14,10 @@ namespace fve {
 			int moveUp = GLFW_KEY_SPACE;
 			int moveDown = GLFW_KEY_LEFT_CONTROL;
 			int sprint = GLFW_KEY_LEFT_SHIFT;
+			int toggleOcclusion = GLFW_KEY_O;
+			int toggleLowEndShaders = GLFW_KEY_L;
+			int toggleDepthPrepass = GLFW_KEY_P;
+			int toggleDynamicResolution = GLFW_KEY_R;
 		};
 
 		struct MouseMappings {
@@ -31,6 +35,22 @@ namespace fve {
 
 		float fov = 50.0f;
 
+		// flipped on every press of keys.toggleOcclusion
+		bool occlusionCulling = true;
+		bool toggleOcclusionHeld = false;
+
+		// flipped on every press of keys.toggleLowEndShaders, the game sets the initial value
+		bool lowEndShaders = false;
+		bool toggleLowEndShadersHeld = false;
+
+		// flipped on every press of keys.toggleDepthPrepass
+		bool depthPrepass = false;
+		bool toggleDepthPrepassHeld = false;
+
+		// flipped on every press of keys.toggleDynamicResolution, the game sets the initial value
+		bool dynamicResolution = true;
+		bool toggleDynamicResolutionHeld = false;
+
 		void init(GLFWwindow* window, int width, int height);
 
 		void update(GLFWwindow* window);
@@ -0,0 +1,778 @@
+#include "fve_bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace fve {
+
+	// ================ Aabb ================
+
+	Aabb Aabb::fromSphere(const glm::vec4& sphere) {
+		glm::vec3 center{ sphere };
+		return { center - glm::vec3(sphere.w), center + glm::vec3(sphere.w) };
+	}
+
+	Aabb Aabb::transform(const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix) {
+		Aabb result{};
+		result.min = glm::vec3(matrix[3]);
+		result.max = glm::vec3(matrix[3]);
+
+		for (int column = 0; column < 3; column++) {
+			for (int row = 0; row < 3; row++) {
+				float a = matrix[column][row] * min[column];
+				float b = matrix[column][row] * max[column];
+				result.min[row] += std::min(a, b);
+				result.max[row] += std::max(a, b);
+			}
+		}
+
+		return result;
+	}
+
+	void Aabb::grow(const glm::vec3& point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void Aabb::grow(const Aabb& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	Aabb Aabb::expanded(float margin) const {
+		return { min - glm::vec3(margin), max + glm::vec3(margin) };
+	}
+
+	float Aabb::surfaceArea() const {
+		glm::vec3 extent = max - min;
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	bool Aabb::contains(const Aabb& other) const {
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+			&& other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+	}
+
+	bool Aabb::overlaps(const Aabb& other) const {
+		return min.x <= other.max.x && other.min.x <= max.x
+			&& min.y <= other.max.y && other.min.y <= max.y
+			&& min.z <= other.max.z && other.min.z <= max.z;
+	}
+
+	bool Aabb::overlapsSphere(const glm::vec3& center, float radius) const {
+		glm::vec3 closest = glm::clamp(center, min, max);
+		glm::vec3 offset = closest - center;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	static Aabb merge(const Aabb& a, const Aabb& b) {
+		Aabb result = a;
+		result.grow(b);
+		return result;
+	}
+
+	// ================ Traversal helpers ================
+
+	static constexpr u32 ALL_PLANES = (1u << Frustum::Plane::Count) - 1;
+	static constexpr u32 OUTSIDE = ~0u;
+
+	// returns OUTSIDE, or the planes of planeMask the box still straddles
+	static u32 classify(const Frustum& frustum, const Aabb& box, u32 planeMask) {
+		u32 straddling = 0;
+		for (u32 i = 0; i < Frustum::Plane::Count; i++) {
+			if ((planeMask & (1u << i)) == 0) continue;
+
+			const glm::vec4& plane = frustum.planes[i];
+			glm::vec3 positive{
+				plane.x >= 0.0f ? box.max.x : box.min.x,
+				plane.y >= 0.0f ? box.max.y : box.min.y,
+				plane.z >= 0.0f ? box.max.z : box.min.z
+			};
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) return OUTSIDE;
+
+			glm::vec3 negative{
+				plane.x >= 0.0f ? box.min.x : box.max.x,
+				plane.y >= 0.0f ? box.min.y : box.max.y,
+				plane.z >= 0.0f ? box.min.z : box.max.z
+			};
+			if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f) straddling |= 1u << i;
+		}
+		return straddling;
+	}
+
+	// slab test, tEntry is only written on a hit
+	static bool intersectRay(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& tEntry) {
+		// removed static objects are left behind as inverted boxes
+		if (box.min.x > box.max.x) return false;
+
+		glm::vec3 t1 = (box.min - origin) * inverseDirection;
+		glm::vec3 t2 = (box.max - origin) * inverseDirection;
+		glm::vec3 tMin = glm::min(t1, t2);
+		glm::vec3 tMax = glm::max(t1, t2);
+
+		float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+		if (tNear > tFar) return false;
+
+		tEntry = tNear;
+		return true;
+	}
+
+	void FveBvh::clear() {
+		staticNodes.clear();
+		staticIds.clear();
+		staticBounds.clear();
+		staticSlots.clear();
+		staticGeneration++;
+
+		dynamicNodes.clear();
+		dynamicSlots.clear();
+		dynamicRoot = NULL_NODE;
+		freeList = NULL_NODE;
+	}
+
+	// ================ Static tree ================
+
+	void FveBvh::buildStatic(const std::vector<std::pair<id_t, Aabb>>& objects) {
+		staticNodes.clear();
+		staticIds.clear();
+		staticBounds.clear();
+		staticSlots.clear();
+		staticGeneration++;
+
+		if (objects.empty()) return;
+
+		staticIds.reserve(objects.size());
+		staticBounds.reserve(objects.size());
+		for (const auto& object : objects) {
+			staticIds.push_back(object.first);
+			staticBounds.push_back(object.second);
+		}
+
+		// a binary tree with n leaves never needs more than 2n - 1 nodes
+		staticNodes.reserve(objects.size() * 2);
+		staticNodes.push_back({ {}, 0, static_cast<u32>(objects.size()) });
+		updateNodeBounds(0);
+
+		std::vector<u32> pending{ 0 };
+		while (!pending.empty()) {
+			u32 node = pending.back();
+			pending.pop_back();
+
+			subdivide(node);
+			if (staticNodes[node].count == 0) {
+				pending.push_back(staticNodes[node].leftFirst);
+				pending.push_back(staticNodes[node].leftFirst + 1);
+			}
+		}
+
+		// objects were reordered while partitioning
+		for (u32 i = 0; i < staticIds.size(); i++) {
+			staticSlots[staticIds[i]] = i;
+		}
+	}
+
+	void FveBvh::updateNodeBounds(u32 nodeIndex) {
+		StaticNode& node = staticNodes[nodeIndex];
+		node.bounds = {};
+		for (u32 i = 0; i < node.count; i++) {
+			node.bounds.grow(staticBounds[node.leftFirst + i]);
+		}
+	}
+
+	void FveBvh::subdivide(u32 nodeIndex) {
+		const u32 first = staticNodes[nodeIndex].leftFirst;
+		const u32 count = staticNodes[nodeIndex].count;
+		if (count <= 1) return;
+
+		// bin by centroid, the object boxes may overlap the split planes
+		Aabb centroidBounds{};
+		for (u32 i = first; i < first + count; i++) {
+			centroidBounds.grow(staticBounds[i].center());
+		}
+
+		struct Bin {
+			Aabb bounds;
+			u32 count = 0;
+		};
+
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		u32 bestSplit = 0;
+
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+			if (extent <= 0.0f) continue;
+
+			Bin bins[SAH_BINS]{};
+			const float scale = SAH_BINS / extent;
+			for (u32 i = first; i < first + count; i++) {
+				u32 bin = std::min(SAH_BINS - 1, static_cast<u32>((staticBounds[i].center()[axis] - centroidBounds.min[axis]) * scale));
+				bins[bin].count++;
+				bins[bin].bounds.grow(staticBounds[i]);
+			}
+
+			// sweep from both sides to get the area and count left and right of every plane
+			float leftArea[SAH_BINS - 1];
+			u32 leftCount[SAH_BINS - 1];
+			float rightArea[SAH_BINS - 1];
+			u32 rightCount[SAH_BINS - 1];
+
+			Aabb leftBox{};
+			Aabb rightBox{};
+			u32 leftSum = 0;
+			u32 rightSum = 0;
+			for (u32 i = 0; i < SAH_BINS - 1; i++) {
+				leftSum += bins[i].count;
+				leftCount[i] = leftSum;
+				leftBox.grow(bins[i].bounds);
+				leftArea[i] = leftSum > 0 ? leftBox.surfaceArea() : 0.0f;
+
+				rightSum += bins[SAH_BINS - 1 - i].count;
+				rightCount[SAH_BINS - 2 - i] = rightSum;
+				rightBox.grow(bins[SAH_BINS - 1 - i].bounds);
+				rightArea[SAH_BINS - 2 - i] = rightSum > 0 ? rightBox.surfaceArea() : 0.0f;
+			}
+
+			for (u32 i = 0; i < SAH_BINS - 1; i++) {
+				if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i + 1;
+				}
+			}
+		}
+
+		// every centroid is in the same spot, nothing left to split
+		if (bestAxis < 0) return;
+
+		// small nodes stay leaves unless splitting is actually cheaper to traverse
+		float leafCost = count * staticNodes[nodeIndex].bounds.surfaceArea();
+		if (count <= MAX_LEAF_OBJECTS && bestCost >= leafCost) return;
+
+		const float scale = SAH_BINS / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+		auto binOf = [&](u32 i) {
+			return std::min(SAH_BINS - 1, static_cast<u32>((staticBounds[i].center()[bestAxis] - centroidBounds.min[bestAxis]) * scale));
+		};
+
+		u32 left = first;
+		u32 right = first + count - 1;
+		while (left <= right) {
+			if (binOf(left) < bestSplit) {
+				left++;
+			}
+			else {
+				std::swap(staticIds[left], staticIds[right]);
+				std::swap(staticBounds[left], staticBounds[right]);
+				if (right == 0) break;
+				right--;
+			}
+		}
+
+		u32 leftCount = left - first;
+		if (leftCount == 0 || leftCount == count) return;
+
+		u32 leftChild = static_cast<u32>(staticNodes.size());
+		staticNodes.push_back({ {}, first, leftCount });
+		staticNodes.push_back({ {}, left, count - leftCount });
+		updateNodeBounds(leftChild);
+		updateNodeBounds(leftChild + 1);
+
+		staticNodes[nodeIndex].leftFirst = leftChild;
+		staticNodes[nodeIndex].count = 0;
+	}
+
+	void FveBvh::updateStatic(id_t id, const Aabb& bounds) {
+		auto it = staticSlots.find(id);
+		assert(it != staticSlots.end() && "Object is not part of the static tree");
+		staticBounds[it->second] = bounds;
+		staticGeneration++;
+	}
+
+	void FveBvh::refit() {
+		for (size_t i = staticNodes.size(); i-- > 0;) {
+			StaticNode& node = staticNodes[i];
+			if (node.count > 0) {
+				updateNodeBounds(static_cast<u32>(i));
+			}
+			else {
+				node.bounds = merge(staticNodes[node.leftFirst].bounds, staticNodes[node.leftFirst + 1].bounds);
+			}
+		}
+	}
+
+	// ================ Dynamic tree ================
+
+	i32 FveBvh::allocateNode() {
+		if (freeList == NULL_NODE) {
+			dynamicNodes.emplace_back();
+			return static_cast<i32>(dynamicNodes.size() - 1);
+		}
+
+		i32 node = freeList;
+		freeList = dynamicNodes[node].parent;
+		dynamicNodes[node] = DynamicNode{};
+		return node;
+	}
+
+	void FveBvh::freeNode(i32 node) {
+		dynamicNodes[node].parent = freeList;
+		dynamicNodes[node].height = -1;
+		freeList = node;
+	}
+
+	void FveBvh::insertDynamic(id_t id, const Aabb& bounds) {
+		assert(!contains(id) && "Object is already part of the hierarchy");
+
+		i32 leaf = allocateNode();
+		dynamicNodes[leaf].bounds = bounds.expanded(DYNAMIC_MARGIN);
+		dynamicNodes[leaf].objectBounds = bounds;
+		dynamicNodes[leaf].id = id;
+		dynamicNodes[leaf].height = 0;
+
+		insertLeaf(leaf);
+		dynamicSlots[id] = leaf;
+	}
+
+	bool FveBvh::updateDynamic(id_t id, const Aabb& bounds) {
+		auto it = dynamicSlots.find(id);
+		assert(it != dynamicSlots.end() && "Object is not part of the dynamic tree");
+
+		i32 leaf = it->second;
+		dynamicNodes[leaf].objectBounds = bounds;
+		if (dynamicNodes[leaf].bounds.contains(bounds)) return false;
+
+		removeLeaf(leaf);
+		dynamicNodes[leaf].bounds = bounds.expanded(DYNAMIC_MARGIN);
+		insertLeaf(leaf);
+		return true;
+	}
+
+	void FveBvh::remove(id_t id) {
+		auto it = dynamicSlots.find(id);
+		if (it != dynamicSlots.end()) {
+			removeLeaf(it->second);
+			freeNode(it->second);
+			dynamicSlots.erase(it);
+			return;
+		}
+
+		// static objects are hidden by an inverted box until the next rebuild
+		auto staticIt = staticSlots.find(id);
+		if (staticIt != staticSlots.end()) {
+			staticBounds[staticIt->second] = {};
+			staticSlots.erase(staticIt);
+			staticGeneration++;
+		}
+	}
+
+	void FveBvh::insertLeaf(i32 leaf) {
+		if (dynamicRoot == NULL_NODE) {
+			dynamicRoot = leaf;
+			dynamicNodes[leaf].parent = NULL_NODE;
+			return;
+		}
+
+		// walk down to the sibling that grows the tree's total surface area the least
+		const Aabb leafBounds = dynamicNodes[leaf].bounds;
+		i32 index = dynamicRoot;
+		while (!dynamicNodes[index].isLeaf()) {
+			const DynamicNode& node = dynamicNodes[index];
+
+			float area = node.bounds.surfaceArea();
+			float combinedArea = merge(node.bounds, leafBounds).surfaceArea();
+
+			// cost of pairing the leaf with this node, and the minimum cost pushed onto descendants
+			float cost = 2.0f * combinedArea;
+			float inheritanceCost = 2.0f * (combinedArea - area);
+
+			auto descendCost = [&](i32 child) {
+				const DynamicNode& childNode = dynamicNodes[child];
+				float merged = merge(leafBounds, childNode.bounds).surfaceArea();
+				if (childNode.isLeaf()) return merged + inheritanceCost;
+				return (merged - childNode.bounds.surfaceArea()) + inheritanceCost;
+			};
+
+			float cost1 = descendCost(node.child1);
+			float cost2 = descendCost(node.child2);
+
+			if (cost < cost1 && cost < cost2) break;
+
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		i32 sibling = index;
+
+		// allocation may grow the node array, so no references are held across it
+		i32 oldParent = dynamicNodes[sibling].parent;
+		i32 newParent = allocateNode();
+		dynamicNodes[newParent].parent = oldParent;
+		dynamicNodes[newParent].bounds = merge(leafBounds, dynamicNodes[sibling].bounds);
+		dynamicNodes[newParent].height = dynamicNodes[sibling].height + 1;
+		dynamicNodes[newParent].child1 = sibling;
+		dynamicNodes[newParent].child2 = leaf;
+		dynamicNodes[sibling].parent = newParent;
+		dynamicNodes[leaf].parent = newParent;
+
+		if (oldParent != NULL_NODE) {
+			if (dynamicNodes[oldParent].child1 == sibling) {
+				dynamicNodes[oldParent].child1 = newParent;
+			}
+			else {
+				dynamicNodes[oldParent].child2 = newParent;
+			}
+		}
+		else {
+			dynamicRoot = newParent;
+		}
+
+		// fix heights and boxes on the way back up
+		index = dynamicNodes[leaf].parent;
+		while (index != NULL_NODE) {
+			index = balance(index);
+
+			DynamicNode& node = dynamicNodes[index];
+			node.height = 1 + std::max(dynamicNodes[node.child1].height, dynamicNodes[node.child2].height);
+			node.bounds = merge(dynamicNodes[node.child1].bounds, dynamicNodes[node.child2].bounds);
+
+			index = node.parent;
+		}
+	}
+
+	void FveBvh::removeLeaf(i32 leaf) {
+		if (leaf == dynamicRoot) {
+			dynamicRoot = NULL_NODE;
+			return;
+		}
+
+		i32 parent = dynamicNodes[leaf].parent;
+		i32 grandParent = dynamicNodes[parent].parent;
+		i32 sibling = dynamicNodes[parent].child1 == leaf ? dynamicNodes[parent].child2 : dynamicNodes[parent].child1;
+
+		if (grandParent == NULL_NODE) {
+			dynamicRoot = sibling;
+			dynamicNodes[sibling].parent = NULL_NODE;
+			freeNode(parent);
+			return;
+		}
+
+		// the sibling takes the parent's place
+		if (dynamicNodes[grandParent].child1 == parent) {
+			dynamicNodes[grandParent].child1 = sibling;
+		}
+		else {
+			dynamicNodes[grandParent].child2 = sibling;
+		}
+		dynamicNodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		i32 index = grandParent;
+		while (index != NULL_NODE) {
+			index = balance(index);
+
+			DynamicNode& node = dynamicNodes[index];
+			node.bounds = merge(dynamicNodes[node.child1].bounds, dynamicNodes[node.child2].bounds);
+			node.height = 1 + std::max(dynamicNodes[node.child1].height, dynamicNodes[node.child2].height);
+
+			index = node.parent;
+		}
+	}
+
+	// rotates the taller child up when the subtree at iA is unbalanced, returns the subtree's new root
+	i32 FveBvh::balance(i32 iA) {
+		DynamicNode& A = dynamicNodes[iA];
+		if (A.isLeaf() || A.height < 2) return iA;
+
+		i32 iB = A.child1;
+		i32 iC = A.child2;
+		DynamicNode& B = dynamicNodes[iB];
+		DynamicNode& C = dynamicNodes[iC];
+
+		i32 balanceFactor = C.height - B.height;
+
+		// rotate C up
+		if (balanceFactor > 1) {
+			i32 iF = C.child1;
+			i32 iG = C.child2;
+			DynamicNode& F = dynamicNodes[iF];
+			DynamicNode& G = dynamicNodes[iG];
+
+			C.child1 = iA;
+			C.parent = A.parent;
+			A.parent = iC;
+
+			if (C.parent != NULL_NODE) {
+				if (dynamicNodes[C.parent].child1 == iA) {
+					dynamicNodes[C.parent].child1 = iC;
+				}
+				else {
+					dynamicNodes[C.parent].child2 = iC;
+				}
+			}
+			else {
+				dynamicRoot = iC;
+			}
+
+			if (F.height > G.height) {
+				C.child2 = iF;
+				A.child2 = iG;
+				G.parent = iA;
+				A.bounds = merge(B.bounds, G.bounds);
+				C.bounds = merge(A.bounds, F.bounds);
+				A.height = 1 + std::max(B.height, G.height);
+				C.height = 1 + std::max(A.height, F.height);
+			}
+			else {
+				C.child2 = iG;
+				A.child2 = iF;
+				F.parent = iA;
+				A.bounds = merge(B.bounds, F.bounds);
+				C.bounds = merge(A.bounds, G.bounds);
+				A.height = 1 + std::max(B.height, F.height);
+				C.height = 1 + std::max(A.height, G.height);
+			}
+
+			return iC;
+		}
+
+		// rotate B up
+		if (balanceFactor < -1) {
+			i32 iD = B.child1;
+			i32 iE = B.child2;
+			DynamicNode& D = dynamicNodes[iD];
+			DynamicNode& E = dynamicNodes[iE];
+
+			B.child1 = iA;
+			B.parent = A.parent;
+			A.parent = iB;
+
+			if (B.parent != NULL_NODE) {
+				if (dynamicNodes[B.parent].child1 == iA) {
+					dynamicNodes[B.parent].child1 = iB;
+				}
+				else {
+					dynamicNodes[B.parent].child2 = iB;
+				}
+			}
+			else {
+				dynamicRoot = iB;
+			}
+
+			if (D.height > E.height) {
+				B.child2 = iD;
+				A.child1 = iE;
+				E.parent = iA;
+				A.bounds = merge(C.bounds, E.bounds);
+				B.bounds = merge(A.bounds, D.bounds);
+				A.height = 1 + std::max(C.height, E.height);
+				B.height = 1 + std::max(A.height, D.height);
+			}
+			else {
+				B.child2 = iE;
+				A.child1 = iD;
+				D.parent = iA;
+				A.bounds = merge(C.bounds, D.bounds);
+				B.bounds = merge(A.bounds, E.bounds);
+				A.height = 1 + std::max(C.height, D.height);
+				B.height = 1 + std::max(A.height, E.height);
+			}
+
+			return iB;
+		}
+
+		return iA;
+	}
+
+	// ================ Queries ================
+
+	void FveBvh::queryFrustum(const Frustum& frustum, std::vector<id_t>& out) const {
+		queryFrustumStatic(frustum, out);
+		queryFrustumDynamic(frustum, out);
+	}
+
+	void FveBvh::queryFrustumStatic(const Frustum& frustum, std::vector<id_t>& out) const {
+		if (staticNodes.empty()) return;
+
+		TraversalStack<TraversalEntry> stack;
+		stack.push({ 0, ALL_PLANES });
+
+		while (!stack.empty()) {
+			TraversalEntry entry = stack.pop();
+			const StaticNode& node = staticNodes[entry.node];
+
+			// nodes fully inside skip the plane tests for their whole subtree
+			u32 planeMask = entry.planeMask;
+			if (planeMask != 0) {
+				planeMask = classify(frustum, node.bounds, planeMask);
+				if (planeMask == OUTSIDE) continue;
+			}
+
+			if (node.count > 0) {
+				for (u32 i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+					const Aabb& bounds = staticBounds[i];
+
+					// skip removed objects, they keep an inverted box until the next rebuild
+					if (bounds.min.x > bounds.max.x) continue;
+
+					if (planeMask == 0 || classify(frustum, bounds, planeMask) != OUTSIDE) {
+						out.push_back(staticIds[i]);
+					}
+				}
+				continue;
+			}
+
+			stack.push({ static_cast<i32>(node.leftFirst), planeMask });
+			stack.push({ static_cast<i32>(node.leftFirst + 1), planeMask });
+		}
+	}
+
+	void FveBvh::queryFrustumDynamic(const Frustum& frustum, std::vector<id_t>& out) const {
+		if (dynamicRoot == NULL_NODE) return;
+
+		TraversalStack<TraversalEntry> stack;
+		stack.push({ dynamicRoot, ALL_PLANES });
+
+		while (!stack.empty()) {
+			TraversalEntry entry = stack.pop();
+			const DynamicNode& node = dynamicNodes[entry.node];
+
+			u32 planeMask = entry.planeMask;
+			if (planeMask != 0) {
+				planeMask = classify(frustum, node.bounds, planeMask);
+				if (planeMask == OUTSIDE) continue;
+			}
+
+			if (node.isLeaf()) {
+				// the fat box can reach into the frustum while the object stays outside
+				if (planeMask == 0 || classify(frustum, node.objectBounds, planeMask) != OUTSIDE) {
+					out.push_back(node.id);
+				}
+				continue;
+			}
+
+			stack.push({ node.child1, planeMask });
+			stack.push({ node.child2, planeMask });
+		}
+	}
+
+	void FveBvh::querySphere(const glm::vec3& center, float radius, std::vector<id_t>& out) const {
+		TraversalStack<i32> stack;
+
+		if (!staticNodes.empty()) {
+			stack.push(0);
+			while (!stack.empty()) {
+				const StaticNode& node = staticNodes[stack.pop()];
+				if (!node.bounds.overlapsSphere(center, radius)) continue;
+
+				if (node.count > 0) {
+					for (u32 i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+						if (staticBounds[i].overlapsSphere(center, radius)) out.push_back(staticIds[i]);
+					}
+					continue;
+				}
+
+				stack.push(static_cast<i32>(node.leftFirst));
+				stack.push(static_cast<i32>(node.leftFirst + 1));
+			}
+		}
+
+		if (dynamicRoot != NULL_NODE) {
+			stack.push(dynamicRoot);
+			while (!stack.empty()) {
+				const DynamicNode& node = dynamicNodes[stack.pop()];
+				if (!node.bounds.overlapsSphere(center, radius)) continue;
+
+				if (node.isLeaf()) {
+					if (node.objectBounds.overlapsSphere(center, radius)) out.push_back(node.id);
+					continue;
+				}
+
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+	}
+
+	bool FveBvh::raycast(const Ray& ray, RayHit& hit) const {
+		const glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+		hit = {};
+		float closest = ray.maxDistance;
+		bool found = false;
+
+		TraversalStack<i32> stack;
+
+		if (!staticNodes.empty()) {
+			float t;
+			if (intersectRay(staticNodes[0].bounds, ray.origin, inverseDirection, closest, t)) {
+				stack.push(0);
+			}
+
+			while (!stack.empty()) {
+				const StaticNode& node = staticNodes[stack.pop()];
+
+				if (node.count > 0) {
+					for (u32 i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+						if (intersectRay(staticBounds[i], ray.origin, inverseDirection, closest, t)) {
+							closest = t;
+							hit = { staticIds[i], t };
+							found = true;
+						}
+					}
+					continue;
+				}
+
+				// visit the nearer child first so the farther one is more likely to be pruned
+				i32 near = static_cast<i32>(node.leftFirst);
+				i32 far = near + 1;
+				float tNear = 0.0f;
+				float tFar = 0.0f;
+				bool hitNear = intersectRay(staticNodes[near].bounds, ray.origin, inverseDirection, closest, tNear);
+				bool hitFar = intersectRay(staticNodes[far].bounds, ray.origin, inverseDirection, closest, tFar);
+
+				if (hitNear && hitFar && tFar < tNear) {
+					std::swap(near, far);
+				}
+
+				if (hitNear && hitFar) {
+					stack.push(far);
+					stack.push(near);
+				}
+				else if (hitNear) {
+					stack.push(static_cast<i32>(node.leftFirst));
+				}
+				else if (hitFar) {
+					stack.push(static_cast<i32>(node.leftFirst + 1));
+				}
+			}
+		}
+
+		if (dynamicRoot != NULL_NODE) {
+			stack.push(dynamicRoot);
+			while (!stack.empty()) {
+				const DynamicNode& node = dynamicNodes[stack.pop()];
+
+				float t;
+				if (!intersectRay(node.bounds, ray.origin, inverseDirection, closest, t)) continue;
+
+				if (node.isLeaf()) {
+					if (!intersectRay(node.objectBounds, ray.origin, inverseDirection, closest, t)) continue;
+					closest = t;
+					hit = { node.id, t };
+					found = true;
+					continue;
+				}
+
+				stack.push(node.child1);
+				stack.push(node.child2);
+			}
+		}
+
+		return found;
+	}
+
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "fve_frustum.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fve {
+
+	struct Aabb {
+		glm::vec3 min{ std::numeric_limits<float>::max() };
+		glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+		static Aabb fromSphere(const glm::vec4& sphere);
+
+		// box around the eight transformed corners of a mesh space box (Arvo)
+		static Aabb transform(const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix);
+
+		void grow(const glm::vec3& point);
+		void grow(const Aabb& other);
+		Aabb expanded(float margin) const;
+
+		glm::vec3 center() const { return (min + max) * 0.5f; }
+		float surfaceArea() const;
+		bool contains(const Aabb& other) const;
+		bool overlaps(const Aabb& other) const;
+		bool overlapsSphere(const glm::vec3& center, float radius) const;
+	};
+
+	struct Ray {
+		glm::vec3 origin{ 0.0f };
+		glm::vec3 direction{ 0.0f, 0.0f, 1.0f };
+		float maxDistance = std::numeric_limits<float>::max();
+	};
+
+	/*
+	 * Bounding volume hierarchy over scene objects, keyed by game object id.
+	 *
+	 * Static objects live in a flat tree built top-down with a binned surface area heuristic.
+	 * Their boxes can still be nudged with updateStatic() and the tree refit bottom-up, which keeps
+	 * the topology but is far cheaper than a rebuild.
+	 *
+	 * Dynamic objects live in a second tree built by incremental insertion (Box2D style). Leaves store
+	 * a fattened box so small movements do not touch the tree at all, and the tree is kept
+	 * balanced with rotations as leaves come and go. Leaves also keep the exact box, which queries
+	 * test before reporting the object.
+	 *
+	 * Queries walk both trees and append matching ids to the output.
+	 */
+	class FveBvh {
+	public:
+		// same type as FveGameObject::id_t, kept local so the tree does not depend on game objects
+		using id_t = u32;
+
+		struct RayHit {
+			id_t id = 0;
+			float distance = std::numeric_limits<float>::max();
+		};
+
+		// objects per static leaf before a split is considered
+		static constexpr u32 MAX_LEAF_OBJECTS = 4;
+		static constexpr u32 SAH_BINS = 12;
+
+		// how far dynamic leaves are fattened in every direction, in world units
+		static constexpr float DYNAMIC_MARGIN = 0.2f;
+
+		void clear();
+
+		// replaces the static tree
+		void buildStatic(const std::vector<std::pair<id_t, Aabb>>& objects);
+		void updateStatic(id_t id, const Aabb& bounds);
+		void refit();
+
+		void insertDynamic(id_t id, const Aabb& bounds);
+		// returns true when the object left its fat box and had to be reinserted
+		bool updateDynamic(id_t id, const Aabb& bounds);
+		void remove(id_t id);
+
+		bool contains(id_t id) const { return staticSlots.count(id) != 0 || dynamicSlots.count(id) != 0; }
+		u32 size() const { return static_cast<u32>(staticSlots.size() + dynamicSlots.size()); }
+
+		void queryFrustum(const Frustum& frustum, std::vector<id_t>& out) const;
+		void querySphere(const glm::vec3& center, float radius, std::vector<id_t>& out) const;
+		// closest hit against the object boxes
+		bool raycast(const Ray& ray, RayHit& hit) const;
+
+		// bumped whenever a static object is added, moved or removed, for caches built from the static scene
+		u32 getStaticGeneration() const { return staticGeneration; }
+
+		u32 getStaticNodeCount() const { return static_cast<u32>(staticNodes.size()); }
+		u32 getDynamicHeight() const { return dynamicRoot == NULL_NODE ? 0 : static_cast<u32>(dynamicNodes[dynamicRoot].height); }
+
+	private:
+		static constexpr i32 NULL_NODE = -1;
+
+		// children are allocated in pairs after their parent, so refit() can walk the array backwards
+		struct StaticNode {
+			Aabb bounds;
+			u32 leftFirst; // first child if count == 0, first object otherwise
+			u32 count;
+		};
+
+		struct DynamicNode {
+			Aabb bounds; // fattened on leaves
+			Aabb objectBounds; // the object's own box, leaves only
+			i32 parent = NULL_NODE; // next free node while on the free list
+			i32 child1 = NULL_NODE;
+			i32 child2 = NULL_NODE;
+			i32 height = 0; // -1 when free
+			id_t id = 0;
+
+			bool isLeaf() const { return child1 == NULL_NODE; }
+		};
+
+		void subdivide(u32 nodeIndex);
+		void updateNodeBounds(u32 nodeIndex);
+
+		i32 allocateNode();
+		void freeNode(i32 node);
+		void insertLeaf(i32 leaf);
+		void removeLeaf(i32 leaf);
+		i32 balance(i32 node);
+
+		void queryFrustumStatic(const Frustum& frustum, std::vector<id_t>& out) const;
+		void queryFrustumDynamic(const Frustum& frustum, std::vector<id_t>& out) const;
+
+		struct TraversalEntry {
+			i32 node;
+			u32 planeMask; // planes the node still straddles, 0 means fully inside
+		};
+
+		// entries held in place by the traversal stacks, kept on the stack so queries stay thread safe
+		static constexpr u32 MAX_TRAVERSAL_DEPTH = 256;
+
+		// a degenerate tree can go deeper than the fixed entries, the rest spill to the heap then
+		template<typename T>
+		class TraversalStack {
+		public:
+			bool empty() const { return size == 0; }
+
+			void push(const T& entry) {
+				if (size < MAX_TRAVERSAL_DEPTH) {
+					fixed[size] = entry;
+				}
+				else {
+					overflow.push_back(entry);
+				}
+				size++;
+			}
+
+			T pop() {
+				size--;
+				if (size < MAX_TRAVERSAL_DEPTH) return fixed[size];
+				T entry = overflow.back();
+				overflow.pop_back();
+				return entry;
+			}
+
+		private:
+			T fixed[MAX_TRAVERSAL_DEPTH];
+			std::vector<T> overflow;
+			u32 size = 0;
+		};
+
+		// static tree
+		std::vector<StaticNode> staticNodes;
+		std::vector<id_t> staticIds;
+		std::vector<Aabb> staticBounds;
+		std::unordered_map<id_t, u32> staticSlots;
+		u32 staticGeneration = 0;
+
+		// dynamic tree
+		std::vector<DynamicNode> dynamicNodes;
+		i32 dynamicRoot = NULL_NODE;
+		i32 freeList = NULL_NODE;
+		std::unordered_map<id_t, i32> dynamicSlots;
+	};
+
+}
@@ -0,0 +1,148 @@
+#include "fve_bvh_bench.hpp"
+#include "fve_bvh.hpp"
+#include "fve_camera.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace fve {
+
+	using BenchClock = std::chrono::steady_clock;
+
+	static double millisecondsSince(BenchClock::time_point start) {
+		return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+	}
+
+	void runBvhBenchmark(u32 objectCount) {
+		// a fixed seed keeps runs comparable
+		std::mt19937 rng{ 1337 };
+		std::uniform_real_distribution<float> position{ -500.0f, 500.0f };
+		std::uniform_real_distribution<float> extent{ 0.25f, 2.5f };
+		std::uniform_real_distribution<float> jitter{ -1.0f, 1.0f };
+		std::uniform_real_distribution<float> angle{ -3.14159f, 3.14159f };
+
+		// one in five objects moves every frame
+		const u32 dynamicStride = 5;
+
+		std::vector<Aabb> bounds(objectCount);
+		std::vector<std::pair<FveBvh::id_t, Aabb>> staticObjects;
+		std::vector<FveBvh::id_t> dynamicObjects;
+		for (u32 i = 0; i < objectCount; i++) {
+			glm::vec3 center{ position(rng), position(rng) * 0.1f, position(rng) };
+			glm::vec3 halfExtent{ extent(rng), extent(rng), extent(rng) };
+			bounds[i] = { center - halfExtent, center + halfExtent };
+
+			if (i % dynamicStride == 0) {
+				dynamicObjects.push_back(i);
+			}
+			else {
+				staticObjects.push_back({ i, bounds[i] });
+			}
+		}
+
+		FVE_CORE_INFO("BVH benchmark: {0} objects ({1} static, {2} dynamic)", objectCount, staticObjects.size(), dynamicObjects.size());
+
+		FveBvh bvh;
+
+		auto start = BenchClock::now();
+		bvh.buildStatic(staticObjects);
+		FVE_CORE_INFO("  static SAH build:   {0:.2f} ms ({1} nodes)", millisecondsSince(start), bvh.getStaticNodeCount());
+
+		start = BenchClock::now();
+		for (auto id : dynamicObjects) {
+			bvh.insertDynamic(id, bounds[id]);
+		}
+		FVE_CORE_INFO("  dynamic insertion:  {0:.2f} ms (height {1})", millisecondsSince(start), bvh.getDynamicHeight());
+
+		// nudge every static object, then refit once
+		start = BenchClock::now();
+		for (const auto& object : staticObjects) {
+			glm::vec3 offset{ jitter(rng) * 0.05f, 0.0f, jitter(rng) * 0.05f };
+			Aabb moved{ bounds[object.first].min + offset, bounds[object.first].max + offset };
+			bvh.updateStatic(object.first, moved);
+		}
+		bvh.refit();
+		FVE_CORE_INFO("  static refit:       {0:.2f} ms", millisecondsSince(start));
+
+		// small per frame movements mostly stay inside the fat boxes
+		const u32 frames = 10;
+		u32 reinserted = 0;
+		start = BenchClock::now();
+		for (u32 frame = 0; frame < frames; frame++) {
+			for (auto id : dynamicObjects) {
+				glm::vec3 velocity{ jitter(rng) * 0.05f, 0.0f, jitter(rng) * 0.05f };
+				bounds[id] = { bounds[id].min + velocity, bounds[id].max + velocity };
+				reinserted += bvh.updateDynamic(id, bounds[id]) ? 1 : 0;
+			}
+		}
+		FVE_CORE_INFO("  dynamic update:     {0:.3f} ms/frame ({1} reinsertions over {2} frames)", millisecondsSince(start) / frames, reinserted, frames);
+
+		// cameras scattered over the world looking in random directions
+		const u32 frustumQueries = 1000;
+		std::vector<Frustum> frustums(frustumQueries);
+		for (auto& frustum : frustums) {
+			FveCamera camera{};
+			camera.setPerspectiveProjection(glm::radians(50.0f), 16.0f / 9.0f, 0.1f, 250.0f);
+			camera.setViewYXZ({ position(rng), 0.0f, position(rng) }, { 0.0f, angle(rng), 0.0f });
+			frustum = camera.getFrustum();
+		}
+
+		std::vector<FveBvh::id_t> results;
+		results.reserve(objectCount);
+		size_t bvhVisible = 0;
+		start = BenchClock::now();
+		for (const auto& frustum : frustums) {
+			results.clear();
+			bvh.queryFrustum(frustum, results);
+			bvhVisible += results.size();
+		}
+		double bvhMs = millisecondsSince(start);
+
+		// the flat SIMD sphere test over every object, for comparison. the spheres are filled in once
+		// up front, like the BVH they are built outside the timed queries
+		FrustumCuller culler;
+		for (const auto& box : bounds) {
+			culler.add(glm::vec4(box.center(), glm::length(box.max - box.center())));
+		}
+		size_t flatVisible = 0;
+		start = BenchClock::now();
+		for (const auto& frustum : frustums) {
+			flatVisible += culler.cull(frustum);
+		}
+		double flatMs = millisecondsSince(start);
+
+		FVE_CORE_INFO("  frustum query:      {0:.3f} ms/query, {1:.0f} queries/s, {2} visible on average",
+			bvhMs / frustumQueries, frustumQueries / (bvhMs / 1000.0), bvhVisible / frustumQueries);
+		FVE_CORE_INFO("  flat SIMD cull:     {0:.3f} ms/query, {1} visible on average", flatMs / frustumQueries, flatVisible / frustumQueries);
+
+		const u32 rayQueries = 100000;
+		u32 rayHits = 0;
+		start = BenchClock::now();
+		for (u32 i = 0; i < rayQueries; i++) {
+			Ray ray{};
+			ray.origin = { position(rng), 0.0f, position(rng) };
+			ray.direction = glm::normalize(glm::vec3{ jitter(rng), jitter(rng) * 0.1f, jitter(rng) });
+			ray.maxDistance = 1000.0f;
+
+			FveBvh::RayHit hit;
+			rayHits += bvh.raycast(ray, hit) ? 1 : 0;
+		}
+		double rayMs = millisecondsSince(start);
+		FVE_CORE_INFO("  ray casts:          {0:.0f} rays/s ({1} hits)", rayQueries / (rayMs / 1000.0), rayHits);
+
+		const u32 sphereQueries = 100000;
+		size_t sphereResults = 0;
+		start = BenchClock::now();
+		for (u32 i = 0; i < sphereQueries; i++) {
+			results.clear();
+			bvh.querySphere({ position(rng), 0.0f, position(rng) }, 10.0f, results);
+			sphereResults += results.size();
+		}
+		double sphereMs = millisecondsSince(start);
+		FVE_CORE_INFO("  sphere queries:     {0:.0f} queries/s, {1:.1f} results on average",
+			sphereQueries / (sphereMs / 1000.0), static_cast<double>(sphereResults) / sphereQueries);
+	}
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+
+namespace fve {
+
+	// Headless BVH benchmark on synthetic objects: build, refit, dynamic updates and query throughput.
+	// Runs without a window or device, started with --bench-bvh.
+	void runBvhBenchmark(u32 objectCount);
+
+}
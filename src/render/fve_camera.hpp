@@ -4,6 +4,8 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include "fve_frustum.hpp"
+
 namespace fve {
 
 	class FveCamera {
@@ -21,10 +23,19 @@ namespace fve {
 		const glm::mat4& getInverseView() const { return inverseViewMatrix; }
 		const glm::vec3 getPosition() const { return glm::vec3(inverseViewMatrix[3]); }
 
+		// world space frustum of the current projection * view
+		Frustum getFrustum() const { return Frustum::fromMatrix(projectionMatrix * viewMatrix); }
+
+		// clip planes of the last projection, view space distances
+		float getNear() const { return nearPlane; }
+		float getFar() const { return farPlane; }
+
 	private:
 		glm::mat4 projectionMatrix{ 1.0f };
 		glm::mat4 viewMatrix{ 1.0f };
 		glm::mat4 inverseViewMatrix{ 1.0f };
+		float nearPlane = 0.1f;
+		float farPlane = 1000.0f;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "fve_depth_pyramid.hpp"
+#include "../core/fve_initializers.hpp"
+#include "../core/vulkan/fve_memory.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace fve {
+
+	static u32 previousPowerOfTwo(u32 value) {
+		u32 result = 1;
+		while (result * 2 <= value) {
+			result *= 2;
+		}
+		return result;
+	}
+
+	FveDepthPyramid::FveDepthPyramid(FveDevice& device) : device{ device } {
+		createPipeline();
+
+		// texelFetch ignores filtering, the sampler only completes the combined image descriptor
+		VkSamplerCreateInfo samplerInfo = fve_init::samplerCreateInfo(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid sampler!");
+		}
+	}
+
+	FveDepthPyramid::~FveDepthPyramid() {
+		destroyImage();
+		vkDestroySampler(device.device(), sampler, nullptr);
+		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	}
+
+	void FveDepthPyramid::createPipeline() {
+		setLayout = FveDescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkDescriptorSetLayout layout = setLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &layout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		pipeline = std::make_unique<FveComputePipeline>(device, "shaders/depth_pyramid.comp.spv", pipelineLayout);
+	}
+
+	void FveDepthPyramid::resize(VkExtent2D newDepthExtent, VkImageView depthView) {
+		destroyImage();
+
+		depthExtent = newDepthExtent;
+		extent.width = previousPowerOfTwo(depthExtent.width);
+		extent.height = previousPowerOfTwo(depthExtent.height);
+		mipCount = 1;
+		while ((std::max(extent.width, extent.height) >> mipCount) > 0) {
+			mipCount++;
+		}
+
+		createImage();
+		createDescriptorSets(depthView);
+
+		valid = false;
+		generation++;
+
+		FVE_CORE_DEBUG("Depth pyramid resized to {0}x{1} with {2} levels", extent.width, extent.height, mipCount);
+	}
+
+	void FveDepthPyramid::createImage() {
+		VkImageCreateInfo imageInfo = fve_init::imageCreateInfo(
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			{ extent.width, extent.height, 1 });
+		imageInfo.mipLevels = mipCount;
+
+		VmaAllocationCreateInfo allocCreateInfo{};
+		allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		VmaAllocationInfo allocInfo{};
+		device.createImageWithInfo(imageInfo, allocCreateInfo, allocation, allocInfo, image);
+
+		VkImageViewCreateInfo viewInfo = fve_init::imageViewCreateInfo(VK_FORMAT_R32_SFLOAT, image, VK_IMAGE_ASPECT_COLOR_BIT);
+		viewInfo.subresourceRange.levelCount = mipCount;
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &fullView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid image view!");
+		}
+
+		mipViews.resize(mipCount);
+		for (u32 i = 0; i < mipCount; i++) {
+			viewInfo.subresourceRange.baseMipLevel = i;
+			viewInfo.subresourceRange.levelCount = 1;
+			if (vkCreateImageView(device.device(), &viewInfo, nullptr, &mipViews[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create depth pyramid image view!");
+			}
+		}
+
+		// the pyramid stays in GENERAL, written as a storage image and sampled by the culling passes
+		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1 };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		device.endSingleTimeCommands(commandBuffer);
+	}
+
+	void FveDepthPyramid::createDescriptorSets(VkImageView depthView) {
+		const u32 setCount = mipCount;
+
+		descriptorPool = FveDescriptorPool::Builder(device)
+			.setMaxSets(setCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount)
+			.build();
+
+		VkDescriptorImageInfo outputInfo{};
+		outputInfo.imageView = mipViews[0];
+		outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo depthInfo{};
+		depthInfo.sampler = sampler;
+		depthInfo.imageView = depthView;
+		depthInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		FveDescriptorWriter(*setLayout, *descriptorPool)
+			.writeImage(0, &depthInfo)
+			.writeImage(1, &outputInfo)
+			.build(depthSet);
+
+		mipSets.resize(mipCount);
+		for (u32 i = 1; i < mipCount; i++) {
+			VkDescriptorImageInfo inputInfo{};
+			inputInfo.sampler = sampler;
+			inputInfo.imageView = mipViews[i - 1];
+			inputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo levelInfo{};
+			levelInfo.imageView = mipViews[i];
+			levelInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			FveDescriptorWriter(*setLayout, *descriptorPool)
+				.writeImage(0, &inputInfo)
+				.writeImage(1, &levelInfo)
+				.build(mipSets[i]);
+		}
+	}
+
+	void FveDepthPyramid::destroyImage() {
+		// frames in flight may still read the old image and its sets, they go once those have retired
+		std::shared_ptr<FveDescriptorPool> pool = std::move(descriptorPool);
+		device.deferDestroy([vkDevice = device.device(), views = std::move(mipViews), fullView = fullView, image = image, allocation = allocation, pool]() mutable {
+			for (auto view : views) {
+				vkDestroyImageView(vkDevice, view, nullptr);
+			}
+			if (fullView != VK_NULL_HANDLE) {
+				vkDestroyImageView(vkDevice, fullView, nullptr);
+			}
+			if (image != VK_NULL_HANDLE) {
+				vmaDestroyImage(fveAllocator, image, allocation);
+			}
+			pool.reset();
+		});
+
+		mipViews.clear();
+		fullView = VK_NULL_HANDLE;
+		image = VK_NULL_HANDLE;
+		allocation = VK_NULL_HANDLE;
+		depthSet = VK_NULL_HANDLE;
+		mipSets.clear();
+	}
+
+	void FveDepthPyramid::build(FveCommandRecorder& recorder, VkExtent2D renderExtent, const glm::mat4& newViewProjection) {
+		assert(renderExtent.width <= depthExtent.width && renderExtent.height <= depthExtent.height && "Render extent exceeds the depth attachment");
+
+		// the next level reads the one just written
+		VkImageMemoryBarrier levelBarrier{};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = image;
+		levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		pipeline->bind(recorder);
+
+		VkExtent2D inputSize = renderExtent;
+		for (u32 level = 0; level < mipCount; level++) {
+			VkExtent2D outputSize{ std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+
+			VkDescriptorSet set = level == 0 ? depthSet : mipSets[level];
+			recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set);
+
+			PushConstants push{};
+			push.inputSize = { inputSize.width, inputSize.height };
+			push.outputSize = { outputSize.width, outputSize.height };
+			recorder.pushConstants(pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push);
+
+			recorder.dispatch(
+				(outputSize.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+				(outputSize.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+				1);
+
+			levelBarrier.subresourceRange.baseMipLevel = level;
+			vkCmdPipelineBarrier(recorder,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+
+			inputSize = outputSize;
+		}
+
+		viewProjection = newViewProjection;
+		valid = true;
+	}
+
+	VkDescriptorImageInfo FveDepthPyramid::descriptorInfo() const {
+		VkDescriptorImageInfo info{};
+		info.sampler = sampler;
+		info.imageView = fullView;
+		info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		return info;
+	}
+
+}
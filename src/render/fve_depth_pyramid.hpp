@@ -0,0 +1,99 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "../core/vulkan/fve_descriptors.hpp"
+#include "../core/vulkan/fve_pipeline.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Hierarchical-Z pyramid of a depth buffer, used to reject occluded objects on the GPU.
+	 *
+	 * Every texel holds the farthest depth of the region it covers, so a bounding box whose nearest
+	 * depth lies behind the texels under it is certainly hidden. Level 0 is the largest power of two
+	 * at or below the depth extent and each level after it halves, which keeps the uv of a texel the
+	 * same at every level. The reduction reads the full footprint of every texel, so non power of two
+	 * depth buffers stay conservative.
+	 *
+	 * The pyramid remembers the view projection of the frame it was built from, so the next frame can
+	 * reproject its bounds into it before anything of its own has been drawn.
+	 */
+	class FveDepthPyramid {
+	public:
+		// must match local_size_x/y in depth_pyramid.comp
+		static constexpr u32 WORKGROUP_SIZE = 8;
+
+		FveDepthPyramid(FveDevice& device);
+		~FveDepthPyramid();
+
+		FveDepthPyramid(const FveDepthPyramid&) = delete;
+		FveDepthPyramid& operator=(const FveDepthPyramid&) = delete;
+
+		// recreates the pyramid for the depth attachment, which has to be sampleable
+		void resize(VkExtent2D depthExtent, VkImageView depthView);
+
+		// reduces the renderExtent corner of the depth attachment into the pyramid, so the pyramid covers
+		// the screen whatever the render scale. must be called outside a render pass, the depth image is
+		// expected in SHADER_READ_ONLY_OPTIMAL and earlier readers of the pyramid to be done, the render
+		// graph takes care of both
+		void build(FveCommandRecorder& recorder, VkExtent2D renderExtent, const glm::mat4& viewProjection);
+
+		// drops the current contents, queries must not test against the pyramid until the next build
+		void invalidate() { valid = false; }
+		bool isValid() const { return valid; }
+
+		// bumped by resize(), anything holding the pyramid view must rewrite its descriptors
+		u32 getGeneration() const { return generation; }
+
+		VkDescriptorImageInfo descriptorInfo() const;
+		VkImage getImage() const { return image; }
+		VkExtent2D getExtent() const { return extent; }
+		u32 getMipCount() const { return mipCount; }
+		const glm::mat4& getViewProjection() const { return viewProjection; }
+
+	private:
+		struct PushConstants {
+			glm::uvec2 inputSize;
+			glm::uvec2 outputSize;
+		};
+
+		void createPipeline();
+		void createImage();
+		void createDescriptorSets(VkImageView depthView);
+		void destroyImage();
+
+		FveDevice& device;
+
+		std::unique_ptr<FveDescriptorSetLayout> setLayout;
+		std::unique_ptr<FveDescriptorPool> descriptorPool;
+		VkPipelineLayout pipelineLayout;
+		std::unique_ptr<FveComputePipeline> pipeline;
+		VkSampler sampler;
+
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkImageView fullView = VK_NULL_HANDLE;
+		std::vector<VkImageView> mipViews;
+
+		// level 0 reads the depth attachment, the rest read the level above
+		VkDescriptorSet depthSet = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> mipSets;
+
+		VkExtent2D depthExtent{};
+		VkExtent2D extent{};
+		u32 mipCount = 0;
+		u32 generation = 0;
+
+		glm::mat4 viewProjection{ 1.0f };
+		bool valid = false;
+	};
+
+}
@@ -0,0 +1,42 @@
+#include "fve_dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace fve {
+
+	void FveDynamicResolution::setSettings(const Settings& newSettings) {
+		assert(newSettings.minScale > 0.0f && newSettings.minScale <= newSettings.maxScale && "Invalid render scale range");
+		assert(newSettings.targetFrameMs > 0.0f && "Target frame time must be positive");
+
+		settings = newSettings;
+		stats.scale = settings.enabled ? std::clamp(stats.scale, settings.minScale, settings.maxScale) : settings.maxScale;
+	}
+
+	float FveDynamicResolution::update(float gpuFrameMs) {
+		stats.gpuFrameMs = stats.gpuFrameMs > 0.0f ? stats.gpuFrameMs + (gpuFrameMs - stats.gpuFrameMs) * SMOOTHING : gpuFrameMs;
+
+		if (!settings.enabled) {
+			stats.scale = settings.maxScale;
+			return stats.scale;
+		}
+
+		const float target = settings.targetFrameMs;
+		if (stats.gpuFrameMs > target || stats.gpuFrameMs < target * LOWER_BAND) {
+			const float wanted = stats.scale * std::sqrt(target * HEADROOM / std::max(stats.gpuFrameMs, 0.01f));
+			stats.scale += (wanted - stats.scale) * RESPONSE;
+		}
+		stats.scale = std::clamp(stats.scale, settings.minScale, settings.maxScale);
+
+		return stats.scale;
+	}
+
+	VkExtent2D FveDynamicResolution::scaleExtent(VkExtent2D extent, float scale) {
+		return {
+			std::max(static_cast<u32>(std::lround(extent.width * scale)), 1u),
+			std::max(static_cast<u32>(std::lround(extent.height * scale)), 1u)
+		};
+	}
+
+}
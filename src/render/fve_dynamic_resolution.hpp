@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+
+#include <vulkan/vulkan.h>
+
+namespace fve {
+
+	/*
+	 * Picks the scale the scene renders at from the GPU time of finished frames.
+	 *
+	 * GPU time roughly follows the pixel count, so the scale moves by the square root of how far the
+	 * smoothed frame time is from the target. Nothing changes while the frame time sits in a band just
+	 * under the target, which keeps the scale from chasing noise and frames from alternating between
+	 * two sizes. The readings are a couple of frames old, so the scale only takes part of each step.
+	 */
+	class FveDynamicResolution {
+	public:
+		struct Settings {
+			bool enabled = true;
+			float minScale = 0.5f;
+			// the scene attachments are allocated at this scale, changing it recreates them
+			float maxScale = 1.0f;
+			float targetFrameMs = 1000.0f / 60.0f;
+		};
+
+		struct Stats {
+			float scale = 1.0f;
+			float gpuFrameMs = 0.0f; // smoothed
+		};
+
+		FveDynamicResolution() = default;
+
+		void setSettings(const Settings& newSettings);
+		const Settings& getSettings() const { return settings; }
+
+		// feeds the GPU time of a finished frame, returns the scale for the next one
+		float update(float gpuFrameMs);
+		float getScale() const { return stats.scale; }
+
+		// rounded, at least one pixel
+		static VkExtent2D scaleExtent(VkExtent2D extent, float scale);
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		// weight of a new reading in the smoothed frame time
+		static constexpr float SMOOTHING = 0.1f;
+		// frame times between this fraction of the target and the target leave the scale alone
+		static constexpr float LOWER_BAND = 0.8f;
+		// a step aims this far under the target, the middle of the band
+		static constexpr float HEADROOM = 0.9f;
+		// fraction of a step taken per frame
+		static constexpr float RESPONSE = 0.2f;
+
+		Settings settings{};
+		Stats stats{};
+	};
+
+}
@@ -0,0 +1,175 @@
+#include "fve_frame_counters.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace fve {
+
+	static bool exceeds(u64 value, u64 limit) {
+		return limit != 0 && value > limit;
+	}
+
+	FveFrameCounters::FveFrameCounters(FveDevice& device, u32 frameCount)
+		: device{ device }, frameCount{ frameCount }, slotUsed(frameCount, false) {
+		if (!device.supportsPipelineStatistics()) {
+			FVE_CORE_WARN("Pipeline statistics not supported, only recorded commands are counted");
+			return;
+		}
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		poolInfo.queryCount = frameCount;
+		poolInfo.pipelineStatistics = STATISTIC_FLAGS;
+
+		if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline statistics query pool!");
+		}
+	}
+
+	FveFrameCounters::~FveFrameCounters() {
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device.device(), queryPool, nullptr);
+		}
+	}
+
+	void FveFrameCounters::beginFrame(VkCommandBuffer commandBuffer, u32 frameIndex) {
+		assert(frameIndex < frameCount && "Frame index out of range");
+		assert(!frameOpen && "The previous frame was not ended");
+
+		// every recorder of the previous frame was destroyed before it was submitted
+		latestRecorded = recordTotals.take();
+		bool over = exceeds(latestRecorded.drawCalls, budget.drawCalls) ||
+			exceeds(latestRecorded.indirectDraws, budget.indirectDraws) ||
+			exceeds(latestRecorded.pipelineBinds, budget.pipelineBinds) ||
+			exceeds(latestRecorded.descriptorBinds, budget.descriptorBinds) ||
+			exceeds(latestRecorded.triangles, budget.triangles);
+
+		stats.frames++;
+		stats.peakRecorded.drawCalls = std::max(stats.peakRecorded.drawCalls, latestRecorded.drawCalls);
+		stats.peakRecorded.indirectDraws = std::max(stats.peakRecorded.indirectDraws, latestRecorded.indirectDraws);
+		stats.peakRecorded.instances = std::max(stats.peakRecorded.instances, latestRecorded.instances);
+		stats.peakRecorded.triangles = std::max(stats.peakRecorded.triangles, latestRecorded.triangles);
+		stats.peakRecorded.dispatches = std::max(stats.peakRecorded.dispatches, latestRecorded.dispatches);
+		stats.peakRecorded.pipelineBinds = std::max(stats.peakRecorded.pipelineBinds, latestRecorded.pipelineBinds);
+		stats.peakRecorded.descriptorBinds = std::max(stats.peakRecorded.descriptorBinds, latestRecorded.descriptorBinds);
+		stats.peakRecorded.pushConstantBytes = std::max(stats.peakRecorded.pushConstantBytes, latestRecorded.pushConstantBytes);
+		stats.peakRecorded.bufferBinds = std::max(stats.peakRecorded.bufferBinds, latestRecorded.bufferBinds);
+
+		if (supportsPipelineStatistics()) {
+			PipelineStats pipelineStats{};
+			if (slotUsed[frameIndex] && readResults(frameIndex, pipelineStats)) {
+				latestPipeline = pipelineStats;
+				latestPipelineValid = true;
+				over = over ||
+					exceeds(pipelineStats.inputPrimitives, budget.inputPrimitives) ||
+					exceeds(pipelineStats.fragmentInvocations, budget.fragmentInvocations);
+
+				PipelineStats& peak = stats.peakPipeline;
+				peak.inputPrimitives = std::max(peak.inputPrimitives, pipelineStats.inputPrimitives);
+				peak.vertexInvocations = std::max(peak.vertexInvocations, pipelineStats.vertexInvocations);
+				peak.clippingInvocations = std::max(peak.clippingInvocations, pipelineStats.clippingInvocations);
+				peak.clippingPrimitives = std::max(peak.clippingPrimitives, pipelineStats.clippingPrimitives);
+				peak.fragmentInvocations = std::max(peak.fragmentInvocations, pipelineStats.fragmentInvocations);
+				peak.computeInvocations = std::max(peak.computeInvocations, pipelineStats.computeInvocations);
+			}
+
+			vkCmdResetQueryPool(commandBuffer, queryPool, frameIndex, 1);
+			vkCmdBeginQuery(commandBuffer, queryPool, frameIndex, 0);
+			slotUsed[frameIndex] = true;
+			currentFrame = frameIndex;
+			frameOpen = true;
+		}
+
+		checkBudget(over);
+	}
+
+	void FveFrameCounters::endFrame(VkCommandBuffer commandBuffer) {
+		if (!supportsPipelineStatistics()) return;
+		assert(frameOpen && "Can't end a frame that was not begun");
+		vkCmdEndQuery(commandBuffer, queryPool, currentFrame);
+		frameOpen = false;
+	}
+
+	bool FveFrameCounters::readResults(u32 frameIndex, PipelineStats& pipelineStats) {
+		// the statistics in bit order, then the availability
+		u64 results[STATISTIC_COUNT + 1]{};
+		VkResult result = vkGetQueryPoolResults(device.device(),
+			queryPool,
+			frameIndex,
+			1,
+			sizeof(results),
+			results,
+			sizeof(results),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[STATISTIC_COUNT] == 0) return false;
+
+		pipelineStats.inputPrimitives = results[0];
+		pipelineStats.vertexInvocations = results[1];
+		pipelineStats.clippingInvocations = results[2];
+		pipelineStats.clippingPrimitives = results[3];
+		pipelineStats.fragmentInvocations = results[4];
+		pipelineStats.computeInvocations = results[5];
+		return true;
+	}
+
+	void FveFrameCounters::checkBudget(bool over) {
+		if (over) {
+			stats.framesOverBudget++;
+			// a lasting overrun is reported once, when it starts
+			if (!overBudget) {
+				FVE_CORE_WARN("Frame over budget: {0} draws, {1} indirect, {2} pipeline binds, {3} descriptor binds, {4} triangles, {5} primitives, {6} fragments",
+					latestRecorded.drawCalls,
+					latestRecorded.indirectDraws,
+					latestRecorded.pipelineBinds,
+					latestRecorded.descriptorBinds,
+					latestRecorded.triangles,
+					latestPipeline.inputPrimitives,
+					latestPipeline.fragmentInvocations);
+			}
+		}
+		overBudget = over;
+	}
+
+	bool FveFrameCounters::getLatestPipelineStats(PipelineStats& pipelineStats) const {
+		if (!latestPipelineValid) return false;
+		pipelineStats = latestPipeline;
+		return true;
+	}
+
+	void FveFrameCounters::dump() const {
+		FVE_CORE_DEBUG("Recorded: {0} draws, {1} indirect, {2} instances, {3} triangles, {4} dispatches, {5} pipeline binds, {6} descriptor binds, {7} buffer binds, {8} push constant bytes",
+			latestRecorded.drawCalls,
+			latestRecorded.indirectDraws,
+			latestRecorded.instances,
+			latestRecorded.triangles,
+			latestRecorded.dispatches,
+			latestRecorded.pipelineBinds,
+			latestRecorded.descriptorBinds,
+			latestRecorded.bufferBinds,
+			latestRecorded.pushConstantBytes);
+
+		if (latestPipelineValid) {
+			FVE_CORE_DEBUG("Pipeline: {0} primitives, {1} vertex invocations, {2}/{3} primitives past clipping, {4} fragment invocations, {5} compute invocations",
+				latestPipeline.inputPrimitives,
+				latestPipeline.vertexInvocations,
+				latestPipeline.clippingPrimitives,
+				latestPipeline.clippingInvocations,
+				latestPipeline.fragmentInvocations,
+				latestPipeline.computeInvocations);
+		}
+
+		FVE_CORE_DEBUG("Peaks over {0} frames: {1} draws, {2} indirect, {3} pipeline binds, {4} triangles, {5} primitives, {6} fragment invocations, over budget: {7}",
+			stats.frames,
+			stats.peakRecorded.drawCalls,
+			stats.peakRecorded.indirectDraws,
+			stats.peakRecorded.pipelineBinds,
+			stats.peakRecorded.triangles,
+			stats.peakPipeline.inputPrimitives,
+			stats.peakPipeline.fragmentInvocations,
+			stats.framesOverBudget);
+	}
+
+}
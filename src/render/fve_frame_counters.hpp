@@ -0,0 +1,116 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "../core/vulkan/fve_command_recorder.hpp"
+
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Per frame workload counters, for spotting regressions in what a frame asks of the GPU.
+	 *
+	 * Recorders hand what they recorded to getRecordTotals() from any thread, beginFrame() takes the
+	 * sum as the previous frame's counts. A pipeline statistics query spans the scene of every frame,
+	 * its results are read back like the profiler's timestamps once the slot comes around again, so
+	 * they trail the recorded counts by the frames in flight.
+	 *
+	 * Frames whose counts exceed the budget are counted, and a warning is logged when a frame goes
+	 * over after being within it. Without pipeline statistics support only the recorded counts exist.
+	 */
+	class FveFrameCounters {
+	public:
+		// what the GPU reports, counted over the whole scene
+		struct PipelineStats {
+			u64 inputPrimitives = 0;
+			u64 vertexInvocations = 0;
+			u64 clippingInvocations = 0;
+			u64 clippingPrimitives = 0; // what survives clipping and reaches the rasterizer
+			u64 fragmentInvocations = 0;
+			u64 computeInvocations = 0;
+		};
+
+		// limits for a frame, zero leaves a counter unchecked
+		struct Budget {
+			u64 drawCalls = 0;
+			u64 indirectDraws = 0; // checked against the upper bound the commands were recorded with
+			u64 pipelineBinds = 0;
+			u64 descriptorBinds = 0;
+			u64 triangles = 0; // of the directly recorded draws
+			u64 inputPrimitives = 0; // indirect draws included
+			u64 fragmentInvocations = 0;
+		};
+
+		struct Stats {
+			u32 frames = 0;
+			u32 framesOverBudget = 0;
+			RecordStats peakRecorded{};
+			PipelineStats peakPipeline{};
+		};
+
+		FveFrameCounters(FveDevice& device, u32 frameCount);
+		~FveFrameCounters();
+
+		FveFrameCounters(const FveFrameCounters&) = delete;
+		FveFrameCounters& operator=(const FveFrameCounters&) = delete;
+
+		bool supportsPipelineStatistics() const { return queryPool != VK_NULL_HANDLE; }
+		// what secondary buffers have to inherit to execute inside the query
+		VkQueryPipelineStatisticFlags getStatisticFlags() const { return supportsPipelineStatistics() ? STATISTIC_FLAGS : 0; }
+
+		FveRecordTotals& getRecordTotals() { return recordTotals; }
+
+		// takes the previous frame's recorded counts and the slot's last statistics, then opens the query.
+		// the slot's last frame must have retired and commandBuffer must be outside a render pass
+		void beginFrame(VkCommandBuffer commandBuffer, u32 frameIndex);
+		// closes the query, later commands are not counted by the GPU
+		void endFrame(VkCommandBuffer commandBuffer);
+
+		void setBudget(const Budget& newBudget) { budget = newBudget; }
+		const Budget& getBudget() const { return budget; }
+
+		const RecordStats& getLatestRecorded() const { return latestRecorded; }
+		// false until the first results were read back
+		bool getLatestPipelineStats(PipelineStats& pipelineStats) const;
+
+		const Stats& getStats() const { return stats; }
+		// peaks and frames over budget start over
+		void resetStats() { stats = {}; }
+
+		// logs the latest counts and the stats since the last reset
+		void dump() const;
+
+	private:
+		static constexpr VkQueryPipelineStatisticFlags STATISTIC_FLAGS =
+			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+		// one result per bit, written in bit order
+		static constexpr u32 STATISTIC_COUNT = 6;
+
+		bool readResults(u32 frameIndex, PipelineStats& pipelineStats);
+		void checkBudget(bool over);
+
+		FveDevice& device;
+		u32 frameCount;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		// whether the slot's query was begun since the pool was created
+		std::vector<bool> slotUsed;
+		bool frameOpen = false;
+		u32 currentFrame = 0;
+
+		FveRecordTotals recordTotals;
+		RecordStats latestRecorded{};
+		PipelineStats latestPipeline{};
+		bool latestPipelineValid = false;
+
+		Budget budget{};
+		bool overBudget = false;
+		Stats stats{};
+	};
+
+}
@@ -2,10 +2,14 @@
 
 #include "fve_camera.hpp"
 #include "../fve_game_object.hpp"
+#include "fve_render_queue.hpp"
+#include "fve_gpu_profiler.hpp"
+#include "../core/vulkan/fve_command_recorder.hpp"
+#include "../fve_constants.hpp"
 
 #include <vulkan/vulkan.h>
 
-#define MAX_LIGHTS 10
+#include <vector>
 
 namespace fve {
 
@@ -20,8 +24,9 @@ namespace fve {
 		glm::vec4 lightColor{ 1.0f, 1.0f, 1.0f, 0.5f };
 	};
 
+	// element of the light storage buffer, see FveLightClusters
 	struct PointLight {
-		glm::vec4 position{}; // ignore w
+		glm::vec4 position{}; // w is the range the light reaches
 		glm::vec4 color{}; // w is intensity
 	};
 
@@ -32,10 +37,29 @@ namespace fve {
 		alignas(16) glm::vec4 ambientLightColor{ 1.0f, 1.0f, 1.0f, 0.02f }; // w is light intensity
 		Fog fog;
 		Sun sun;
-		PointLight pointLights[MAX_LIGHTS];
+		// x and y scale framebuffer pixels to cluster tiles, z and w map log(view depth) to a depth slice
+		alignas(16) glm::vec4 clusterScale{};
+		// cluster counts along x, y and depth, w is the length of a cluster's light list
+		alignas(16) glm::uvec4 clusterGrid{};
+		// world to shadow map clip space of every cascade, see FveShadowMaps
+		alignas(16) glm::mat4 shadowMatrices[SHADOW_CASCADE_COUNT]{};
+		// view depth each cascade reaches, fragments beyond the last one are unshadowed
+		alignas(16) glm::vec4 cascadeSplits{};
 		int numLights;
 	};
 
+	// per frame counters, reset by the game before the systems run
+	struct FrameStats {
+		u32 visibleObjects = 0;
+		u32 culledObjects = 0;
+		u32 gpuDrivenObjects = 0;
+		// read back from the GPU culling passes, so they trail the frame by the frames in flight
+		u32 occludedObjects = 0;
+		u32 disoccludedObjects = 0;
+		// CPU time spent recording the main pass
+		float recordMilliseconds = 0.0f;
+	};
+
 	struct FrameInfo {
 		int frameIndex;
 		float frameTime;
@@ -44,6 +68,11 @@ namespace fve {
 		VkDescriptorSet globalDescriptorSet;
 		VkDescriptorSet texturedDescriptorSet;
 		FveGameObject::Map& gameObjects;
+		FveRenderQueue& renderQueue;
+		FrameStats& stats;
+		const std::vector<FveGameObject::id_t>& visibleObjects; // inside the camera frustum this frame
+		FveGpuProfiler* profiler; // systems time their commands with it, may be null
+		FveRecordTotals* recordTotals; // systems count what they record into it, may be null
 	};
 
 }
\ No newline at end of file
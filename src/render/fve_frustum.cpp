@@ -0,0 +1,171 @@
+#include "fve_frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#define FVE_FRUSTUM_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FVE_FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace fve {
+
+	// every batch kernel reads this many spheres at a time, the arrays are padded to a multiple of it
+	static constexpr u32 CULL_BATCH = 8;
+
+	Frustum Frustum::fromMatrix(const glm::mat4& m) {
+		// glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+
+		Frustum frustum{};
+		frustum.planes[Left] = row(3) + row(0);
+		frustum.planes[Right] = row(3) - row(0);
+		frustum.planes[Bottom] = row(3) + row(1);
+		frustum.planes[Top] = row(3) - row(1);
+		frustum.planes[Near] = row(2); // 0 <= z rather than -w <= z
+		frustum.planes[Far] = row(3) - row(2);
+
+		for (auto& plane : frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+
+		return frustum;
+	}
+
+	bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+		for (const auto& plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+		}
+		return true;
+	}
+
+	bool Frustum::intersectsAabb(const glm::vec3& min, const glm::vec3& max) const {
+		for (const auto& plane : planes) {
+			// the corner furthest along the plane normal
+			glm::vec3 positive{
+				plane.x >= 0.0f ? max.x : min.x,
+				plane.y >= 0.0f ? max.y : min.y,
+				plane.z >= 0.0f ? max.z : min.z
+			};
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) return false;
+		}
+		return true;
+	}
+
+	glm::vec4 transformSphere(const glm::vec4& sphere, const glm::mat4& modelMatrix) {
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(sphere), 1.0f));
+
+		float scaleSquared = std::max({
+			glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+			glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1])),
+			glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))
+		});
+
+		return glm::vec4(center, sphere.w * std::sqrt(scaleSquared));
+	}
+
+	void FrustumCuller::clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+		count = 0;
+	}
+
+	u32 FrustumCuller::add(const glm::vec4& sphere) {
+		centerX.push_back(sphere.x);
+		centerY.push_back(sphere.y);
+		centerZ.push_back(sphere.z);
+		radius.push_back(sphere.w);
+		return count++;
+	}
+
+#if defined(FVE_FRUSTUM_AVX)
+
+	static void cullBatch(const Frustum& frustum, const float* x, const float* y, const float* z, const float* r, u8* visible) {
+		const __m256 cx = _mm256_loadu_ps(x);
+		const __m256 cy = _mm256_loadu_ps(y);
+		const __m256 cz = _mm256_loadu_ps(z);
+		const __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const auto& plane : frustum.planes) {
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negR, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (u32 i = 0; i < 8; i++) {
+			visible[i] = static_cast<u8>((mask >> i) & 1);
+		}
+	}
+
+#elif defined(FVE_FRUSTUM_SSE)
+
+	static void cullBatch4(const Frustum& frustum, const float* x, const float* y, const float* z, const float* r, u8* visible) {
+		const __m128 cx = _mm_loadu_ps(x);
+		const __m128 cy = _mm_loadu_ps(y);
+		const __m128 cz = _mm_loadu_ps(z);
+		const __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const auto& plane : frustum.planes) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negR));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (u32 i = 0; i < 4; i++) {
+			visible[i] = static_cast<u8>((mask >> i) & 1);
+		}
+	}
+
+	static void cullBatch(const Frustum& frustum, const float* x, const float* y, const float* z, const float* r, u8* visible) {
+		cullBatch4(frustum, x, y, z, r, visible);
+		cullBatch4(frustum, x + 4, y + 4, z + 4, r + 4, visible + 4);
+	}
+
+#else
+
+	static void cullBatch(const Frustum& frustum, const float* x, const float* y, const float* z, const float* r, u8* visible) {
+		for (u32 i = 0; i < CULL_BATCH; i++) {
+			visible[i] = frustum.intersectsSphere({ x[i], y[i], z[i] }, r[i]) ? 1 : 0;
+		}
+	}
+
+#endif
+
+	u32 FrustumCuller::cull(const Frustum& frustum) {
+		// pad to whole batches, the padding results are never read
+		const u32 padded = (count + CULL_BATCH - 1) / CULL_BATCH * CULL_BATCH;
+		centerX.resize(padded, 0.0f);
+		centerY.resize(padded, 0.0f);
+		centerZ.resize(padded, 0.0f);
+		radius.resize(padded, 0.0f);
+		visible.resize(padded);
+
+		for (u32 i = 0; i < padded; i += CULL_BATCH) {
+			cullBatch(frustum, &centerX[i], &centerY[i], &centerZ[i], &radius[i], &visible[i]);
+		}
+
+		// drop the padding again so later add() calls line up
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		radius.resize(count);
+
+		u32 visibleCount = 0;
+		for (u32 i = 0; i < count; i++) {
+			visibleCount += visible[i];
+		}
+		return visibleCount;
+	}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace fve {
+
+	struct Frustum {
+		enum Plane { Left = 0, Right, Bottom, Top, Near, Far, Count };
+
+		// xyz is the inward facing unit normal, w the distance, so dot(n, p) + w >= 0 is inside
+		glm::vec4 planes[Plane::Count];
+
+		// Gribb/Hartmann extraction for a Vulkan style [0, 1] clip space depth range
+		static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+		bool intersectsSphere(const glm::vec3& center, float radius) const;
+		bool intersectsAabb(const glm::vec3& min, const glm::vec3& max) const;
+	};
+
+	// world space sphere around a mesh's bounds, grown by the largest axis scale of the model matrix
+	glm::vec4 transformSphere(const glm::vec4& sphere, const glm::mat4& modelMatrix);
+
+	/*
+	 * Tests a batch of bounding spheres against a frustum.
+	 * Spheres are stored as separate x/y/z/radius arrays so 4 (SSE) or 8 (AVX) of them go through
+	 * each plane at once, with a scalar loop on targets that have neither.
+	 */
+	class FrustumCuller {
+	public:
+		void clear();
+
+		// returns the index used to query the result after cull()
+		u32 add(const glm::vec4& sphere);
+
+		// returns the number of visible spheres
+		u32 cull(const Frustum& frustum);
+
+		bool isVisible(u32 index) const { return visible[index] != 0; }
+		u32 size() const { return count; }
+
+	private:
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> radius;
+		std::vector<u8> visible;
+		u32 count = 0;
+	};
+
+}
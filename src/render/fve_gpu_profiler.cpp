@@ -0,0 +1,190 @@
+#include "fve_gpu_profiler.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace fve {
+
+	static const char* FRAME_SCOPE = "frame";
+
+	FveGpuProfiler::FveGpuProfiler(FveDevice& device, u32 frameCount)
+		: device{ device }, frameCount{ frameCount }, slots(frameCount) {
+		for (FrameSlot& slot : slots) {
+			slot.names.resize(MAX_SCOPES);
+		}
+
+		if (!device.properties.limits.timestampComputeAndGraphics) {
+			FVE_CORE_WARN("Timestamps not supported, GPU profiling disabled");
+			return;
+		}
+
+		u32 familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice(), &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(device.physicalDevice(), &familyCount, families.data());
+
+		const u32 validBits = families[device.findPhysicalQueueFamilies().graphicsFamily].timestampValidBits;
+		if (validBits == 0) {
+			FVE_CORE_WARN("Graphics queue has no valid timestamp bits, GPU profiling disabled");
+			return;
+		}
+		// the counter wraps at validBits, differences are taken modulo that
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		nanosecondsPerTick = device.properties.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = frameCount * MAX_SCOPES * 2;
+
+		if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+
+	FveGpuProfiler::~FveGpuProfiler() {
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device.device(), queryPool, nullptr);
+		}
+	}
+
+	void FveGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, u32 frameIndex) {
+		assert(frameIndex < frameCount && "Frame index out of range");
+		assert(!frameOpen && "The previous frame was not ended");
+		latestFrameValid = false;
+		if (!isSupported()) return;
+
+		readResults(frameIndex);
+
+		slots[frameIndex].scopeCount = 0;
+		vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery(frameIndex, 0), MAX_SCOPES * 2);
+		currentFrame = frameIndex;
+		frameOpen = true;
+
+		// always lands in the first scope
+		beginScope(commandBuffer, FRAME_SCOPE);
+	}
+
+	void FveGpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+		if (!isSupported()) return;
+		assert(frameOpen && "Can't end a frame that was not begun");
+		endScope(commandBuffer, 0);
+		frameOpen = false;
+	}
+
+	u32 FveGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string& name) {
+		if (!isSupported() || !frameOpen) return NO_SCOPE;
+
+		FrameSlot& slot = slots[currentFrame];
+		const u32 scope = slot.scopeCount.fetch_add(1);
+		if (scope >= MAX_SCOPES) return NO_SCOPE;
+
+		// every scope has its own index, so threads never write the same name
+		slot.names[scope] = name;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery(currentFrame, scope));
+		return scope;
+	}
+
+	void FveGpuProfiler::endScope(VkCommandBuffer commandBuffer, u32 scope) {
+		if (scope == NO_SCOPE) return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(currentFrame, scope) + 1);
+	}
+
+	void FveGpuProfiler::readResults(u32 frameIndex) {
+		FrameSlot& slot = slots[frameIndex];
+		const u32 scopeCount = std::min(slot.scopeCount.load(), MAX_SCOPES);
+		if (scopeCount == 0) return;
+
+		// value and availability of the begin and end query of every scope
+		std::vector<u64> results(scopeCount * 4);
+		VkResult result = vkGetQueryPoolResults(device.device(),
+			queryPool,
+			firstQuery(frameIndex, 0),
+			scopeCount * 2,
+			results.size() * sizeof(u64),
+			results.data(),
+			2 * sizeof(u64),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result != VK_SUCCESS && result != VK_NOT_READY) return;
+
+		std::unordered_map<std::string, float> totals;
+		for (u32 i = 0; i < scopeCount; i++) {
+			const u64* scope = &results[i * 4];
+			// a scope that was never closed has no end timestamp
+			if (scope[1] == 0 || scope[3] == 0) continue;
+
+			const u64 ticks = (scope[2] - scope[0]) & timestampMask;
+			totals[slot.names[i]] += static_cast<float>(static_cast<double>(ticks) * nanosecondsPerTick / 1e6);
+		}
+
+		for (const auto& [name, milliseconds] : totals) {
+			History& history = histories[name];
+			if (history.samples.size() < HISTORY) {
+				history.samples.push_back(milliseconds);
+			}
+			else {
+				history.samples[history.next] = milliseconds;
+			}
+			history.next = (history.next + 1) % HISTORY;
+
+			if (name == FRAME_SCOPE) {
+				latestFrameMs = milliseconds;
+				latestFrameValid = true;
+			}
+		}
+	}
+
+	bool FveGpuProfiler::getLatestFrameMs(float& milliseconds) const {
+		if (!latestFrameValid) return false;
+		milliseconds = latestFrameMs;
+		return true;
+	}
+
+	std::vector<FveGpuProfiler::ScopeStats> FveGpuProfiler::getStats() const {
+		std::vector<ScopeStats> stats;
+		stats.reserve(histories.size());
+
+		std::vector<float> sorted;
+		for (const auto& [name, history] : histories) {
+			if (history.samples.empty()) continue;
+			sorted = history.samples;
+			std::sort(sorted.begin(), sorted.end());
+
+			float sum = 0.0f;
+			for (float sample : sorted) sum += sample;
+
+			const size_t count = sorted.size();
+			ScopeStats scope{};
+			scope.name = name;
+			scope.samples = static_cast<u32>(count);
+			scope.averageMs = sum / static_cast<float>(count);
+			scope.medianMs = sorted[count / 2];
+			scope.p95Ms = sorted[std::min(count - 1, count * 95 / 100)];
+			scope.maxMs = sorted.back();
+			stats.push_back(scope);
+		}
+
+		std::sort(stats.begin(), stats.end(), [](const ScopeStats& a, const ScopeStats& b) {
+			if ((a.name == FRAME_SCOPE) != (b.name == FRAME_SCOPE)) return a.name == FRAME_SCOPE;
+			return a.averageMs > b.averageMs;
+		});
+		return stats;
+	}
+
+	void FveGpuProfiler::dump() const {
+		if (!isSupported()) return;
+
+		for (const ScopeStats& scope : getStats()) {
+			FVE_CORE_DEBUG("GPU {0}: {1:.3f} ms average, {2:.3f} median, {3:.3f} p95, {4:.3f} max over {5} frames",
+				scope.name,
+				scope.averageMs,
+				scope.medianMs,
+				scope.p95Ms,
+				scope.maxMs,
+				scope.samples);
+		}
+	}
+
+}
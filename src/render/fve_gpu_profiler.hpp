@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * GPU timings of named scopes, measured with timestamp queries.
+	 *
+	 * Every frame in flight owns a range of the query pool. beginFrame() reads back what the range
+	 * held when the slot was last used, that frame has retired so nothing waits, then resets it.
+	 * Scopes may be opened from any thread recording into the frame, secondary buffers included, and
+	 * scopes sharing a name within a frame are summed. Statistics cover the last HISTORY frames
+	 * each scope showed up in.
+	 *
+	 * Without timestamp support every call is a no-op and no statistics are gathered.
+	 */
+	class FveGpuProfiler {
+	public:
+		static constexpr u32 MAX_SCOPES = 64; // per frame, the frame scope included
+		static constexpr u32 HISTORY = 120;
+		static constexpr u32 NO_SCOPE = ~0u;
+
+		struct ScopeStats {
+			std::string name;
+			u32 samples = 0;
+			float averageMs = 0.0f;
+			float medianMs = 0.0f;
+			float p95Ms = 0.0f;
+			float maxMs = 0.0f;
+		};
+
+		// begin and end timestamps around the commands recorded in between, a null profiler records nothing
+		class Scope {
+		public:
+			Scope(FveGpuProfiler* profiler, VkCommandBuffer commandBuffer, const std::string& name)
+				: profiler{ profiler }, commandBuffer{ commandBuffer } {
+				if (profiler) scope = profiler->beginScope(commandBuffer, name);
+			}
+			~Scope() {
+				if (profiler) profiler->endScope(commandBuffer, scope);
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			FveGpuProfiler* profiler;
+			VkCommandBuffer commandBuffer;
+			u32 scope = NO_SCOPE;
+		};
+
+		FveGpuProfiler(FveDevice& device, u32 frameCount);
+		~FveGpuProfiler();
+
+		FveGpuProfiler(const FveGpuProfiler&) = delete;
+		FveGpuProfiler& operator=(const FveGpuProfiler&) = delete;
+
+		bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+		// collects the results of the slot's previous frame and opens the frame scope. the slot's last
+		// frame must have retired and commandBuffer must be outside a render pass
+		void beginFrame(VkCommandBuffer commandBuffer, u32 frameIndex);
+		// closes the frame scope, later commands are not part of the frame time
+		void endFrame(VkCommandBuffer commandBuffer);
+
+		// NO_SCOPE once the frame ran out of queries, endScope() ignores it
+		u32 beginScope(VkCommandBuffer commandBuffer, const std::string& name);
+		void endScope(VkCommandBuffer commandBuffer, u32 scope);
+
+		// frame time read back by the last beginFrame(), false if it read nothing
+		bool getLatestFrameMs(float& milliseconds) const;
+
+		// sorted by average time, the frame first
+		std::vector<ScopeStats> getStats() const;
+		void dump() const;
+
+	private:
+		struct FrameSlot {
+			std::atomic<u32> scopeCount{ 0 };
+			std::vector<std::string> names;
+		};
+
+		struct History {
+			std::vector<float> samples; // ring of the last HISTORY values
+			u32 next = 0;
+		};
+
+		void readResults(u32 frameIndex);
+		u32 firstQuery(u32 frameIndex, u32 scope) const { return (frameIndex * MAX_SCOPES + scope) * 2; }
+
+		FveDevice& device;
+		u32 frameCount;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		u64 timestampMask = ~0ull;
+		double nanosecondsPerTick = 1.0;
+
+		std::vector<FrameSlot> slots;
+		u32 currentFrame = 0;
+		bool frameOpen = false;
+
+		std::unordered_map<std::string, History> histories;
+		float latestFrameMs = 0.0f;
+		bool latestFrameValid = false;
+	};
+
+}
@@ -0,0 +1,193 @@
+#include "fve_light_clusters.hpp"
+#include "../core/vulkan/fve_memory.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace fve {
+
+	STATIC_ASSERT(sizeof(PointLight) == 32, "PointLight must match the std430 layout in the shaders.");
+
+	FveLightClusters::FveLightClusters(FveDevice& device, u32 frameCount) : device{ device }, frameCount{ frameCount } {
+		createPipeline();
+		createBuffers();
+		createDescriptorSets();
+
+		FVE_CORE_DEBUG("Light clusters: {0}x{1}x{2} grid, {3} lights per cluster, room for {4} lights",
+			GRID_X, GRID_Y, GRID_Z, MAX_LIGHTS_PER_CLUSTER, MAX_LIGHTS);
+	}
+
+	FveLightClusters::~FveLightClusters() {
+		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	}
+
+	float FveLightClusters::lightRange(float intensity) {
+		return std::sqrt(std::max(intensity, 0.0f) / LIGHT_CUTOFF);
+	}
+
+	void FveLightClusters::createPipeline() {
+		setLayout = FveDescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkDescriptorSetLayout layout = setLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &layout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		pipeline = std::make_unique<FveComputePipeline>(device, "shaders/light_cluster.comp.spv", pipelineLayout);
+	}
+
+	void FveLightClusters::createBuffers() {
+		lightBuffers.resize(frameCount);
+		countBuffers.resize(frameCount);
+		indexBuffers.resize(frameCount);
+		statsBuffers.resize(frameCount);
+		builtLights.resize(frameCount, 0);
+		for (u32 i = 0; i < frameCount; i++) {
+			lightBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(PointLight),
+				MAX_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"clusterLightBuffer");
+			lightBuffers[i]->map();
+			countBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(u32),
+				CLUSTER_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				"clusterCountBuffer");
+			indexBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(u32),
+				CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				"clusterIndexBuffer");
+			statsBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(GpuClusterStats),
+				1,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VMA_MEMORY_USAGE_GPU_TO_CPU,
+				"clusterStatsBuffer");
+			statsBuffers[i]->map();
+			std::memset(statsBuffers[i]->getMappedMemory(), 0, sizeof(GpuClusterStats));
+		}
+	}
+
+	void FveLightClusters::createDescriptorSets() {
+		descriptorPool = FveDescriptorPool::Builder(device)
+			.setMaxSets(frameCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 4)
+			.build();
+
+		clusterSets.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++) {
+			auto lightInfo = lightBuffers[i]->descriptorInfo();
+			auto countInfo = countBuffers[i]->descriptorInfo();
+			auto indexInfo = indexBuffers[i]->descriptorInfo();
+			auto statsInfo = statsBuffers[i]->descriptorInfo();
+			FveDescriptorWriter(*setLayout, *descriptorPool)
+				.writeBuffer(0, &lightInfo)
+				.writeBuffer(1, &countInfo)
+				.writeBuffer(2, &indexInfo)
+				.writeBuffer(3, &statsInfo)
+				.build(clusterSets[i]);
+		}
+	}
+
+	PointLight* FveLightClusters::getLights(int frameIndex) {
+		return static_cast<PointLight*>(lightBuffers[frameIndex]->getMappedMemory());
+	}
+
+	void FveLightClusters::updateUbo(GlobalUbo& ubo, VkExtent2D extent, const FveCamera& camera) const {
+		// slice = log(z / near) / log(far / near) * GRID_Z, split into a scale and bias on log(z)
+		const float logDepthRange = std::log(camera.getFar() / camera.getNear());
+		const float sliceScale = static_cast<float>(GRID_Z) / logDepthRange;
+		const float sliceBias = -sliceScale * std::log(camera.getNear());
+
+		ubo.clusterScale = glm::vec4(
+			static_cast<float>(GRID_X) / static_cast<float>(extent.width),
+			static_cast<float>(GRID_Y) / static_cast<float>(extent.height),
+			sliceScale,
+			sliceBias);
+		ubo.clusterGrid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, MAX_LIGHTS_PER_CLUSTER);
+	}
+
+	void FveLightClusters::build(FveCommandRecorder& recorder, int frameIndex, const FveCamera& camera, u32 lightCount) {
+		assert(lightCount <= static_cast<u32>(MAX_LIGHTS) && "Too many point lights for the light buffer");
+
+		// the last frame in this slot has retired, so its counters from the last use are complete
+		auto& statsBuffer = statsBuffers[frameIndex];
+		statsBuffer->invalidate();
+		GpuClusterStats lastStats = *static_cast<GpuClusterStats*>(statsBuffer->getMappedMemory());
+		stats.lights = builtLights[frameIndex];
+		stats.occupiedClusters = lastStats.occupiedClusters;
+		stats.lightReferences = lastStats.lightReferences;
+		stats.maxClusterLights = lastStats.maxClusterLights;
+		stats.overflowedClusters = lastStats.overflowedClusters;
+		builtLights[frameIndex] = lightCount;
+
+		if (lightCount > 0) {
+			lightBuffers[frameIndex]->flush(sizeof(PointLight) * lightCount);
+		}
+
+		vkCmdFillBuffer(recorder, statsBuffer->getAllocatedBuffer().buffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(recorder,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		pipeline->bind(recorder);
+		recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipelineLayout,
+			0,
+			1,
+			&clusterSets[frameIndex]);
+
+		const glm::mat4& projection = camera.getProjection();
+
+		PushConstants push{};
+		push.view = camera.getView();
+		push.projection = glm::vec4(projection[0][0], projection[1][1], camera.getNear(), camera.getFar());
+		push.grid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, MAX_LIGHTS_PER_CLUSTER);
+		push.lightCount = lightCount;
+		recorder.pushConstants(pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push);
+
+		recorder.dispatch((CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+	}
+
+}
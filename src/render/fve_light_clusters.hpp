@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "../core/vulkan/fve_buffer.hpp"
+#include "../core/vulkan/fve_descriptors.hpp"
+#include "../core/vulkan/fve_pipeline.hpp"
+#include "fve_camera.hpp"
+#include "fve_frame_info.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Bins point lights into a grid of view space clusters for clustered forward shading.
+	 *
+	 * The view frustum is cut into screen tiles and exponentially spaced depth slices, so clusters
+	 * stay roughly cube shaped from the near plane out. Every frame a compute pass tests each light's
+	 * sphere against the box of every cluster and writes a short list of the lights touching it, and
+	 * the lit fragment shaders only loop over the list of the cluster they fall into. Lights live in a
+	 * storage buffer, so their count is bounded by MAX_LIGHTS rather than by the UBO size.
+	 *
+	 * Everything the shaders read is per frame slot, the CPU fills the lights of one slot while the
+	 * GPU may still be shading with the other.
+	 */
+	class FveLightClusters {
+	public:
+		// must match local_size_x in light_cluster.comp
+		static constexpr u32 WORKGROUP_SIZE = 64;
+
+		static constexpr u32 GRID_X = 16;
+		static constexpr u32 GRID_Y = 9;
+		static constexpr u32 GRID_Z = 24;
+		static constexpr u32 CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+		// a light's range ends where intensity / distance² drops below this
+		static constexpr float LIGHT_CUTOFF = 0.01f;
+
+		// read back from the binning pass, so they trail the frame by the frames in flight
+		struct Stats {
+			u32 lights = 0;
+			u32 occupiedClusters = 0;
+			u32 lightReferences = 0; // summed length of all cluster lists
+			u32 maxClusterLights = 0; // longest list before it was cut to MAX_LIGHTS_PER_CLUSTER
+			u32 overflowedClusters = 0;
+		};
+
+		FveLightClusters(FveDevice& device, u32 frameCount);
+		~FveLightClusters();
+
+		FveLightClusters(const FveLightClusters&) = delete;
+		FveLightClusters& operator=(const FveLightClusters&) = delete;
+
+		static float lightRange(float intensity);
+
+		// host visible light array of a frame slot, room for MAX_LIGHTS
+		PointLight* getLights(int frameIndex);
+
+		// grid parameters the lit fragment shaders need to find their cluster
+		void updateUbo(GlobalUbo& ubo, VkExtent2D extent, const FveCamera& camera) const;
+
+		// bins the first lightCount lights of the frame slot, must be called outside a render pass.
+		// the lit shaders reading the lists have to be ordered after it by the caller
+		void build(FveCommandRecorder& recorder, int frameIndex, const FveCamera& camera, u32 lightCount);
+
+		// bindings of the global descriptor sets
+		VkDescriptorBufferInfo lightsInfo(int frameIndex) const { return lightBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo countsInfo(int frameIndex) const { return countBuffers[frameIndex]->descriptorInfo(); }
+		VkDescriptorBufferInfo indicesInfo(int frameIndex) const { return indexBuffers[frameIndex]->descriptorInfo(); }
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct PushConstants {
+			glm::mat4 view;
+			glm::vec4 projection; // x P00, y P11, z near, w far
+			glm::uvec4 grid; // w is the list length
+			u32 lightCount;
+		};
+
+		// mirrors the StatsBuffer block in light_cluster.comp
+		struct GpuClusterStats {
+			u32 lightReferences;
+			u32 occupiedClusters;
+			u32 maxClusterLights;
+			u32 overflowedClusters;
+		};
+
+		void createPipeline();
+		void createBuffers();
+		void createDescriptorSets();
+
+		FveDevice& device;
+		// frames in flight, everything per frame is kept this many times
+		u32 frameCount;
+
+		std::unique_ptr<FveDescriptorSetLayout> setLayout;
+		std::unique_ptr<FveDescriptorPool> descriptorPool;
+		VkPipelineLayout pipelineLayout;
+		std::unique_ptr<FveComputePipeline> pipeline;
+
+		std::vector<std::unique_ptr<FveBuffer>> lightBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> countBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> indexBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> statsBuffers;
+		std::vector<VkDescriptorSet> clusterSets;
+
+		// light count each frame slot was last built with, for the stats
+		std::vector<u32> builtLights;
+		Stats stats{};
+	};
+
+}
@@ -0,0 +1,767 @@
+#include "fve_render_graph.hpp"
+#include "../core/fve_initializers.hpp"
+#include "../core/vulkan/fve_memory.hpp"
+#include "../core/utils/fve_logger.hpp"
+#include "../core/utils/fve_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace fve {
+
+	FveRenderGraph::PassBuilder& FveRenderGraph::PassBuilder::read(ResourceId resource, Usage usage) {
+		graph.addAccess(pass, resource, usage, false);
+		return *this;
+	}
+
+	FveRenderGraph::PassBuilder& FveRenderGraph::PassBuilder::write(ResourceId resource, Usage usage) {
+		graph.addAccess(pass, resource, usage, true);
+		return *this;
+	}
+
+	FveRenderGraph::PassBuilder& FveRenderGraph::PassBuilder::sideEffects() {
+		graph.passes[pass].sideEffects = true;
+		return *this;
+	}
+
+	FveRenderGraph::FveRenderGraph(FveDevice& device) : device{ device } {}
+
+	FveRenderGraph::~FveRenderGraph() {
+		destroyTransients();
+	}
+
+	void FveRenderGraph::reset() {
+		resources.clear();
+		passes.clear();
+		schedule.clear();
+		barriers.clear();
+		finalBarrier = {};
+	}
+
+	FveRenderGraph::ResourceId FveRenderGraph::importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, Usage restingUsage) {
+		Resource resource{};
+		resource.name = name;
+		resource.imported = true;
+		resource.image = true;
+		resource.vkImage = image;
+		resource.desc.aspect = aspect;
+		resource.restingUsage = restingUsage;
+		resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	FveRenderGraph::ResourceId FveRenderGraph::importBuffer(const std::string& name, VkBuffer buffer, Usage restingUsage) {
+		Resource resource{};
+		resource.name = name;
+		resource.imported = true;
+		resource.image = false;
+		resource.buffer = buffer;
+		resource.restingUsage = restingUsage;
+		resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	FveRenderGraph::ResourceId FveRenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+		Resource resource{};
+		resource.name = name;
+		resource.imported = false;
+		resource.image = true;
+		resource.desc = desc;
+		resources.push_back(std::move(resource));
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	void FveRenderGraph::markOutput(ResourceId resource) {
+		assert(resource < resources.size() && "Unknown render graph resource");
+		resources[resource].output = true;
+	}
+
+	void FveRenderGraph::addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, ExecuteFn execute) {
+		Pass pass{};
+		pass.name = name;
+		pass.execute = std::move(execute);
+		passes.push_back(std::move(pass));
+
+		PassBuilder builder{ *this, static_cast<u32>(passes.size() - 1) };
+		setup(builder);
+	}
+
+	void FveRenderGraph::addAccess(u32 pass, ResourceId resource, Usage usage, bool write) {
+		if (resource >= resources.size()) {
+			throw std::runtime_error("render graph pass " + passes[pass].name + " uses an unknown resource!");
+		}
+		if (write && usageAccess(usage, true) == 0) {
+			throw std::runtime_error("render graph pass " + passes[pass].name + " writes " + resources[resource].name + " with a read only usage!");
+		}
+
+		// one access per resource and pass keeps the barrier of a pass unambiguous
+		for (Access& access : passes[pass].accesses) {
+			if (access.resource != resource) continue;
+			if (access.usage != usage) {
+				throw std::runtime_error("render graph pass " + passes[pass].name + " uses " + resources[resource].name + " in two ways!");
+			}
+			access.write = access.write || write;
+			return;
+		}
+
+		Resource& target = resources[resource];
+		if (target.image && !target.imported) {
+			target.imageUsage |= usageImageFlags(usage, write);
+		}
+		passes[pass].accesses.push_back({ resource, usage, write });
+	}
+
+	bool FveRenderGraph::compile() {
+		for (Resource& resource : resources) {
+			resource.writers.clear();
+			resource.readers = 0;
+			resource.firstUse = NONE;
+			resource.lastUse = NONE;
+			resource.transient = NONE;
+		}
+		for (u32 i = 0; i < passes.size(); i++) {
+			Pass& pass = passes[i];
+			pass.culled = false;
+			pass.references = 0;
+			pass.barrierIndex = NONE;
+			for (const Access& access : pass.accesses) {
+				if (access.write) {
+					resources[access.resource].writers.push_back(i);
+					pass.references++;
+				}
+				else {
+					resources[access.resource].readers++;
+				}
+			}
+		}
+
+		cullPasses();
+		schedulePasses();
+		placeTransients();
+		planBarriers();
+
+		// anything that changes what dump() prints
+		u64 hash = fnv1a(nullptr, 0);
+		for (const Pass& pass : passes) {
+			hash = fnv1a(pass.name.data(), pass.name.size(), hash);
+			hash = fnv1a(&pass.culled, sizeof(pass.culled), hash);
+		}
+		for (u32 passIndex : schedule) {
+			hash = fnv1a(&passIndex, sizeof(passIndex), hash);
+			const u32 barrierIndex = passes[passIndex].barrierIndex;
+			const size_t imageCount = barrierIndex != NONE ? barriers[barrierIndex].images.size() : 0;
+			hash = fnv1a(&imageCount, sizeof(imageCount), hash);
+		}
+		hash = fnv1a(&transientSignature, sizeof(transientSignature), hash);
+
+		const bool changed = hash != signature;
+		signature = hash;
+		return changed;
+	}
+
+	void FveRenderGraph::cullPasses() {
+		// a resource stays while something reads it after the frame or later in it
+		std::vector<u32> consumers(resources.size());
+		std::vector<ResourceId> unused;
+		for (ResourceId i = 0; i < resources.size(); i++) {
+			consumers[i] = resources[i].readers + (resources[i].output ? 1 : 0);
+			if (consumers[i] == 0) unused.push_back(i);
+		}
+
+		auto cull = [&](Pass& pass) {
+			pass.culled = true;
+			for (const Access& access : pass.accesses) {
+				if (access.write) continue;
+				if (--consumers[access.resource] == 0) {
+					unused.push_back(access.resource);
+				}
+			}
+		};
+
+		for (Pass& pass : passes) {
+			if (pass.references == 0 && !pass.sideEffects) {
+				cull(pass);
+			}
+		}
+
+		while (!unused.empty()) {
+			ResourceId resource = unused.back();
+			unused.pop_back();
+
+			for (u32 writer : resources[resource].writers) {
+				Pass& pass = passes[writer];
+				if (pass.culled || pass.sideEffects) continue;
+				if (--pass.references == 0) {
+					cull(pass);
+				}
+			}
+		}
+	}
+
+	void FveRenderGraph::schedulePasses() {
+		// a pass follows the last write before it of everything it touches, and a write also follows the
+		// reads of the previous contents
+		std::vector<std::vector<u32>> successors(passes.size());
+		std::vector<u32> predecessorCount(passes.size(), 0);
+		std::vector<std::vector<bool>> dependsOn(passes.size(), std::vector<bool>(passes.size(), false));
+
+		std::vector<u32> lastWriter(resources.size(), NONE);
+		std::vector<std::vector<u32>> readersSinceWrite(resources.size());
+
+		auto addEdge = [&](u32 from, u32 to) {
+			if (from == to || dependsOn[to][from]) return;
+			dependsOn[to][from] = true;
+			successors[from].push_back(to);
+			predecessorCount[to]++;
+		};
+
+		for (u32 i = 0; i < passes.size(); i++) {
+			if (passes[i].culled) continue;
+
+			for (const Access& access : passes[i].accesses) {
+				if (lastWriter[access.resource] != NONE) {
+					addEdge(lastWriter[access.resource], i);
+				}
+				if (access.write) {
+					for (u32 reader : readersSinceWrite[access.resource]) {
+						addEdge(reader, i);
+					}
+				}
+			}
+
+			for (const Access& access : passes[i].accesses) {
+				if (access.write) {
+					lastWriter[access.resource] = i;
+					readersSinceWrite[access.resource].clear();
+				}
+				else {
+					readersSinceWrite[access.resource].push_back(i);
+				}
+			}
+		}
+
+		std::vector<u32> ready;
+		for (u32 i = 0; i < passes.size(); i++) {
+			if (!passes[i].culled && predecessorCount[i] == 0) ready.push_back(i);
+		}
+
+		schedule.clear();
+		while (!ready.empty()) {
+			// prefer the first declared pass that doesn't wait on the one just scheduled, so the GPU
+			// has other work to overlap a barrier with
+			size_t pick = 0;
+			u32 previous = schedule.empty() ? NONE : schedule.back();
+			u32 best = NONE;
+			for (size_t i = 0; i < ready.size(); i++) {
+				bool independent = previous == NONE || !dependsOn[ready[i]][previous];
+				if (independent && (best == NONE || ready[i] < best)) {
+					best = ready[i];
+					pick = i;
+				}
+			}
+			if (best == NONE) {
+				pick = std::min_element(ready.begin(), ready.end()) - ready.begin();
+			}
+
+			u32 next = ready[pick];
+			ready.erase(ready.begin() + pick);
+			schedule.push_back(next);
+
+			for (u32 successor : successors[next]) {
+				if (--predecessorCount[successor] == 0) ready.push_back(successor);
+			}
+		}
+
+		for (u32 position = 0; position < schedule.size(); position++) {
+			for (const Access& access : passes[schedule[position]].accesses) {
+				Resource& resource = resources[access.resource];
+				if (resource.firstUse == NONE) resource.firstUse = position;
+				resource.lastUse = position;
+			}
+		}
+	}
+
+	void FveRenderGraph::placeTransients() {
+		std::vector<ResourceId> used;
+		u64 hash = fnv1a(nullptr, 0);
+		for (ResourceId i = 0; i < resources.size(); i++) {
+			const Resource& resource = resources[i];
+			if (resource.imported || resource.firstUse == NONE) continue;
+			used.push_back(i);
+			hash = fnv1a(&resource.desc, sizeof(ImageDesc), hash);
+			hash = fnv1a(&resource.imageUsage, sizeof(resource.imageUsage), hash);
+			hash = fnv1a(&resource.firstUse, sizeof(resource.firstUse), hash);
+			hash = fnv1a(&resource.lastUse, sizeof(resource.lastUse), hash);
+		}
+
+		if (hash != transientSignature || transients.size() != used.size()) {
+			if (!transients.empty()) {
+				// frames in flight may still render with the old placement, it only changes with the graph
+				destroyTransients();
+			}
+
+			for (ResourceId id : used) {
+				const Resource& resource = resources[id];
+
+				TransientImage transient{};
+				transient.desc = resource.desc;
+				transient.usage = resource.imageUsage;
+				transient.firstUse = resource.firstUse;
+				transient.lastUse = resource.lastUse;
+
+				VkImageCreateInfo imageInfo = fve_init::imageCreateInfo(
+					resource.desc.format,
+					resource.imageUsage,
+					{ resource.desc.extent.width, resource.desc.extent.height, 1 });
+				imageInfo.arrayLayers = resource.desc.layers;
+				if (vkCreateImage(device.device(), &imageInfo, nullptr, &transient.image) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create transient image " + resource.name + "!");
+				}
+				vkGetImageMemoryRequirements(device.device(), transient.image, &transient.requirements);
+				transients.push_back(transient);
+			}
+
+			// largest first, each into the first block whose occupants are all dead or not yet born
+			std::vector<u32> order(transients.size());
+			for (u32 i = 0; i < order.size(); i++) order[i] = i;
+			std::sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+				return transients[a].requirements.size > transients[b].requirements.size;
+			});
+
+			for (u32 index : order) {
+				TransientImage& transient = transients[index];
+				for (u32 b = 0; b < blocks.size() && transient.block == NONE; b++) {
+					MemoryBlock& block = blocks[b];
+					if ((block.requirements.memoryTypeBits & transient.requirements.memoryTypeBits) == 0) continue;
+
+					bool overlaps = false;
+					for (u32 occupant : block.occupants) {
+						const TransientImage& other = transients[occupant];
+						if (transient.firstUse <= other.lastUse && other.firstUse <= transient.lastUse) {
+							overlaps = true;
+							break;
+						}
+					}
+					if (overlaps) continue;
+
+					block.requirements.size = std::max(block.requirements.size, transient.requirements.size);
+					block.requirements.alignment = std::max(block.requirements.alignment, transient.requirements.alignment);
+					block.requirements.memoryTypeBits &= transient.requirements.memoryTypeBits;
+					block.occupants.push_back(index);
+					transient.block = b;
+				}
+
+				if (transient.block == NONE) {
+					MemoryBlock block{};
+					block.requirements = transient.requirements;
+					block.occupants.push_back(index);
+					transient.block = static_cast<u32>(blocks.size());
+					blocks.push_back(block);
+				}
+			}
+
+			VmaAllocationCreateInfo allocCreateInfo{};
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+			for (MemoryBlock& block : blocks) {
+				if (vmaAllocateMemory(fveAllocator, &block.requirements, &allocCreateInfo, &block.allocation, nullptr) != VK_SUCCESS) {
+					throw std::runtime_error("failed to allocate transient image memory!");
+				}
+			}
+
+			for (TransientImage& transient : transients) {
+				if (vmaBindImageMemory(fveAllocator, blocks[transient.block].allocation, transient.image) != VK_SUCCESS) {
+					throw std::runtime_error("failed to bind transient image memory!");
+				}
+
+				// a view may only see one of depth and stencil, passes sample depth
+				VkImageAspectFlags viewAspect = (transient.desc.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : transient.desc.aspect;
+				VkImageViewCreateInfo viewInfo = fve_init::imageViewCreateInfo(transient.desc.format, transient.image, viewAspect);
+				viewInfo.viewType = transient.desc.layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.subresourceRange.layerCount = transient.desc.layers;
+				if (vkCreateImageView(device.device(), &viewInfo, nullptr, &transient.view) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create transient image view!");
+				}
+			}
+
+			transientSignature = hash;
+		}
+
+		stats.transientImages = static_cast<u32>(transients.size());
+		stats.transientBytes = 0;
+		stats.allocatedBytes = 0;
+		for (u32 i = 0; i < used.size(); i++) {
+			resources[used[i]].transient = i;
+			stats.transientBytes += transients[i].requirements.size;
+		}
+		for (const MemoryBlock& block : blocks) {
+			stats.allocatedBytes += block.requirements.size;
+		}
+	}
+
+	void FveRenderGraph::planBarriers() {
+		std::vector<ResourceState> states(resources.size());
+		std::vector<bool> touched(resources.size(), false);
+
+		for (ResourceId i = 0; i < resources.size(); i++) {
+			const Resource& resource = resources[i];
+			if (!resource.imported) continue;
+
+			// whatever the resting usage does may still be in flight from the last frame
+			ResourceState& state = states[i];
+			state.layout = resource.image ? usageLayout(resource.restingUsage, false) : VK_IMAGE_LAYOUT_UNDEFINED;
+			state.writeStages = usageStages(resource.restingUsage);
+			state.writeAccess = usageAccess(resource.restingUsage, true);
+			state.readStages = usageStages(resource.restingUsage);
+			state.readAccess = usageAccess(resource.restingUsage, false);
+			touched[i] = true;
+		}
+
+		// running state of each block, a new occupant waits for the previous one
+		std::vector<std::pair<VkPipelineStageFlags, VkAccessFlags>> blockStates(blocks.size());
+		for (u32 b = 0; b < blocks.size(); b++) {
+			blockStates[b] = { blocks[b].lastStages, blocks[b].lastAccess };
+		}
+
+		auto imageBarrier = [&](const Resource& resource, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = resource.imported ? resource.vkImage : transients[resource.transient].image;
+			// layout transitions of a depth-stencil image have to cover both aspects. imported images come
+			// with theirs, a transient's follow from its format
+			VkImageAspectFlags aspect = resource.desc.aspect;
+			if (!resource.imported && (aspect & VK_IMAGE_ASPECT_DEPTH_BIT)) {
+				aspect = FveDevice::depthAspects(resource.desc.format);
+			}
+			barrier.subresourceRange = { aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+			return barrier;
+		};
+
+		stats.imageBarriers = 0;
+
+		for (u32 position = 0; position < schedule.size(); position++) {
+			Pass& pass = passes[schedule[position]];
+			Barrier barrier{};
+
+			for (const Access& access : pass.accesses) {
+				const Resource& resource = resources[access.resource];
+				ResourceState& state = states[access.resource];
+
+				if (!touched[access.resource]) {
+					// contents of a transient don't carry over, only the memory's last use has to finish
+					const auto& blockState = blockStates[transients[resource.transient].block];
+					state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+					state.writeStages = blockState.first;
+					state.writeAccess = blockState.second;
+					touched[access.resource] = true;
+				}
+
+				const VkPipelineStageFlags stages = usageStages(access.usage);
+				const VkAccessFlags accessMask = usageAccess(access.usage, access.write);
+				const VkImageLayout layout = resource.image ? usageLayout(access.usage, access.write) : VK_IMAGE_LAYOUT_UNDEFINED;
+				const bool layoutChange = resource.image && state.layout != layout;
+
+				if (access.write || layoutChange) {
+					// reads of the old contents only need to finish, writes also need to be made available
+					const VkPipelineStageFlags srcStages = state.writeStages | state.readStages;
+					if (layoutChange) {
+						barrier.images.push_back(imageBarrier(resource, state.layout, layout, state.writeAccess, accessMask));
+						barrier.srcStages |= srcStages;
+						barrier.dstStages |= stages;
+					}
+					else if (srcStages != 0) {
+						if (state.writeAccess != 0) {
+							barrier.memory.srcAccessMask |= state.writeAccess;
+							barrier.memory.dstAccessMask |= accessMask;
+						}
+						barrier.srcStages |= srcStages;
+						barrier.dstStages |= stages;
+					}
+
+					if (access.write) {
+						state = { layout, stages, accessMask, 0, 0 };
+					}
+					else {
+						// later readers in other stages chain onto the transition
+						state = { layout, stages, 0, stages, accessMask };
+					}
+				}
+				else {
+					if (state.writeStages != 0 && ((stages & ~state.readStages) != 0 || (accessMask & ~state.readAccess) != 0)) {
+						if (state.writeAccess != 0) {
+							barrier.memory.srcAccessMask |= state.writeAccess;
+							barrier.memory.dstAccessMask |= accessMask;
+						}
+						barrier.srcStages |= state.writeStages;
+						barrier.dstStages |= stages;
+					}
+					state.readStages |= stages;
+					state.readAccess |= accessMask;
+				}
+			}
+
+			if (!barrier.empty()) {
+				if (barrier.srcStages == 0) barrier.srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+				stats.imageBarriers += static_cast<u32>(barrier.images.size());
+				pass.barrierIndex = static_cast<u32>(barriers.size());
+				barriers.push_back(std::move(barrier));
+			}
+
+			for (const Access& access : pass.accesses) {
+				const Resource& resource = resources[access.resource];
+				if (resource.imported) continue;
+				const ResourceState& state = states[access.resource];
+				blockStates[transients[resource.transient].block] = { state.writeStages | state.readStages, state.writeAccess };
+			}
+		}
+
+		// imported resources go back to their resting usage for the next frame
+		finalBarrier = {};
+		for (ResourceId i = 0; i < resources.size(); i++) {
+			const Resource& resource = resources[i];
+			if (!resource.imported || resource.firstUse == NONE) continue;
+
+			const ResourceState& state = states[i];
+			const VkPipelineStageFlags restingStages = usageStages(resource.restingUsage);
+			const VkAccessFlags restingAccess = usageAccess(resource.restingUsage, false) | usageAccess(resource.restingUsage, true);
+			const VkImageLayout restingLayout = resource.image ? usageLayout(resource.restingUsage, false) : VK_IMAGE_LAYOUT_UNDEFINED;
+			const VkPipelineStageFlags pendingStages = state.writeStages | state.readStages;
+
+			// the next frame only waits on the resting stages, which is enough once the last writes happened
+			// there or were already made visible to them
+			const bool writesInRestingStages = (state.writeStages & ~restingStages) == 0 && (state.writeAccess & ~usageAccess(resource.restingUsage, true)) == 0;
+			const bool writesSeenByRestingStages = (restingStages & ~state.readStages) == 0 && (usageAccess(resource.restingUsage, false) & ~state.readAccess) == 0;
+
+			if (resource.image && state.layout != restingLayout) {
+				finalBarrier.images.push_back(imageBarrier(resource, state.layout, restingLayout, state.writeAccess, restingAccess));
+			}
+			else if (writesInRestingStages || writesSeenByRestingStages) {
+				continue;
+			}
+			else if (state.writeAccess != 0) {
+				finalBarrier.memory.srcAccessMask |= state.writeAccess;
+				finalBarrier.memory.dstAccessMask |= restingAccess;
+			}
+			finalBarrier.srcStages |= pendingStages != 0 ? pendingStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			finalBarrier.dstStages |= restingStages;
+		}
+		stats.imageBarriers += static_cast<u32>(finalBarrier.images.size());
+
+		for (u32 b = 0; b < blocks.size(); b++) {
+			blocks[b].lastStages = blockStates[b].first;
+			blocks[b].lastAccess = blockStates[b].second;
+		}
+
+		stats.passes = static_cast<u32>(schedule.size());
+		stats.culledPasses = static_cast<u32>(passes.size() - schedule.size());
+		stats.barriers = static_cast<u32>(barriers.size()) + (finalBarrier.empty() ? 0 : 1);
+	}
+
+	void FveRenderGraph::execute(VkCommandBuffer commandBuffer, FveGpuProfiler* profiler) {
+		auto record = [commandBuffer](const Barrier& barrier) {
+			const bool memory = barrier.memory.srcAccessMask != 0 || barrier.memory.dstAccessMask != 0;
+			vkCmdPipelineBarrier(commandBuffer,
+				barrier.srcStages,
+				barrier.dstStages,
+				0,
+				memory ? 1 : 0, memory ? &barrier.memory : nullptr,
+				0, nullptr,
+				static_cast<u32>(barrier.images.size()), barrier.images.data());
+		};
+
+		for (u32 passIndex : schedule) {
+			const Pass& pass = passes[passIndex];
+			if (pass.barrierIndex != NONE) {
+				record(barriers[pass.barrierIndex]);
+			}
+			FveGpuProfiler::Scope scope{ profiler, commandBuffer, pass.name };
+			pass.execute(commandBuffer);
+		}
+
+		if (!finalBarrier.empty()) {
+			record(finalBarrier);
+		}
+	}
+
+	VkImage FveRenderGraph::getImage(ResourceId resource) const {
+		assert(resource < resources.size() && resources[resource].image && "Not a render graph image");
+		const Resource& target = resources[resource];
+		if (target.imported) return target.vkImage;
+		return target.transient != NONE ? transients[target.transient].image : VK_NULL_HANDLE;
+	}
+
+	VkImageView FveRenderGraph::getImageView(ResourceId resource) const {
+		assert(resource < resources.size() && resources[resource].image && "Not a render graph image");
+		const Resource& target = resources[resource];
+		if (target.imported) return VK_NULL_HANDLE;
+		return target.transient != NONE ? transients[target.transient].view : VK_NULL_HANDLE;
+	}
+
+	u32 FveRenderGraph::getMemoryBlock(ResourceId resource) const {
+		assert(resource < resources.size() && resources[resource].image && !resources[resource].imported && "Not a transient image");
+		const Resource& target = resources[resource];
+		return target.transient != NONE ? transients[target.transient].block : NONE;
+	}
+
+	void FveRenderGraph::dump() const {
+		FVE_CORE_DEBUG("Render graph: {0} passes, {1} culled, {2} barriers, {3} image barriers",
+			stats.passes,
+			stats.culledPasses,
+			stats.barriers,
+			stats.imageBarriers);
+
+		for (u32 position = 0; position < schedule.size(); position++) {
+			const Pass& pass = passes[schedule[position]];
+
+			std::string reads;
+			std::string writes;
+			for (const Access& access : pass.accesses) {
+				std::string& list = access.write ? writes : reads;
+				if (!list.empty()) list += ", ";
+				list += resources[access.resource].name + " (" + usageName(access.usage) + ")";
+			}
+
+			std::string barrier = "no barrier";
+			if (pass.barrierIndex != NONE) {
+				const Barrier& b = barriers[pass.barrierIndex];
+				barrier = "barrier " + std::to_string(b.images.size()) + " images" + (b.memory.srcAccessMask != 0 ? " + memory" : "");
+			}
+
+			FVE_CORE_DEBUG("  {0}: {1}, {2}, reads [{3}], writes [{4}]", position, pass.name, barrier, reads, writes);
+		}
+
+		if (!finalBarrier.empty()) {
+			FVE_CORE_DEBUG("  end: barrier {0} images back to their resting layouts", finalBarrier.images.size());
+		}
+
+		for (const Pass& pass : passes) {
+			if (pass.culled) FVE_CORE_DEBUG("  culled: {0}", pass.name);
+		}
+
+		for (const Resource& resource : resources) {
+			if (resource.imported || resource.transient == NONE) continue;
+			const TransientImage& transient = transients[resource.transient];
+			FVE_CORE_DEBUG("  transient {0}: {1}x{2}, passes {3}-{4}, {5} KiB in block {6}",
+				resource.name,
+				transient.desc.extent.width,
+				transient.desc.extent.height,
+				transient.firstUse,
+				transient.lastUse,
+				transient.requirements.size / 1024,
+				transient.block);
+		}
+
+		FVE_CORE_DEBUG("Transient memory: {0} KiB in {1} allocations, {2} KiB without aliasing, {3} KiB saved",
+			stats.allocatedBytes / 1024,
+			blocks.size(),
+			stats.transientBytes / 1024,
+			(stats.transientBytes - stats.allocatedBytes) / 1024);
+	}
+
+	void FveRenderGraph::destroyTransients() {
+		// released once the frames that may still use them have retired
+		std::vector<VkImageView> views;
+		std::vector<VkImage> images;
+		std::vector<VmaAllocation> allocations;
+		for (TransientImage& transient : transients) {
+			views.push_back(transient.view);
+			images.push_back(transient.image);
+		}
+		for (MemoryBlock& block : blocks) {
+			allocations.push_back(block.allocation);
+		}
+		device.deferDestroy([vkDevice = device.device(), views = std::move(views), images = std::move(images), allocations = std::move(allocations)]() {
+			for (size_t i = 0; i < views.size(); i++) {
+				vkDestroyImageView(vkDevice, views[i], nullptr);
+				vkDestroyImage(vkDevice, images[i], nullptr);
+			}
+			for (VmaAllocation allocation : allocations) {
+				vmaFreeMemory(fveAllocator, allocation);
+			}
+		});
+
+		transients.clear();
+		blocks.clear();
+		transientSignature = 0;
+	}
+
+	VkPipelineStageFlags FveRenderGraph::usageStages(Usage usage) {
+		switch (usage) {
+		case Usage::ColorAttachment: return VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		case Usage::DepthAttachment: return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		case Usage::VertexStorage: return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+		case Usage::FragmentSampled:
+		case Usage::FragmentStorage: return VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		case Usage::ComputeSampled:
+		case Usage::ComputeStorage: return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		case Usage::Indirect: return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		case Usage::Transfer: return VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		return 0;
+	}
+
+	VkAccessFlags FveRenderGraph::usageAccess(Usage usage, bool write) {
+		switch (usage) {
+		case Usage::ColorAttachment:
+			return write ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		case Usage::DepthAttachment:
+			return write ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		case Usage::VertexStorage:
+		case Usage::FragmentStorage:
+		case Usage::ComputeStorage:
+			return write ? VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+		case Usage::FragmentSampled:
+		case Usage::ComputeSampled:
+			return write ? 0 : VK_ACCESS_SHADER_READ_BIT;
+		case Usage::Indirect:
+			return write ? 0 : VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		case Usage::Transfer:
+			return write ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+		}
+		return 0;
+	}
+
+	VkImageLayout FveRenderGraph::usageLayout(Usage usage, bool write) {
+		switch (usage) {
+		case Usage::ColorAttachment: return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		case Usage::DepthAttachment: return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		case Usage::FragmentSampled:
+		case Usage::ComputeSampled: return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		case Usage::Transfer: return write ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		default: return VK_IMAGE_LAYOUT_GENERAL;
+		}
+	}
+
+	VkImageUsageFlags FveRenderGraph::usageImageFlags(Usage usage, bool write) {
+		switch (usage) {
+		case Usage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case Usage::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case Usage::FragmentSampled:
+		case Usage::ComputeSampled: return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case Usage::Transfer: return write ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		default: return VK_IMAGE_USAGE_STORAGE_BIT;
+		}
+	}
+
+	const char* FveRenderGraph::usageName(Usage usage) {
+		switch (usage) {
+		case Usage::ColorAttachment: return "color attachment";
+		case Usage::DepthAttachment: return "depth attachment";
+		case Usage::VertexStorage: return "vertex storage";
+		case Usage::FragmentSampled: return "fragment sampled";
+		case Usage::FragmentStorage: return "fragment storage";
+		case Usage::ComputeSampled: return "compute sampled";
+		case Usage::ComputeStorage: return "compute storage";
+		case Usage::Indirect: return "indirect";
+		case Usage::Transfer: return "transfer";
+		}
+		return "unknown";
+	}
+
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "fve_gpu_profiler.hpp"
+
+#include <vma/vk_mem_alloc.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Graph of the GPU passes of a frame and the resources they hand to each other.
+	 *
+	 * Passes are added in submission order and declare every image and buffer they read or write,
+	 * a read sees the latest write declared before it. compile() drops the passes whose results
+	 * nobody consumes, schedules the rest so that independent work separates a producer from its
+	 * consumer where dependencies allow, and works out one batched barrier in front of each pass from
+	 * the accesses alone. execute() then records the passes in that order.
+	 *
+	 * Imported resources belong to someone else and rest in the state of one usage between frames, the
+	 * graph expects them in it at the start of a frame and hands them back in it. Writing an imported
+	 * resource only keeps a pass alive if the resource is marked as an output or read later on.
+	 *
+	 * Transient images belong to the graph and don't outlive the frame. Their memory is placed once per
+	 * distinct graph, images whose lifetimes don't overlap share an allocation, and is kept for as long
+	 * as the frames ask for the same images.
+	 *
+	 * The graph is meant to be rebuilt every frame with reset(), which keeps the transient memory.
+	 */
+	class FveRenderGraph {
+	public:
+		using ResourceId = u32;
+		using ExecuteFn = std::function<void(VkCommandBuffer)>;
+
+		// how a pass touches a resource, the pipeline stage and image layout follow from it
+		enum class Usage {
+			ColorAttachment,
+			DepthAttachment,
+			VertexStorage,
+			FragmentSampled,
+			FragmentStorage,
+			ComputeSampled,
+			ComputeStorage,
+			Indirect,
+			Transfer
+		};
+
+		struct ImageDesc {
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			VkExtent2D extent{};
+			u32 layers = 1;
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		};
+
+		// of the last compile()
+		struct Stats {
+			u32 passes = 0;
+			u32 culledPasses = 0;
+			u32 barriers = 0; // vkCmdPipelineBarrier calls per execute(), including the final one
+			u32 imageBarriers = 0;
+			u32 transientImages = 0;
+			VkDeviceSize transientBytes = 0; // what the transients would take without aliasing
+			VkDeviceSize allocatedBytes = 0;
+		};
+
+		class PassBuilder {
+		public:
+			PassBuilder& read(ResourceId resource, Usage usage);
+			PassBuilder& write(ResourceId resource, Usage usage);
+			// the pass does something outside the graph, presenting for example, and is never culled
+			PassBuilder& sideEffects();
+
+		private:
+			friend class FveRenderGraph;
+			PassBuilder(FveRenderGraph& graph, u32 pass) : graph{ graph }, pass{ pass } {}
+
+			FveRenderGraph& graph;
+			u32 pass;
+		};
+
+		FveRenderGraph(FveDevice& device);
+		~FveRenderGraph();
+
+		FveRenderGraph(const FveRenderGraph&) = delete;
+		FveRenderGraph& operator=(const FveRenderGraph&) = delete;
+
+		// drops the passes and resources of the last frame, the transient memory stays
+		void reset();
+
+		// aspect is what barriers on the image cover, both depth and stencil for a depth-stencil format
+		ResourceId importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, Usage restingUsage);
+		ResourceId importBuffer(const std::string& name, VkBuffer buffer, Usage restingUsage);
+		ResourceId createImage(const std::string& name, const ImageDesc& desc);
+
+		// the contents are used after the frame, so the passes writing it are kept
+		void markOutput(ResourceId resource);
+
+		// setup declares the accesses, execute records the pass once the graph runs
+		void addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, ExecuteFn execute);
+
+		// returns true when the compiled graph differs from the previous compile, worth a dump()
+		bool compile();
+		// with a profiler every pass is timed under its name
+		void execute(VkCommandBuffer commandBuffer, FveGpuProfiler* profiler = nullptr);
+
+		// transients only have an image and a view after compile(), imported images have no view here
+		VkImage getImage(ResourceId resource) const;
+		VkImageView getImageView(ResourceId resource) const;
+		// index of the allocation compile() placed a transient in, ~0u before that. transients sharing one alias
+		u32 getMemoryBlock(ResourceId resource) const;
+
+		// logs the schedule, culled passes, barriers and transient memory of the last compile()
+		void dump() const;
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		static constexpr u32 NONE = ~0u;
+
+		struct Access {
+			ResourceId resource;
+			Usage usage;
+			bool write;
+		};
+
+		struct Resource {
+			std::string name;
+			bool imported;
+			bool image;
+			bool output = false;
+			VkImage vkImage = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			ImageDesc desc{};
+			Usage restingUsage = Usage::ComputeStorage;
+			VkImageUsageFlags imageUsage = 0;
+
+			// filled by compile()
+			std::vector<u32> writers;
+			u32 readers = 0;
+			u32 firstUse = NONE;
+			u32 lastUse = NONE;
+			u32 transient = NONE;
+		};
+
+		struct Pass {
+			std::string name;
+			std::vector<Access> accesses;
+			ExecuteFn execute;
+			bool sideEffects = false;
+
+			// filled by compile()
+			bool culled = false;
+			u32 references = 0;
+			u32 barrierIndex = NONE;
+		};
+
+		// one vkCmdPipelineBarrier
+		struct Barrier {
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			VkMemoryBarrier memory{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+			std::vector<VkImageMemoryBarrier> images;
+
+			bool empty() const { return dstStages == 0; }
+		};
+
+		// what a resource went through since its last write became visible
+		struct ResourceState {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			VkPipelineStageFlags readStages = 0;
+			VkAccessFlags readAccess = 0;
+		};
+
+		// graph owned image, kept across compiles of the same graph
+		struct TransientImage {
+			ImageDesc desc;
+			VkImageUsageFlags usage;
+			u32 firstUse;
+			u32 lastUse;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkMemoryRequirements requirements{};
+			u32 block = NONE;
+		};
+
+		// one allocation shared by transients that are never alive at the same time
+		struct MemoryBlock {
+			VmaAllocation allocation = VK_NULL_HANDLE;
+			VkMemoryRequirements requirements{};
+			std::vector<u32> occupants;
+			// last accesses of the frame, the first occupant of the next one waits for them
+			VkPipelineStageFlags lastStages = 0;
+			VkAccessFlags lastAccess = 0;
+		};
+
+		void addAccess(u32 pass, ResourceId resource, Usage usage, bool write);
+
+		void cullPasses();
+		void schedulePasses();
+		void placeTransients();
+		void planBarriers();
+		void destroyTransients();
+
+		static VkPipelineStageFlags usageStages(Usage usage);
+		static VkAccessFlags usageAccess(Usage usage, bool write);
+		static VkImageLayout usageLayout(Usage usage, bool write);
+		static VkImageUsageFlags usageImageFlags(Usage usage, bool write);
+		static const char* usageName(Usage usage);
+
+		FveDevice& device;
+
+		std::vector<Resource> resources;
+		std::vector<Pass> passes;
+
+		// compiled state
+		std::vector<u32> schedule;
+		std::vector<Barrier> barriers;
+		Barrier finalBarrier;
+		u64 signature = 0;
+
+		std::vector<TransientImage> transients;
+		std::vector<MemoryBlock> blocks;
+		u64 transientSignature = 0;
+
+		Stats stats{};
+	};
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+
+namespace fve {
+
+	// Compiles and runs a small render graph whose transient images take turns, and checks that the
+	// ones with disjoint lifetimes share their memory. Needs a device, started with --check-render-graph.
+	bool runRenderGraphCheck(FveDevice& device);
+
+}
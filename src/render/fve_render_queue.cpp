@@ -0,0 +1,292 @@
+#include "fve_render_queue.hpp"
+#include "../core/vulkan/fve_memory.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace fve {
+
+	static constexpr u64 PASS_BITS = 2;
+	static constexpr u64 PIPELINE_BITS = 12;
+	static constexpr u64 MATERIAL_BITS = 12;
+	static constexpr u64 MESH_BITS = 16;
+	static constexpr u64 DEPTH_BITS = 22;
+
+	STATIC_ASSERT(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64, "Render queue key must use all 64 bits.");
+
+	static constexpr u64 mask(u64 bits) { return (1ull << bits) - 1; }
+
+	// initial per-frame instance capacity, grown on demand
+	static constexpr u32 INITIAL_INSTANCE_CAPACITY = 1024;
+
+	FveRenderQueue::FveRenderQueue(FveDevice& device, u32 frameCount) : device{ device }, frameCount{ frameCount } {
+		instancePool = FveDescriptorPool::Builder(device)
+			.setMaxSets(frameCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount)
+			.build();
+		instanceSetLayout = FveDescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+			.build();
+
+		instanceBuffers.resize(frameCount);
+		instanceSets.resize(frameCount, VK_NULL_HANDLE);
+		for (u32 i = 0; i < frameCount; i++) {
+			createInstanceBuffer(i, INITIAL_INSTANCE_CAPACITY);
+		}
+	}
+
+	FveRenderQueue::~FveRenderQueue() {
+		FVE_CORE_TRACE("Destroying render queue");
+	}
+
+	void FveRenderQueue::createInstanceBuffer(int frameIndex, u32 capacity) {
+		instanceBuffers[frameIndex] = std::make_unique<FveBuffer>(
+			fveAllocator,
+			device,
+			sizeof(InstanceData),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU,
+			"instanceBuffer");
+		instanceBuffers[frameIndex]->map();
+
+		// the frame's previous submission has completed by the time it is begun again,
+		// so its set can simply be rewritten in place
+		auto bufferInfo = instanceBuffers[frameIndex]->descriptorInfo();
+		FveDescriptorWriter writer{ *instanceSetLayout, *instancePool };
+		writer.writeBuffer(0, &bufferInfo);
+		if (instanceSets[frameIndex] == VK_NULL_HANDLE) {
+			writer.build(instanceSets[frameIndex]);
+		}
+		else {
+			writer.overwrite(instanceSets[frameIndex]);
+		}
+	}
+
+	u64 FveRenderQueue::depthBits(float viewDepth) {
+		// objects behind the camera all land in the nearest bucket
+		if (!(viewDepth > 0.0f)) return 0;
+
+		// positive IEEE floats sort the same way as their bit patterns, so the top bits
+		// give a logarithmic depth bucket without knowing the near/far planes
+		u32 bits;
+		std::memcpy(&bits, &viewDepth, sizeof(bits));
+		return (bits >> (31 - DEPTH_BITS)) & mask(DEPTH_BITS);
+	}
+
+	u64 FveRenderQueue::makeKey(DrawPass pass, const Material& material, const Mesh& mesh, float viewDepth) {
+		const u64 passId = static_cast<u64>(pass) & mask(PASS_BITS);
+		const u64 pipelineId = material.pipelineId & mask(PIPELINE_BITS);
+		const u64 materialId = material.sortId & mask(MATERIAL_BITS);
+		const u64 meshId = mesh.sortId & mask(MESH_BITS);
+		const u64 depth = depthBits(viewDepth);
+
+		if (pass == DrawPass::Transparent) {
+			// invert depth so the farthest object comes first
+			const u64 farToNear = ~depth & mask(DEPTH_BITS);
+			return (passId << 62) | (farToNear << 40) | (pipelineId << 28) | (materialId << 16) | meshId;
+		}
+
+		return (passId << 62) | (pipelineId << 50) | (materialId << 38) | (meshId << 22) | depth;
+	}
+
+	void FveRenderQueue::begin(int frameIndex) {
+		this->frameIndex = frameIndex;
+		packets.clear();
+		sortItems.clear();
+		sorted = false;
+	}
+
+	void FveRenderQueue::submit(Material* material, VkDescriptorSet descriptorSet, Mesh* mesh, const ObjectPushConstants& push, float viewDepth) {
+		assert(material != nullptr && mesh != nullptr && "Cannot submit a draw without a material and a mesh");
+
+		DrawPass pass = material->transparent ? DrawPass::Transparent : DrawPass::Opaque;
+
+		DrawPacket packet{};
+		packet.key = makeKey(pass, *material, *mesh, viewDepth);
+		packet.material = material;
+		packet.descriptorSet = descriptorSet;
+		packet.mesh = mesh;
+		packet.push = push;
+
+		sortItems.push_back({ packet.key, static_cast<u32>(packets.size()) });
+		packets.push_back(packet);
+		sorted = false;
+	}
+
+	void FveRenderQueue::sort() {
+		radixSort(sortItems, sortScratch);
+		sorted = true;
+	}
+
+	void FveRenderQueue::buildBatches() {
+		batches.clear();
+
+		for (u32 i = 0; i < sortItems.size(); i++) {
+			const DrawPacket& packet = packets[sortItems[i].index];
+
+			if (!batches.empty()) {
+				DrawBatch& current = batches.back();
+				const DrawPacket& first = packets[sortItems[current.first].index];
+				if (packet.material == first.material && packet.descriptorSet == first.descriptorSet && packet.mesh == first.mesh) {
+					current.count++;
+					continue;
+				}
+			}
+
+			batches.push_back({ i, 1, 0, false });
+		}
+
+		// reserve every instanced batch its own range up front, so ranges can be recorded in any order
+		instanceCount = 0;
+		for (auto& batch : batches) {
+			const DrawPacket& first = packets[sortItems[batch.first].index];
+			batch.instanced = batch.count >= MIN_INSTANCE_BATCH && first.material->instancedVariant != nullptr;
+			if (batch.instanced) {
+				batch.firstInstance = instanceCount;
+				instanceCount += batch.count;
+			}
+		}
+	}
+
+	void FveRenderQueue::flush(FveCommandRecorder& recorder) {
+		beginFlush();
+		recordBatches(recorder, 0, getBatchCount());
+		endFlush();
+	}
+
+	void FveRenderQueue::beginFlush() {
+		assert(sorted && "Render queue must be sorted before it is flushed");
+
+		buildBatches();
+
+		// make sure this frame's instance buffer can hold every instanced draw
+		if (instanceCount > instanceBuffers[frameIndex]->getInstanceCount()) {
+			u32 capacity = std::max(instanceCount, instanceBuffers[frameIndex]->getInstanceCount() * 2);
+			FVE_CORE_DEBUG("Growing instance buffer {0} to {1} instances", frameIndex, capacity);
+			createInstanceBuffer(frameIndex, capacity);
+		}
+	}
+
+	void FveRenderQueue::recordBatches(FveCommandRecorder& recorder, u32 firstBatch, u32 batchCount) const {
+		assert(firstBatch + batchCount <= batches.size() && "Batch range out of bounds");
+
+		auto instances = static_cast<InstanceData*>(instanceBuffers[frameIndex]->getMappedMemory());
+
+		// track bound state so only changes are recorded
+		VkPipeline lastPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout lastLayout = VK_NULL_HANDLE;
+		VkDescriptorSet lastSet = VK_NULL_HANDLE;
+		bool instanceSetBound = false;
+		Mesh* lastMesh = nullptr;
+
+		for (u32 batchIndex = firstBatch; batchIndex < firstBatch + batchCount; batchIndex++) {
+			const DrawBatch& batch = batches[batchIndex];
+			const DrawPacket& first = packets[sortItems[batch.first].index];
+			const Material& material = batch.instanced ? *first.material->instancedVariant : *first.material;
+
+			if (material.pipeline != lastPipeline) {
+				recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+				lastPipeline = material.pipeline;
+			}
+
+			// a different layout may disturb previously bound sets, so bind again
+			if (material.pipelineLayout != lastLayout) {
+				lastLayout = material.pipelineLayout;
+				lastSet = VK_NULL_HANDLE;
+				instanceSetBound = false;
+			}
+
+			if (first.descriptorSet != lastSet) {
+				recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+					material.pipelineLayout,
+					0,
+					1,
+					&first.descriptorSet);
+				lastSet = first.descriptorSet;
+			}
+
+			if (batch.instanced && !instanceSetBound) {
+				recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+					material.pipelineLayout,
+					1,
+					1,
+					&instanceSets[frameIndex]);
+				instanceSetBound = true;
+			}
+
+			if (first.mesh != lastMesh) {
+				first.mesh->bind(recorder);
+				lastMesh = first.mesh;
+			}
+
+			if (batch.instanced) {
+				for (u32 i = 0; i < batch.count; i++) {
+					instances[batch.firstInstance + i] = packets[sortItems[batch.first + i].index].push;
+				}
+				first.mesh->draw(recorder, batch.count, batch.firstInstance);
+				continue;
+			}
+
+			for (u32 i = 0; i < batch.count; i++) {
+				const DrawPacket& packet = packets[sortItems[batch.first + i].index];
+				recorder.pushConstants(material.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ObjectPushConstants), &packet.push);
+				packet.mesh->draw(recorder);
+			}
+		}
+	}
+
+	void FveRenderQueue::recordDepthBatches(FveCommandRecorder& recorder, u32 firstBatch, u32 batchCount, const DepthPassPipelines& depthPass) const {
+		assert(firstBatch + batchCount <= batches.size() && "Batch range out of bounds");
+
+		// both pipelines share one layout, so the sets stay bound for the whole range
+		VkDescriptorSet sets[] = { depthPass.globalSet, instanceSets[frameIndex] };
+		recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+			depthPass.pipelineLayout,
+			0,
+			2,
+			sets);
+
+		VkPipeline lastPipeline = VK_NULL_HANDLE;
+		Mesh* lastMesh = nullptr;
+
+		for (u32 batchIndex = firstBatch; batchIndex < firstBatch + batchCount; batchIndex++) {
+			const DrawBatch& batch = batches[batchIndex];
+			const DrawPacket& first = packets[sortItems[batch.first].index];
+
+			// blended draws must not hide what is behind them
+			if (first.material->transparent) continue;
+
+			VkPipeline pipeline = batch.instanced ? depthPass.instancedPipeline : depthPass.pipeline;
+			if (pipeline != lastPipeline) {
+				recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				lastPipeline = pipeline;
+			}
+
+			if (first.mesh != lastMesh) {
+				first.mesh->bindPositions(recorder);
+				lastMesh = first.mesh;
+			}
+
+			if (batch.instanced) {
+				first.mesh->draw(recorder, batch.count, batch.firstInstance);
+				continue;
+			}
+
+			for (u32 i = 0; i < batch.count; i++) {
+				const DrawPacket& packet = packets[sortItems[batch.first + i].index];
+				recorder.pushConstants(depthPass.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectPushConstants), &packet.push);
+				packet.mesh->draw(recorder);
+			}
+		}
+	}
+
+	void FveRenderQueue::endFlush() {
+		if (instanceCount > 0) {
+			instanceBuffers[frameIndex]->flush(instanceCount * sizeof(InstanceData), 0);
+		}
+	}
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/utils/fve_sort.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "../core/vulkan/fve_buffer.hpp"
+#include "../core/vulkan/fve_descriptors.hpp"
+#include "../core/vulkan/fve_command_recorder.hpp"
+#include "../assets/fve_model.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace fve {
+
+	// push constant block shared by every pipeline drawn through the queue
+	struct ObjectPushConstants {
+		alignas(16) glm::mat4 modelMatrix{ 1.0f };
+		alignas(16) glm::mat4 normalMatrix{ 1.0f };
+	};
+
+	// one element of the per-frame instance buffer, laid out like the push constants (std430)
+	using InstanceData = ObjectPushConstants;
+
+	enum class DrawPass : u8 {
+		Opaque = 0,
+		Transparent = 1
+	};
+
+	struct DrawPacket {
+		u64 key;
+		Material* material;
+		VkDescriptorSet descriptorSet;
+		Mesh* mesh;
+		ObjectPushConstants push;
+	};
+
+	// what a depth-only replay of the queue draws with, see FveRenderQueue::recordDepthBatches()
+	struct DepthPassPipelines {
+		VkPipeline pipeline; // transforms from push constants
+		VkPipeline instancedPipeline; // transforms from the instance buffer at set 1
+		VkPipelineLayout pipelineLayout; // shared by both, global set, instance set and ObjectPushConstants
+		VkDescriptorSet globalSet;
+	};
+
+	/*
+	 * Collects draw packets from the render systems, sorts them once per frame by a 64-bit key and
+	 * replays them while skipping redundant pipeline, descriptor set and vertex/index buffer binds.
+	 *
+	 * Opaque key:      pass(2) | pipeline(12) | material(12) | mesh(16) | depth(22)
+	 * Transparent key: pass(2) | ~depth(22)   | pipeline(12) | material(12) | mesh(16)
+	 *
+	 * Opaque draws are grouped by state and go front-to-back within a group for early-Z, while
+	 * transparent draws are ordered strictly back-to-front.
+	 *
+	 * Runs of packets sharing a material, descriptor set and mesh are collapsed into one instanced
+	 * draw when the material has an instanced variant. Their transforms are written to a per-frame
+	 * storage buffer bound at set 1, which the variant indexes with gl_InstanceIndex.
+	 *
+	 * flush() records everything into one command buffer. For parallel recording, beginFlush()
+	 * builds the batches and reserves their instance ranges, after which disjoint batch ranges can
+	 * be recorded from several threads with recordBatches() before endFlush().
+	 */
+	class FveRenderQueue {
+	public:
+
+		// smallest run worth switching to the instanced pipeline for
+		static constexpr u32 MIN_INSTANCE_BATCH = 2;
+
+		FveRenderQueue(FveDevice& device, u32 frameCount);
+		~FveRenderQueue();
+
+		FveRenderQueue(const FveRenderQueue&) = delete;
+		FveRenderQueue& operator=(const FveRenderQueue&) = delete;
+
+		static u64 makeKey(DrawPass pass, const Material& material, const Mesh& mesh, float viewDepth);
+
+		VkDescriptorSetLayout getInstanceSetLayout() const { return instanceSetLayout->getDescriptorSetLayout(); }
+
+		void begin(int frameIndex);
+		void submit(Material* material, VkDescriptorSet descriptorSet, Mesh* mesh, const ObjectPushConstants& push, float viewDepth);
+
+		void sort();
+		void flush(FveCommandRecorder& recorder);
+
+		void beginFlush();
+		u32 getBatchCount() const { return static_cast<u32>(batches.size()); }
+		// safe to call concurrently for disjoint ranges, each range binds all the state it needs
+		void recordBatches(FveCommandRecorder& recorder, u32 firstBatch, u32 batchCount) const;
+		// depth of the opaque batches only, drawn from the position streams. instanced batches read the
+		// transforms recordBatches() writes, so the same batches must be recorded for shading this frame
+		void recordDepthBatches(FveCommandRecorder& recorder, u32 firstBatch, u32 batchCount, const DepthPassPipelines& depthPass) const;
+		void endFlush();
+
+		size_t size() const { return packets.size(); }
+
+	private:
+		struct DrawBatch {
+			u32 first;
+			u32 count;
+			u32 firstInstance; // into this frame's instance buffer, when instanced
+			bool instanced;
+		};
+
+		static u64 depthBits(float viewDepth);
+
+		void createInstanceBuffer(int frameIndex, u32 capacity);
+		void buildBatches();
+
+		FveDevice& device;
+		// frames in flight, everything per frame is kept this many times
+		u32 frameCount;
+
+		std::unique_ptr<FveDescriptorPool> instancePool;
+		std::unique_ptr<FveDescriptorSetLayout> instanceSetLayout;
+		std::vector<std::unique_ptr<FveBuffer>> instanceBuffers;
+		std::vector<VkDescriptorSet> instanceSets;
+
+		std::vector<DrawPacket> packets;
+		std::vector<SortItem> sortItems;
+		std::vector<SortItem> sortScratch;
+		std::vector<DrawBatch> batches;
+
+		int frameIndex = 0;
+		u32 instanceCount = 0;
+		bool sorted = false;
+	};
+
+}
@@ -4,68 +4,162 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 
 namespace fve {
 
-	FveRenderer::FveRenderer(FveWindow& window, FveDevice& device) : window { window }, device{ device } {
+	FveRenderer::FveRenderer(FveWindow& window, FveDevice& device, uint32_t recordingThreads, uint32_t framesInFlight, FveSwapChain::LatencyMode latencyMode)
+		: window { window }, device{ device }, commandPools{ device, framesInFlight, recordingThreads }, profiler{ device, framesInFlight }, frameCounters{ device, framesInFlight } {
+		assert(framesInFlight >= 1 && framesInFlight <= FveSwapChain::MAX_FRAMES_IN_FLIGHT && "Frames in flight out of range");
+		swapChainConfig.framesInFlight = framesInFlight;
+		swapChainConfig.latencyMode = latencyMode;
+		swapChainConfig.maxRenderScale = dynamicResolution.getSettings().maxScale;
+
+		FVE_CORE_DEBUG("Renderer: {0} frames in flight, {1} latency mode", framesInFlight, FveSwapChain::latencyModeName(latencyMode));
+
 		recreateSwapChain();
-		createCommandBuffers();
+		pipelineRenderPass = swapChain->createCompatibleRenderPass();
+		commandBuffers.resize(framesInFlight, VK_NULL_HANDLE);
+
+		if (!profiler.isSupported()) {
+			FVE_CORE_WARN("No GPU frame times, dynamic resolution stays at the maximum scale");
+		}
 	}
 
 	FveRenderer::~FveRenderer() {
 		FVE_CORE_TRACE("Destroying renderer");
-		freeCommandBuffers();
+		vkDestroyRenderPass(device.device(), pipelineRenderPass, nullptr);
+	}
+
+	void FveRenderer::setResolutionSettings(const FveDynamicResolution::Settings& settings) {
+		dynamicResolution.setSettings(settings);
+		swapChainConfig.maxRenderScale = settings.maxScale;
 	}
 
-	void FveRenderer::recreateSwapChain() {
+	bool FveRenderer::recreateSwapChain() {
 		auto extent = window.getExtent();
-		while (extent.width == 0 || extent.height == 0) {
-			extent = window.getExtent();
-			glfwWaitEvents();
+		if (swapChain == nullptr) {
+			// nothing to draw with yet, so the first swap chain waits for a usable window
+			while (extent.width == 0 || extent.height == 0) {
+				extent = window.getExtent();
+				glfwWaitEvents();
+			}
+		}
+		else if (extent.width == 0 || extent.height == 0) {
+			// minimised, frames are skipped until the window comes back. the timeout keeps the loop from spinning
+			swapChainOutOfDate = true;
+			glfwWaitEventsTimeout(MINIMISED_WAIT_SECONDS);
+			return false;
 		}
-		vkDeviceWaitIdle(device.device());
+
+		const auto start = std::chrono::steady_clock::now();
+
 		if (swapChain == nullptr) {
-			swapChain = std::make_unique<FveSwapChain>(device, extent);
+			swapChain = std::make_unique<FveSwapChain>(device, extent, swapChainConfig);
 		}
 		else {
+			// frames in flight still use the old images and attachments, it is destroyed once the last
+			// frame submitted with it has retired instead of waiting for the device
 			std::shared_ptr<FveSwapChain> oldSwapChain = std::move(swapChain);
-			swapChain = std::make_unique<FveSwapChain>(device, extent, oldSwapChain);
+			swapChain = std::make_unique<FveSwapChain>(device, extent, oldSwapChain, swapChainConfig);
 
 			if (!oldSwapChain->compareSwapFormats(*swapChain.get())) {
 				throw std::runtime_error("Swap chain image (or depth) format has changed!");
 			}
+
+			device.deferDestroy(frameNumber - 1, [oldSwapChain]() mutable { oldSwapChain.reset(); });
 		}
-		
-		// TODO
+		swapChainOutOfDate = false;
+
+		const float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		recreateStats.recreations++;
+		recreateStats.lastMs = milliseconds;
+		recreateStats.maxMs = std::max(recreateStats.maxMs, milliseconds);
+		FVE_CORE_DEBUG("Swap chain recreated at {0}x{1} in {2:.2f} ms (max {3:.2f} ms), {4} deferred deletions pending",
+			extent.width,
+			extent.height,
+			milliseconds,
+			recreateStats.maxMs,
+			device.getDeletionStats().pending);
+
+		// blits only filter linearly where the format allows it
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(device.physicalDevice(), swapChain->getSwapChainImageFormat(), &formatProperties);
+		upscaleFilter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+		swapChainGeneration++;
+		return true;
+	}
+
+	void FveRenderer::recreateDepthAttachment() {
+		const auto start = std::chrono::steady_clock::now();
+
+		// frames in flight still use the old attachment, it goes once the last of them has retired
+		swapChain->recreateDepthAttachment(swapChainConfig.sampledDepth, frameNumber - 1);
+
+		FVE_CORE_DEBUG("Depth attachment recreated in {0:.2f} ms",
+			std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		swapChainGeneration++;
 	}
 
-	void FveRenderer::createCommandBuffers() {
+	VkCommandBuffer FveRenderer::beginSecondaryCommandBuffer(uint32_t threadIndex) {
+		assert(isFrameStarted && "Can't call beginSecondaryCommandBuffer() while frame is not in progress");
 
-		commandBuffers.resize(FveSwapChain::MAX_FRAMES_IN_FLIGHT);
+		VkCommandBuffer commandBuffer = commandPools.acquire(currentFrameIndex, threadIndex, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
 
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = device.getCommandPool();
-		allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		// the load pass is compatible, so the same buffers work for a resumed pass
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = swapChain->getRenderPass();
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = swapChain->getFramebuffer();
+		// the primary's statistics query stays active while the buffer executes
+		inheritanceInfo.pipelineStatistics = frameCounters.getStatisticFlags();
 
-		if (vkAllocateCommandBuffers(device.device(), &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate command buffers!");
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
 		}
 
+		// dynamic state is not inherited from the primary
+		setViewportAndScissor(commandBuffer);
+
+		return commandBuffer;
 	}
 
-	void FveRenderer::freeCommandBuffers() {
-		vkFreeCommandBuffers(device.device(), device.getCommandPool(), static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-		commandBuffers.clear();
+	void FveRenderer::endSecondaryCommandBuffer(VkCommandBuffer commandBuffer) {
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
 	}
 
 	VkCommandBuffer FveRenderer::beginFrame() {
 		assert(!isFrameStarted && "Can't call beginFrame() while already in progress");
 
-		auto result = swapChain->acquireNextImage(&currentImageIndex);
+		// old swap chains, buffers and images whose frames have retired
+		device.collectDeletions();
+
+		// toggling between sampled and transient depth leaves the swap chain images alone
+		FveSwapChain::Config depthChanged = swapChain->getConfig();
+		depthChanged.sampledDepth = swapChainConfig.sampledDepth;
+		if (!swapChainOutOfDate && swapChainConfig != swapChain->getConfig() && swapChainConfig == depthChanged) {
+			recreateDepthAttachment();
+		}
+
+		// present mode, frames in flight and the scene attachments' size are baked into the swap chain
+		if ((swapChainOutOfDate || swapChainConfig != swapChain->getConfig()) && !recreateSwapChain()) {
+			return nullptr;
+		}
+
+		auto result = swapChain->acquireNextImage(&currentImageIndex, frameNumber);
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			recreateSwapChain();
@@ -79,6 +173,10 @@ namespace fve {
 		// this frame is now in progress
 		isFrameStarted = true;
 
+		// the frame that last used this slot has retired, so everything it recorded can be recycled
+		commandPools.resetFrame(currentFrameIndex);
+		commandBuffers[currentFrameIndex] = commandPools.acquire(currentFrameIndex, 0, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
 		auto commandBuffer = getCurrentCommandBuffer();
 
 		VkCommandBufferBeginInfo beginInfo{};
@@ -88,18 +186,35 @@ namespace fve {
 			throw std::runtime_error("failed to begin recording command buffer!");
 		}
 
+		// the frame that last used this slot has retired, so its timings are read back without waiting
+		profiler.beginFrame(commandBuffer, currentFrameIndex);
+		frameCounters.beginFrame(commandBuffer, currentFrameIndex);
+		float gpuFrameMs;
+		if (profiler.getLatestFrameMs(gpuFrameMs)) {
+			dynamicResolution.update(gpuFrameMs);
+		}
+
+		const VkExtent2D sceneExtent = swapChain->getSceneExtent();
+		renderExtent = FveDynamicResolution::scaleExtent(swapChain->getSwapChainExtent(), dynamicResolution.getScale());
+		renderExtent.width = std::min(renderExtent.width, sceneExtent.width);
+		renderExtent.height = std::min(renderExtent.height, sceneExtent.height);
+
 		return commandBuffer;
 	}
 
 	void FveRenderer::endFrame() {
 		assert(isFrameStarted && "Can't call endFrame() while frame is not in progress");
 
+		assert(upscaled && "The scene must be upscaled to the swap chain image before endFrame()");
+		upscaled = false;
+
 		auto commandBuffer = getCurrentCommandBuffer();
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
 		}
 
-		auto result = swapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+		auto result = swapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex, frameNumber);
+		frameNumber++;
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || window.wasWindowResized()) {
 			window.resetWindowResizedFlag();
@@ -111,37 +226,44 @@ namespace fve {
 
 		// this frame has been completed
 		isFrameStarted = false;
-		currentFrameIndex = (currentFrameIndex + 1) % FveSwapChain::MAX_FRAMES_IN_FLIGHT;
+		currentFrameIndex = (currentFrameIndex + 1) % swapChainConfig.framesInFlight;
 	}
 
-	void FveRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+	void FveRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, bool keepContents, VkSubpassContents contents) {
 		assert(isFrameStarted && "Can't call beginSwapChainRenderPass() while frame is not in progress");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame");
 
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = swapChain->getRenderPass();
-		renderPassInfo.framebuffer = swapChain->getFrameBuffer(currentImageIndex);
+		renderPassInfo.renderPass = keepContents ? swapChain->getLoadRenderPass() : swapChain->getRenderPass();
+		renderPassInfo.framebuffer = swapChain->getFramebuffer();
 
 		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChain->getSwapChainExtent();
+		renderPassInfo.renderArea.extent = renderExtent;
 
 		std::array<VkClearValue, 2> clearValues{};
 		clearValues[0].color = { 0.63f, 0.4f, 0.0f, 1.0f };
 		clearValues[1].depthStencil = { 1.0f, 0 };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+		renderPassInfo.clearValueCount = keepContents ? 0 : static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = keepContents ? nullptr : clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
 
+		// secondary buffers set their own
+		if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+			setViewportAndScissor(commandBuffer);
+		}
+	}
+
+	void FveRenderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(swapChain->getSwapChainExtent().width);
-		viewport.height = static_cast<float>(swapChain->getSwapChainExtent().height);
+		viewport.width = static_cast<float>(renderExtent.width);
+		viewport.height = static_cast<float>(renderExtent.height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, swapChain->getSwapChainExtent() };
+		VkRect2D scissor{ {0, 0}, renderExtent };
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
@@ -153,4 +275,49 @@ namespace fve {
 		vkCmdEndRenderPass(commandBuffer);
 	}
 
+	void FveRenderer::upscaleToSwapChain(VkCommandBuffer commandBuffer) {
+		assert(isFrameStarted && "Can't call upscaleToSwapChain() while frame is not in progress");
+		assert(!upscaled && "The scene was already upscaled this frame");
+
+		// the scene is done, the copy below may still wait for the swap chain image
+		profiler.endFrame(commandBuffer);
+		frameCounters.endFrame(commandBuffer);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = swapChain->getImage(currentImageIndex);
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		// the acquire semaphore is waited on at the transfer stage
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		const VkExtent2D swapChainExtent = swapChain->getSwapChainExtent();
+		VkImageBlit blit{};
+		blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		blit.srcOffsets[1] = { static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1 };
+		blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		blit.dstOffsets[1] = { static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1 };
+
+		const bool sameSize = renderExtent.width == swapChainExtent.width && renderExtent.height == swapChainExtent.height;
+		vkCmdBlitImage(commandBuffer,
+			swapChain->getSceneImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			barrier.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			sameSize ? VK_FILTER_NEAREST : upscaleFilter);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		upscaled = true;
+	}
+
 }
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include "../core/fve_window.hpp"
 #include "../core/vulkan/fve_device.hpp"
 #include "../core/vulkan/fve_swap_chain.hpp"
+#include "../core/vulkan/fve_command_pools.hpp"
+#include "fve_dynamic_resolution.hpp"
+#include "fve_gpu_profiler.hpp"
+#include "fve_frame_counters.hpp"
 
 #include <cassert>
 #include <memory>
@@ -13,11 +17,16 @@ namespace fve {
 	class FveRenderer {
 	public:
 
-		FveRenderer(FveWindow& window, FveDevice& device);
+		// recordingThreads is how many threads may record secondary command buffers at once. framesInFlight
+		// is fixed for the renderer's lifetime, everything kept per frame is sized by getFramesInFlight()
+		FveRenderer(FveWindow& window, FveDevice& device, uint32_t recordingThreads = 1, uint32_t framesInFlight = 2,
+			FveSwapChain::LatencyMode latencyMode = FveSwapChain::LatencyMode::Throughput);
 		~FveRenderer();
 
+		// for building pipelines, compatible with the passes of every swap chain and valid for the renderer's
+		// lifetime, so variants can still be built from it after the swap chain was recreated
 		VkRenderPass getSwapChainRenderPass() const {
-			return swapChain->getRenderPass();
+			return pipelineRenderPass;
 		}
 
 		bool isFrameInProgress() const { return isFrameStarted; }
@@ -27,35 +36,127 @@ namespace fve {
 			return commandBuffers[currentFrameIndex];
 		}
 
+		uint32_t getFramesInFlight() const { return swapChainConfig.framesInFlight; }
+
+		// number of the frame in progress, or of the next one between frames. frame N signals N on the
+		// device's frame timeline, so anything a frame used can be released once it has retired
+		uint64_t getFrameNumber() const { return frameNumber; }
+		bool isFrameRetired(uint64_t frame) const { return device.isFrameRetired(frame); }
+
 		int getFrameIndex() const {
 			assert(isFrameStarted && "Cannot get frame index when a frame is not in progress");
 			return currentFrameIndex;
 
 		}
 
+		// image acquired for the frame in progress, indexes the swap chain images
+		uint32_t getImageIndex() const {
+			assert(isFrameStarted && "Cannot get image index when a frame is not in progress");
+			return currentImageIndex;
+		}
+
+		size_t getImageCount() const { return swapChain->imageCount(); }
+		VkExtent2D getSwapChainExtent() const { return swapChain->getSwapChainExtent(); }
+		// size of the scene attachments, the frame in progress only covers getRenderExtent() of it
+		VkExtent2D getSceneExtent() const { return swapChain->getSceneExtent(); }
+		VkExtent2D getRenderExtent() const { return renderExtent; }
+		VkImage getSceneImage() const { return swapChain->getSceneImage(); }
+		VkImage getDepthImage() const { return swapChain->getDepthImage(); }
+		VkImageView getDepthImageView() const { return swapChain->getDepthImageView(); }
+		VkImageAspectFlags getDepthAspects() const { return swapChain->getDepthAspects(); }
+
+		// whether depth has to be stored and sampled after the main pass, the depth pyramid needs it.
+		// takes effect at the next beginFrame(), which recreates only the depth attachment when it changes
+		void setSampledDepth(bool sampled) { swapChainConfig.sampledDepth = sampled; }
+
+		// takes effect at the next beginFrame() as well
+		void setLatencyMode(FveSwapChain::LatencyMode latencyMode) { swapChainConfig.latencyMode = latencyMode; }
+		FveSwapChain::LatencyMode getLatencyMode() const { return swapChainConfig.latencyMode; }
+		bool hasSampledDepth() const { return swapChain->hasSampledDepth(); }
+
+		// the render scale follows the GPU frame time within the settings' range. a new maximum scale
+		// recreates the swap chain at the next beginFrame()
+		void setResolutionSettings(const FveDynamicResolution::Settings& settings);
+		const FveDynamicResolution::Settings& getResolutionSettings() const { return dynamicResolution.getSettings(); }
+		const FveDynamicResolution::Stats& getResolutionStats() const { return dynamicResolution.getStats(); }
+
+		// bumped whenever the swap chain or its depth attachment is recreated
+		uint32_t getSwapChainGeneration() const { return swapChainGeneration; }
+
+		// CPU time spent recreating the swap chain, the hitch a resize adds to its frame
+		struct RecreateStats {
+			uint32_t recreations = 0;
+			float lastMs = 0.0f;
+			float maxMs = 0.0f;
+		};
+		const RecreateStats& getRecreateStats() const { return recreateStats; }
+
 		VkCommandBuffer beginFrame();
 		void endFrame();
 
-		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		// keepContents resumes a pass ended earlier in the frame instead of clearing it.
+		// with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the pass may only execute secondary buffers
+		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, bool keepContents = false, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		float getAspectRatio() const { return swapChain->extentAspectRatio(); }
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+		// scales the rendered part of the scene image onto the swap chain image, once per frame after the
+		// last scene pass. expects the scene image in TRANSFER_SRC_OPTIMAL and leaves it there
+		void upscaleToSwapChain(VkCommandBuffer commandBuffer);
+
+		// secondary buffer that continues the swap chain render pass, with viewport and scissor already set.
+		// threadIndex selects a command pool, so every thread recording at the same time needs its own
+		VkCommandBuffer beginSecondaryCommandBuffer(uint32_t threadIndex);
+		void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+
+		// scopes recorded into the frame in progress, from any recording thread
+		FveGpuProfiler& getProfiler() { return profiler; }
+		// recorded commands and pipeline statistics of the scene, recorders add to getRecordTotals()
+		FveFrameCounters& getFrameCounters() { return frameCounters; }
+
+		uint32_t getRecordingThreadCount() const { return commandPools.getThreadCount(); }
+		FveCommandPools::Stats getCommandPoolStats() const { return commandPools.getStats(); }
+
 	private:
 		FveWindow& window;
 		FveDevice& device;
 		std::unique_ptr<FveSwapChain> swapChain;
+		VkRenderPass pipelineRenderPass = VK_NULL_HANDLE;
+
+		// set while the window is minimised, the swap chain is recreated once it has a size again
+		bool swapChainOutOfDate = false;
+		static constexpr double MINIMISED_WAIT_SECONDS = 0.1;
+		RecreateStats recreateStats{};
+
+		// primaries come from thread 0's pool, recycled every time the frame comes around
+		FveCommandPools commandPools;
 		std::vector<VkCommandBuffer> commandBuffers;
 
+		// its frame scope covers the scene and drives the dynamic resolution
+		FveGpuProfiler profiler;
+		// its query spans the same commands as the frame scope
+		FveFrameCounters frameCounters;
+		FveDynamicResolution dynamicResolution;
+		VkExtent2D renderExtent{};
+		VkFilter upscaleFilter = VK_FILTER_LINEAR;
+		bool upscaled = false;
+
 		uint32_t currentImageIndex;
+		uint32_t swapChainGeneration = 0;
+		// what the swap chain is recreated with once it differs from the current one
+		FveSwapChain::Config swapChainConfig{};
 		int currentFrameIndex = 0;
+		uint64_t frameNumber = 1;
 		bool isFrameStarted = false;
 
 		FveRenderer(const FveRenderer&) = delete;
 		FveRenderer& operator=(const FveRenderer&) = delete;
 
-		void createCommandBuffers();
-		void freeCommandBuffers();
-		void recreateSwapChain();
+		void setViewportAndScissor(VkCommandBuffer commandBuffer);
+		// false while the window is minimised, the old swap chain stays in use then
+		bool recreateSwapChain();
+		// for a change of depth usage alone, the swap chain images stay
+		void recreateDepthAttachment();
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include "fve_shadow_maps.hpp"
+#include "../core/fve_initializers.hpp"
+#include "../core/vulkan/fve_memory.hpp"
+#include "../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace fve {
+
+	FveShadowMaps::FveShadowMaps(FveDevice& device, FvePipelineQueue& pipelineQueue) : device{ device } {
+		depthFormat = device.findSupportedFormat(
+			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM },
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+
+		createImage();
+		createRenderPass();
+		createFramebuffers();
+		createPipelineLayout();
+		queuePipeline(pipelineQueue);
+
+		// compares against the stored depth and filters the results, outside the map counts as lit
+		VkSamplerCreateInfo samplerInfo = fve_init::samplerCreateInfo(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER);
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		samplerInfo.compareEnable = VK_TRUE;
+		samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+		if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create shadow map sampler!");
+		}
+
+		FVE_CORE_DEBUG("Shadow maps: {0} cascades of {1}x{1}, {2} of them cached", CASCADE_COUNT, RESOLUTION, CASCADE_COUNT - FIRST_CACHED_CASCADE);
+	}
+
+	FveShadowMaps::~FveShadowMaps() {
+		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+		vkDestroySampler(device.device(), sampler, nullptr);
+		for (u32 i = 0; i < CASCADE_COUNT; i++) {
+			vkDestroyFramebuffer(device.device(), framebuffers[i], nullptr);
+			vkDestroyImageView(device.device(), layerViews[i], nullptr);
+		}
+		vkDestroyImageView(device.device(), arrayView, nullptr);
+		vkDestroyRenderPass(device.device(), renderPass, nullptr);
+		vmaDestroyImage(fveAllocator, image, allocation);
+	}
+
+	void FveShadowMaps::createImage() {
+		VkImageCreateInfo imageInfo = fve_init::imageCreateInfo(
+			depthFormat,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			{ RESOLUTION, RESOLUTION, 1 });
+		imageInfo.arrayLayers = CASCADE_COUNT;
+
+		VmaAllocationCreateInfo allocCreateInfo{};
+		allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		VmaAllocationInfo allocInfo{};
+		device.createImageWithInfo(imageInfo, allocCreateInfo, allocation, allocInfo, image);
+
+		VkImageViewCreateInfo viewInfo = fve_init::imageViewCreateInfo(depthFormat, image, VK_IMAGE_ASPECT_DEPTH_BIT);
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.subresourceRange.layerCount = CASCADE_COUNT;
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &arrayView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create shadow map image view!");
+		}
+
+		// every cascade is rendered through a view of its own layer
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.subresourceRange.layerCount = 1;
+		for (u32 i = 0; i < CASCADE_COUNT; i++) {
+			viewInfo.subresourceRange.baseArrayLayer = i;
+			if (vkCreateImageView(device.device(), &viewInfo, nullptr, &layerViews[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create shadow map image view!");
+			}
+		}
+
+		// between frames the cascades rest where the lit shaders read them
+		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, CASCADE_COUNT };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		device.endSingleTimeCommands(commandBuffer);
+	}
+
+	void FveShadowMaps::createRenderPass() {
+		// a redrawn cascade is cleared anyway, so its old contents are never loaded. the render graph
+		// moves the whole array in and out of the attachment layout around the pass
+		VkAttachmentDescription depthAttachment{};
+		depthAttachment.format = depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 0;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 0;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &depthAttachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+
+		if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create shadow render pass!");
+		}
+	}
+
+	void FveShadowMaps::createFramebuffers() {
+		for (u32 i = 0; i < CASCADE_COUNT; i++) {
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = renderPass;
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &layerViews[i];
+			framebufferInfo.width = RESOLUTION;
+			framebufferInfo.height = RESOLUTION;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create shadow framebuffer!");
+			}
+		}
+	}
+
+	void FveShadowMaps::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 0;
+		pipelineLayoutInfo.pSetLayouts = nullptr;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	void FveShadowMaps::queuePipeline(FvePipelineQueue& pipelineQueue) {
+
+		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		// vertex-only from the position stream, the render pass has no color attachment
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		pipelineConfig->bindingDescriptions = Vertex::getPositionBindingDescriptions();
+		pipelineConfig->attributeDescriptions = Vertex::getPositionAttributeDescriptions();
+		pipelineConfig->colorBlendInfo.attachmentCount = 0;
+		// pushes the stored depth away from the sun, more so on surfaces the sun grazes, against acne
+		pipelineConfig->rasterizationInfo.depthBiasEnable = VK_TRUE;
+		pipelineConfig->rasterizationInfo.depthBiasConstantFactor = 1.25f;
+		pipelineConfig->rasterizationInfo.depthBiasSlopeFactor = 1.75f;
+		pipelineConfig->renderPass = renderPass;
+		pipelineConfig->pipelineLayout = pipelineLayout;
+
+		pipelineHandle = pipelineQueue.add(
+			"shaders/shadow.vert.spv",
+			"",
+			std::move(pipelineConfig),
+			"shadowmaterial");
+	}
+
+	void FveShadowMaps::waitForPipelines(FvePipelineQueue& pipelineQueue) {
+		pipeline = pipelineQueue.wait(pipelineHandle);
+	}
+
+	VkDescriptorImageInfo FveShadowMaps::descriptorInfo() const {
+		VkDescriptorImageInfo info{};
+		info.sampler = sampler;
+		info.imageView = arrayView;
+		info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		return info;
+	}
+
+	void FveShadowMaps::fitCascade(Cascade& cascade, const glm::vec3& center, float radius, const glm::vec3& sunDirection) {
+		// rounded up so the projection keeps its exact size from frame to frame
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// the sun starts out straight above, where the default up vector would be degenerate
+		glm::vec3 up = std::abs(sunDirection.y) > 0.99f ? glm::vec3{ 0.0f, 0.0f, 1.0f } : glm::vec3{ 0.0f, -1.0f, 0.0f };
+
+		FveCamera lightCamera{};
+		lightCamera.setViewDirection(center + sunDirection * (radius + CASTER_DISTANCE), -sunDirection, up);
+		lightCamera.setOrthographicProjection(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + CASTER_DISTANCE);
+
+		glm::mat4 projection = lightCamera.getProjection();
+		glm::mat4 viewProjection = projection * lightCamera.getView();
+
+		// move the projection by less than a texel so the world origin lands on a texel corner
+		const float texelsPerUnit = static_cast<float>(RESOLUTION) * 0.5f;
+		glm::vec2 origin = glm::vec2(viewProjection * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) * texelsPerUnit;
+		glm::vec2 offset = (glm::round(origin) - origin) / texelsPerUnit;
+		projection[3][0] += offset.x;
+		projection[3][1] += offset.y;
+
+		cascade.viewProjection = projection * lightCamera.getView();
+		cascade.center = center;
+		cascade.radius = radius;
+		cascade.sunDirection = sunDirection;
+		cascade.dirty = true;
+	}
+
+	void FveShadowMaps::update(GlobalUbo& ubo, const FveCamera& camera, const FveBvh& sceneBvh) {
+		// the sun is a position the lit shaders light towards, far enough away to treat as a direction
+		const glm::vec3 sunDirection = glm::normalize(glm::vec3(ubo.sun.lightDirection));
+
+		if (sceneBvh.getStaticGeneration() != staticGeneration) {
+			staticGeneration = sceneBvh.getStaticGeneration();
+			cacheValid = false;
+		}
+
+		const float nearPlane = camera.getNear();
+		const float farPlane = std::min(camera.getFar(), SHADOW_DISTANCE);
+		const glm::mat4& projection = camera.getProjection();
+		const glm::mat4& inverseView = camera.getInverseView();
+
+		const float cosThreshold = std::cos(SUN_ANGLE_THRESHOLD);
+		bool sunRefreshDone = false;
+
+		float splitNear = nearPlane;
+		for (u32 i = 0; i < CASCADE_COUNT; i++) {
+			// practical split scheme, between logarithmic and uniform spacing
+			float fraction = static_cast<float>(i + 1) / static_cast<float>(CASCADE_COUNT);
+			float logSplit = nearPlane * std::pow(farPlane / nearPlane, fraction);
+			float uniformSplit = nearPlane + (farPlane - nearPlane) * fraction;
+			float splitFar = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+
+			// bounding sphere of the slice's eight corners, view space +z is forward
+			glm::vec3 corners[8];
+			for (u32 c = 0; c < 8; c++) {
+				float depth = (c & 4) ? splitFar : splitNear;
+				float x = ((c & 1) ? 1.0f : -1.0f) * depth / projection[0][0];
+				float y = ((c & 2) ? 1.0f : -1.0f) * depth / projection[1][1];
+				corners[c] = glm::vec3(inverseView * glm::vec4(x, y, depth, 1.0f));
+			}
+
+			glm::vec3 center{ 0.0f };
+			for (const auto& corner : corners) {
+				center += corner;
+			}
+			center /= 8.0f;
+
+			float radius = 0.0f;
+			for (const auto& corner : corners) {
+				radius = std::max(radius, glm::length(corner - center));
+			}
+
+			Cascade& cascade = cascades[i];
+			if (i < FIRST_CACHED_CASCADE) {
+				fitCascade(cascade, center, radius, sunDirection);
+			}
+			else if (!cacheValid || glm::length(center - cascade.center) + radius > cascade.radius) {
+				// the camera left the cached area, this cannot wait
+				fitCascade(cascade, center, radius * CACHE_PADDING, sunDirection);
+			}
+			else if (!sunRefreshDone && glm::dot(sunDirection, cascade.sunDirection) < cosThreshold) {
+				fitCascade(cascade, center, radius * CACHE_PADDING, sunDirection);
+				sunRefreshDone = true;
+			}
+
+			ubo.shadowMatrices[i] = cascade.viewProjection;
+			ubo.cascadeSplits[i] = splitFar;
+
+			splitNear = splitFar;
+		}
+
+		cacheValid = true;
+		stats.frames++;
+	}
+
+	bool FveShadowMaps::needsRender() const {
+		return std::any_of(cascades.begin(), cascades.end(), [](const Cascade& cascade) { return cascade.dirty; });
+	}
+
+	void FveShadowMaps::render(FveCommandRecorder& recorder, FveGameObject::Map& gameObjects, const FveBvh& sceneBvh) {
+		VkClearValue clearValue{};
+		clearValue.depthStencil = { 1.0f, 0 };
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(RESOLUTION);
+		viewport.height = static_cast<float>(RESOLUTION);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{ { 0, 0 }, { RESOLUTION, RESOLUTION } };
+
+		for (u32 i = 0; i < CASCADE_COUNT; i++) {
+			Cascade& cascade = cascades[i];
+			if (!cascade.dirty) continue;
+
+			const bool cached = i >= FIRST_CACHED_CASCADE;
+
+			VkRenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = renderPass;
+			renderPassInfo.framebuffer = framebuffers[i];
+			renderPassInfo.renderArea = scissor;
+			renderPassInfo.clearValueCount = 1;
+			renderPassInfo.pClearValues = &clearValue;
+
+			vkCmdBeginRenderPass(recorder, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdSetViewport(recorder, 0, 1, &viewport);
+			vkCmdSetScissor(recorder, 0, 1, &scissor);
+			pipeline->bind(recorder);
+
+			// the projection's near plane sits CASTER_DISTANCE towards the sun, so this also finds
+			// casters outside the cascade that throw shadows into it
+			casters.clear();
+			sceneBvh.queryFrustum(Frustum::fromMatrix(cascade.viewProjection), casters);
+
+			PushConstants push{};
+			push.lightViewProjection = cascade.viewProjection;
+
+			Mesh* lastMesh = nullptr;
+			for (auto id : casters) {
+				auto& obj = gameObjects.at(id);
+				if (obj.model == nullptr) continue;
+				// cached cascades outlive the frame, anything that moves would leave its shadow behind
+				if (cached && !obj.isStatic) continue;
+				if (obj.model->getMaterial().transparent) continue;
+
+				Mesh* mesh = &obj.model->getMesh();
+				if (mesh != lastMesh) {
+					mesh->bindPositions(recorder);
+					lastMesh = mesh;
+				}
+
+				push.modelMatrix = obj.transform.mat4();
+				recorder.pushConstants(pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &push);
+				mesh->draw(recorder);
+				stats.casters++;
+			}
+
+			vkCmdEndRenderPass(recorder);
+
+			cascade.dirty = false;
+			stats.cascadesDrawn++;
+			if (cached) stats.cachedCascadesDrawn++;
+		}
+	}
+
+}
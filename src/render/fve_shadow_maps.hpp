@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../core/fve_defines.hpp"
+#include "../core/vulkan/fve_device.hpp"
+#include "../core/vulkan/fve_pipeline.hpp"
+#include "../core/vulkan/fve_pipeline_queue.hpp"
+#include "../fve_game_object.hpp"
+#include "../fve_constants.hpp"
+#include "fve_bvh.hpp"
+#include "fve_camera.hpp"
+#include "fve_frame_info.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace fve {
+
+	/*
+	 * Cascaded shadow maps for the sun.
+	 *
+	 * The view up to SHADOW_DISTANCE is split into SHADOW_CASCADE_COUNT slices, each covered by an
+	 * orthographic projection along the sun direction that bounds the slice with a sphere, so its size
+	 * does not change as the camera turns, and that is snapped to whole texels so edges don't shimmer
+	 * as the camera moves. Every cascade is a layer of one depth array image, drawn in a depth-only
+	 * render pass of its own and sampled by the lit fragment shaders with hardware PCF.
+	 *
+	 * The near cascades are redrawn every frame with every caster. The distant ones only hold static
+	 * casters and are cached: they cover CACHE_PADDING times the area they need and are redrawn only
+	 * when the camera leaves that area, the sun has turned further than SUN_ANGLE_THRESHOLD since they
+	 * were drawn, or the static scene changed. Sun movement refreshes at most one of them per frame.
+	 *
+	 * The image is shared by all frames in flight and rests in SHADER_READ_ONLY_OPTIMAL between them.
+	 * The render graph orders a redraw after the previous frame's shading has read the layer and this
+	 * frame's shading after the redraw.
+	 */
+	class FveShadowMaps {
+	public:
+		static constexpr u32 CASCADE_COUNT = SHADOW_CASCADE_COUNT;
+		// cascades from this one on are cached and only hold static casters
+		static constexpr u32 FIRST_CACHED_CASCADE = 2;
+		static constexpr u32 RESOLUTION = 2048;
+
+		// view depth the last cascade ends at
+		static constexpr float SHADOW_DISTANCE = 60.0f;
+		// blend between logarithmic (1) and uniform (0) split distances
+		static constexpr float SPLIT_LAMBDA = 0.75f;
+		// how far towards the sun casters outside a cascade's bounds are still caught
+		static constexpr float CASTER_DISTANCE = 50.0f;
+		static constexpr float CACHE_PADDING = 1.5f;
+		// about two degrees
+		static constexpr float SUN_ANGLE_THRESHOLD = 0.035f;
+
+		// accumulated until resetStats()
+		struct Stats {
+			u32 frames = 0;
+			u32 cascadesDrawn = 0;
+			u32 cachedCascadesDrawn = 0;
+			u32 casters = 0;
+		};
+
+		// the pipeline is only queued here, waitForPipelines() must be called before the first frame
+		FveShadowMaps(FveDevice& device, FvePipelineQueue& pipelineQueue);
+		~FveShadowMaps();
+
+		FveShadowMaps(const FveShadowMaps&) = delete;
+		FveShadowMaps& operator=(const FveShadowMaps&) = delete;
+
+		void waitForPipelines(FvePipelineQueue& pipelineQueue);
+
+		// fits the cascades to the camera and the sun, decides which of them have to be redrawn and
+		// writes their matrices and split depths
+		void update(GlobalUbo& ubo, const FveCamera& camera, const FveBvh& sceneBvh);
+
+		// true when update() marked any cascade for drawing
+		bool needsRender() const;
+
+		// draws the cascades update() marked, must be called outside a render pass. the image is
+		// expected in, and left in, DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		void render(FveCommandRecorder& recorder, FveGameObject::Map& gameObjects, const FveBvh& sceneBvh);
+
+		// forces the cached cascades to be redrawn with the next update()
+		void invalidateCache() { cacheValid = false; }
+
+		// the whole cascade array, for the lit shaders
+		VkDescriptorImageInfo descriptorInfo() const;
+		VkImage getImage() const { return image; }
+
+		const Stats& getStats() const { return stats; }
+		void resetStats() { stats = {}; }
+
+	private:
+		struct Cascade {
+			glm::mat4 viewProjection{ 1.0f };
+			// bounds and sun direction the projection was fitted to
+			glm::vec3 center{ 0.0f };
+			float radius = 0.0f;
+			glm::vec3 sunDirection{ 0.0f };
+			bool dirty = true;
+		};
+
+		struct PushConstants {
+			glm::mat4 lightViewProjection;
+			glm::mat4 modelMatrix;
+		};
+
+		void createImage();
+		void createRenderPass();
+		void createFramebuffers();
+		void createPipelineLayout();
+		void queuePipeline(FvePipelineQueue& pipelineQueue);
+
+		void fitCascade(Cascade& cascade, const glm::vec3& center, float radius, const glm::vec3& sunDirection);
+
+		FveDevice& device;
+
+		VkFormat depthFormat;
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkImageView arrayView = VK_NULL_HANDLE;
+		std::array<VkImageView, CASCADE_COUNT> layerViews{};
+		std::array<VkFramebuffer, CASCADE_COUNT> framebuffers{};
+		VkSampler sampler;
+		VkRenderPass renderPass;
+
+		std::unique_ptr<FvePipeline> pipeline;
+		VkPipelineLayout pipelineLayout;
+		FvePipelineQueue::Handle pipelineHandle;
+
+		std::array<Cascade, CASCADE_COUNT> cascades{};
+		bool cacheValid = false;
+		u32 staticGeneration = 0;
+
+		std::vector<FveBvh::id_t> casters;
+		Stats stats{};
+	};
+
+}
@@ -0,0 +1,90 @@
+#include "depth_prepass_system.hpp"
+
+#include <stdexcept>
+#include <cassert>
+#include <vector>
+
+namespace fve {
+
+	DepthPrepassSystem::DepthPrepassSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout, FvePipelineQueue& pipelineQueue) : device{ device } {
+		createPipelineLayout(globalSetLayout, instanceSetLayout);
+		queuePipelines(renderPass, pipelineQueue);
+	}
+
+	DepthPrepassSystem::~DepthPrepassSystem() {
+		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	}
+
+	void DepthPrepassSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout) {
+		// one layout for both pipelines, the render queue and the indirect path switch between them freely
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout, instanceSetLayout };
+
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(ObjectPushConstants);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	void DepthPrepassSystem::queuePipelines(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue) {
+
+		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+		// vertex-only, fed from the position stream and writing no color
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		pipelineConfig->bindingDescriptions = Vertex::getPositionBindingDescriptions();
+		pipelineConfig->attributeDescriptions = Vertex::getPositionAttributeDescriptions();
+		pipelineConfig->colorBlendAttachment.colorWriteMask = 0;
+		pipelineConfig->renderPass = renderPass;
+		pipelineConfig->pipelineLayout = pipelineLayout;
+
+		auto instancedConfig = std::make_unique<PipelineConfigInfo>(*pipelineConfig);
+
+		pipelineHandle = pipelineQueue.add(
+			"shaders/depth_prepass.vert.spv",
+			"",
+			std::move(pipelineConfig),
+			"depthprepass");
+		instancedPipelineHandle = pipelineQueue.add(
+			"shaders/depth_prepass_instanced.vert.spv",
+			"",
+			std::move(instancedConfig),
+			"depthprepass_instanced");
+	}
+
+	void DepthPrepassSystem::waitForPipelines(FvePipelineQueue& pipelineQueue) {
+		pipeline = pipelineQueue.wait(pipelineHandle);
+		instancedPipeline = pipelineQueue.wait(instancedPipelineHandle);
+	}
+
+	void DepthPrepassSystem::render(FrameInfo& frameInfo, IndirectRenderSystem& indirectRenderSystem, u32 firstBatch, u32 batchCount) {
+		FveGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "depth prepass" };
+
+		// the indirect commands find their transforms through firstInstance, like instanced batches
+		indirectRenderSystem.renderDepth(frameInfo, instancedPipeline->getBasePipeline(), pipelineLayout);
+
+		DepthPassPipelines depthPass{
+			pipeline->getBasePipeline(),
+			instancedPipeline->getBasePipeline(),
+			pipelineLayout,
+			frameInfo.globalDescriptorSet
+		};
+		FveCommandRecorder recorder{ frameInfo.commandBuffer, frameInfo.recordTotals };
+		frameInfo.renderQueue.recordDepthBatches(recorder, firstBatch, batchCount, depthPass);
+	}
+
+	void DepthPrepassSystem::renderDisoccluded(FrameInfo& frameInfo, IndirectRenderSystem& indirectRenderSystem) {
+		indirectRenderSystem.renderDisoccludedDepth(frameInfo, instancedPipeline->getBasePipeline(), pipelineLayout);
+	}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../../core/vulkan/fve_device.hpp"
+#include "../../core/vulkan/fve_pipeline.hpp"
+#include "../../core/vulkan/fve_pipeline_queue.hpp"
+#include "../fve_frame_info.hpp"
+#include "indirect_render_system.hpp"
+
+#include <memory>
+
+namespace fve {
+
+	/*
+	 * Lays down the depth of every opaque object before it is shaded.
+	 *
+	 * The pre-pass replays the frame's opaque draws with vertex-only pipelines that read just the
+	 * meshes' position streams, 12 bytes per vertex instead of the full interleaved Vertex. The
+	 * shading pass then runs with the depthEqual shader variant, so the fragment shaders only run
+	 * once per pixel no matter how much overdraw the scene has. It pays off where fragments are
+	 * expensive, with many lights per cluster or at high resolutions, and costs a second geometry
+	 * pass everywhere else, which is why it is optional.
+	 *
+	 * Both passes use the same subpass, the pre-pass is simply recorded first.
+	 */
+	class DepthPrepassSystem {
+	public:
+
+		// pipelines are only queued here, waitForPipelines() must be called before the first frame
+		DepthPrepassSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout, FvePipelineQueue& pipelineQueue);
+		~DepthPrepassSystem();
+
+		void waitForPipelines(FvePipelineQueue& pipelineQueue);
+
+		// depth of the GPU-driven draws and of the render queue's batches in [firstBatch, firstBatch + batchCount)
+		void render(FrameInfo& frameInfo, IndirectRenderSystem& indirectRenderSystem, u32 firstBatch, u32 batchCount);
+
+		// depth of the draws the second occlusion culling phase generated
+		void renderDisoccluded(FrameInfo& frameInfo, IndirectRenderSystem& indirectRenderSystem);
+
+	private:
+		FveDevice& device;
+
+		std::unique_ptr<FvePipeline> pipeline;
+		std::unique_ptr<FvePipeline> instancedPipeline;
+		VkPipelineLayout pipelineLayout;
+		FvePipelineQueue::Handle pipelineHandle;
+		FvePipelineQueue::Handle instancedPipelineHandle;
+
+		DepthPrepassSystem(const DepthPrepassSystem&) = delete;
+		DepthPrepassSystem& operator=(const DepthPrepassSystem&) = delete;
+
+		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout);
+		void queuePipelines(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue);
+	};
+
+}
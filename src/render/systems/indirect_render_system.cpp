@@ -0,0 +1,625 @@
+#include "indirect_render_system.hpp"
+#include "../../core/vulkan/fve_memory.hpp"
+#include "../../core/utils/fve_logger.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace fve {
+
+	// initial per-frame upload capacity in bytes, grown on demand
+	static constexpr u32 INITIAL_UPLOAD_CAPACITY = 64 * 1024;
+
+	IndirectRenderSystem::IndirectRenderSystem(FveDevice& device, u32 frameCount, VkDescriptorSetLayout instanceSetLayout, FveDepthPyramid& depthPyramid)
+		: device{ device }, frameCount{ frameCount }, instanceSetLayout{ instanceSetLayout }, depthPyramid{ depthPyramid } {
+		useDrawCount = device.supportsDrawIndirectCount();
+
+		createDescriptorLayouts();
+		createPipelineLayout();
+		pipeline = std::make_unique<FveComputePipeline>(device, "shaders/indirect_draw.comp.spv", pipelineLayout);
+
+		uploadBuffers.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++) {
+			uploadBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				1,
+				INITIAL_UPLOAD_CAPACITY,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"indirectUploadBuffer");
+			uploadBuffers[i]->map();
+		}
+
+		FVE_CORE_DEBUG("Indirect draws use {0}", useDrawCount ? "vkCmdDrawIndexedIndirectCount" : "fixed-count vkCmdDrawIndexedIndirect");
+	}
+
+	IndirectRenderSystem::~IndirectRenderSystem() {
+		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	}
+
+	void IndirectRenderSystem::createDescriptorLayouts() {
+		// one set per frame for the compute pass plus the shared transform set
+		descriptorPool = FveDescriptorPool::Builder(device)
+			.setMaxSets(frameCount + 1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount * 7 + 1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount)
+			.build();
+		cullSetLayout = FveDescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(6, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.addBinding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+			.build();
+	}
+
+	void IndirectRenderSystem::createPipelineLayout() {
+		VkPushConstantRange pushConstantRange;
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+
+		VkDescriptorSetLayout setLayout = cullSetLayout->getDescriptorSetLayout();
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	void IndirectRenderSystem::registerObjects(FveGameObject::Map& gameObjects) {
+		groups.clear();
+		objectInfos.clear();
+		objectSlots.clear();
+		pendingTransforms.clear();
+		pendingInfos.clear();
+
+		struct Candidate {
+			FveGameObject* obj;
+			Material* material;
+			Mesh* mesh;
+			bool textured;
+		};
+
+		std::vector<Candidate> candidates;
+		for (auto& kv : gameObjects) {
+			auto& obj = kv.second;
+			obj.gpuDriven = false;
+
+			if (obj.model == nullptr) continue;
+
+			Material& material = obj.model->getMaterial();
+			Mesh& mesh = obj.model->getMesh();
+
+			// transparent objects still need the render queue's back-to-front order
+			if (material.transparent || material.instancedVariant == nullptr) continue;
+			if (!mesh.hasIndexBuffer) continue;
+
+			candidates.push_back({ &obj, material.instancedVariant, &mesh, obj.texture != nullptr });
+		}
+
+		// give every group a contiguous range of slots, so an object's slot is also its command slot
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+			if (a.material->sortId != b.material->sortId) return a.material->sortId < b.material->sortId;
+			if (a.mesh->sortId != b.mesh->sortId) return a.mesh->sortId < b.mesh->sortId;
+			return a.textured < b.textured;
+		});
+
+		objectCount = static_cast<u32>(candidates.size());
+
+		std::vector<InstanceData> transforms(objectCount);
+		objectInfos.resize(objectCount);
+
+		for (u32 i = 0; i < objectCount; i++) {
+			const Candidate& candidate = candidates[i];
+
+			if (groups.empty()
+				|| groups.back().material != candidate.material
+				|| groups.back().mesh != candidate.mesh
+				|| groups.back().textured != candidate.textured) {
+				groups.push_back({ candidate.material, candidate.mesh, candidate.textured, i, 0 });
+			}
+			groups.back().commandCount++;
+
+			GpuObjectInfo& info = objectInfos[i];
+			info.boundingSphere = candidate.mesh->bounds.sphere;
+			info.firstIndex = 0;
+			info.indexCount = candidate.mesh->indexCount;
+			info.vertexOffset = 0;
+			info.materialIndex = candidate.material->sortId;
+			info.drawGroup = static_cast<u32>(groups.size() - 1);
+			info.flags = OBJECT_ACTIVE;
+
+			transforms[i].modelMatrix = candidate.obj->transform.mat4();
+			transforms[i].normalMatrix = candidate.obj->transform.normalMatrix();
+
+			objectSlots[candidate.obj->getId()] = i;
+			candidate.obj->gpuDriven = true;
+		}
+
+		FVE_CORE_DEBUG("Registered {0} GPU-driven objects in {1} draw groups", objectCount, groups.size());
+
+		if (objectCount == 0) return;
+
+		createBuffers();
+
+		std::vector<GpuDrawGroup> gpuGroups(groups.size());
+		for (size_t i = 0; i < groups.size(); i++) {
+			gpuGroups[i].firstCommand = groups[i].firstCommand;
+			gpuGroups[i].commandCount = groups[i].commandCount;
+		}
+
+		uploadToDevice(*objectBuffer, objectInfos);
+		uploadToDevice(*transformBuffer, transforms);
+		uploadToDevice(*groupBuffer, gpuGroups);
+
+		writeDescriptorSets();
+	}
+
+	void IndirectRenderSystem::createBuffers() {
+		const u32 groupCount = static_cast<u32>(groups.size());
+
+		objectBuffer = std::make_unique<FveBuffer>(
+			fveAllocator,
+			device,
+			sizeof(GpuObjectInfo),
+			objectCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			"indirectObjectBuffer");
+		transformBuffer = std::make_unique<FveBuffer>(
+			fveAllocator,
+			device,
+			sizeof(InstanceData),
+			objectCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			"indirectTransformBuffer");
+		groupBuffer = std::make_unique<FveBuffer>(
+			fveAllocator,
+			device,
+			sizeof(GpuDrawGroup),
+			groupCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			"indirectGroupBuffer");
+
+		// per frame, so generating this frame's commands never races the previous frame's draws
+		commandBuffers.resize(frameCount);
+		countBuffers.resize(frameCount);
+		cullDataBuffers.resize(frameCount);
+		occludedBuffers.resize(frameCount);
+		statsBuffers.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++) {
+			commandBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(VkDrawIndexedIndirectCommand),
+				objectCount * PHASE_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				"indirectCommandBuffer");
+			countBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(u32),
+				groupCount * PHASE_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				"indirectCountBuffer");
+			cullDataBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(GpuCullData),
+				1,
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"indirectCullDataBuffer");
+			cullDataBuffers[i]->map();
+			occludedBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(u32),
+				objectCount,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				"indirectOccludedBuffer");
+			statsBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(GpuCullStats),
+				1,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VMA_MEMORY_USAGE_GPU_TO_CPU,
+				"indirectStatsBuffer");
+			statsBuffers[i]->map();
+			std::memset(statsBuffers[i]->getMappedMemory(), 0, sizeof(GpuCullStats));
+		}
+	}
+
+	template<typename T>
+	void IndirectRenderSystem::uploadToDevice(FveBuffer& target, const std::vector<T>& data) {
+		FveBuffer stagingBuffer{
+			fveAllocator,
+			device,
+			sizeof(T),
+			static_cast<uint32_t>(data.size()),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU
+		};
+
+		stagingBuffer.map();
+		stagingBuffer.writeToBuffer((void*)data.data());
+
+		device.copyBuffer(stagingBuffer.getAllocatedBuffer().buffer, target.getAllocatedBuffer().buffer, sizeof(T) * data.size());
+	}
+
+	void IndirectRenderSystem::writeDescriptorSets() {
+		// registration replaces every buffer, so start over with fresh sets
+		descriptorPool->resetPool();
+
+		auto objectInfo = objectBuffer->descriptorInfo();
+		auto groupInfo = groupBuffer->descriptorInfo();
+		auto transformInfo = transformBuffer->descriptorInfo();
+		auto pyramidInfo = depthPyramid.descriptorInfo();
+
+		cullSets.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++) {
+			auto commandInfo = commandBuffers[i]->descriptorInfo();
+			auto countInfo = countBuffers[i]->descriptorInfo();
+			auto cullDataInfo = cullDataBuffers[i]->descriptorInfo();
+			auto occludedInfo = occludedBuffers[i]->descriptorInfo();
+			auto statsInfo = statsBuffers[i]->descriptorInfo();
+			FveDescriptorWriter(*cullSetLayout, *descriptorPool)
+				.writeBuffer(0, &objectInfo)
+				.writeBuffer(1, &groupInfo)
+				.writeBuffer(2, &commandInfo)
+				.writeBuffer(3, &countInfo)
+				.writeBuffer(4, &transformInfo)
+				.writeImage(5, &pyramidInfo)
+				.writeBuffer(6, &cullDataInfo)
+				.writeBuffer(7, &occludedInfo)
+				.writeBuffer(8, &statsInfo)
+				.build(cullSets[i]);
+		}
+		pyramidGenerations.assign(frameCount, depthPyramid.getGeneration());
+
+		if (!descriptorPool->allocateDescriptorSet(instanceSetLayout, transformSet)) {
+			throw std::runtime_error("failed to allocate transform descriptor set!");
+		}
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = transformSet;
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.descriptorCount = 1;
+		write.pBufferInfo = &transformInfo;
+		vkUpdateDescriptorSets(device.device(), 1, &write, 0, nullptr);
+	}
+
+	void IndirectRenderSystem::writePyramidDescriptors(int frameIndex) {
+		// only this frame's set, the others may still be in use by frames in flight
+		auto pyramidInfo = depthPyramid.descriptorInfo();
+		FveDescriptorWriter(*cullSetLayout, *descriptorPool)
+			.writeImage(5, &pyramidInfo)
+			.overwrite(cullSets[frameIndex]);
+		pyramidGenerations[frameIndex] = depthPyramid.getGeneration();
+	}
+
+	void IndirectRenderSystem::updateObject(FveGameObject& obj) {
+		auto it = objectSlots.find(obj.getId());
+		if (it == objectSlots.end()) return;
+
+		InstanceData transform{};
+		transform.modelMatrix = obj.transform.mat4();
+		transform.normalMatrix = obj.transform.normalMatrix();
+		pendingTransforms.push_back({ it->second, transform });
+	}
+
+	void IndirectRenderSystem::setObjectActive(FveGameObject& obj, bool active) {
+		auto it = objectSlots.find(obj.getId());
+		if (it == objectSlots.end()) return;
+
+		GpuObjectInfo& info = objectInfos[it->second];
+		u32 flags = active ? (info.flags | OBJECT_ACTIVE) : (info.flags & ~OBJECT_ACTIVE);
+		if (flags == info.flags) return;
+
+		info.flags = flags;
+		pendingInfos.push_back(it->second);
+	}
+
+	void IndirectRenderSystem::uploadPendingChanges(VkCommandBuffer commandBuffer, int frameIndex) {
+		if (pendingTransforms.empty() && pendingInfos.empty()) return;
+
+		VkDeviceSize transformBytes = pendingTransforms.size() * sizeof(InstanceData);
+		VkDeviceSize infoBytes = pendingInfos.size() * sizeof(GpuObjectInfo);
+		VkDeviceSize requiredBytes = transformBytes + infoBytes;
+
+		auto& upload = uploadBuffers[frameIndex];
+		if (requiredBytes > upload->getBufferSize()) {
+			u32 capacity = static_cast<u32>(std::max<VkDeviceSize>(requiredBytes, upload->getBufferSize() * 2));
+			FVE_CORE_DEBUG("Growing indirect upload buffer {0} to {1} bytes", frameIndex, capacity);
+			upload = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				1,
+				capacity,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"indirectUploadBuffer");
+			upload->map();
+		}
+
+		auto mapped = static_cast<char*>(upload->getMappedMemory());
+
+		std::vector<VkBufferCopy> transformCopies;
+		transformCopies.reserve(pendingTransforms.size());
+		VkDeviceSize offset = 0;
+		for (const auto& pending : pendingTransforms) {
+			std::memcpy(mapped + offset, &pending.second, sizeof(InstanceData));
+			transformCopies.push_back({ offset, pending.first * sizeof(InstanceData), sizeof(InstanceData) });
+			offset += sizeof(InstanceData);
+		}
+
+		std::vector<VkBufferCopy> infoCopies;
+		infoCopies.reserve(pendingInfos.size());
+		for (u32 slot : pendingInfos) {
+			std::memcpy(mapped + offset, &objectInfos[slot], sizeof(GpuObjectInfo));
+			infoCopies.push_back({ offset, slot * sizeof(GpuObjectInfo), sizeof(GpuObjectInfo) });
+			offset += sizeof(GpuObjectInfo);
+		}
+
+		upload->flush(requiredBytes, 0);
+
+		// earlier frames may still be reading the persistent buffers
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		if (!transformCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, upload->getAllocatedBuffer().buffer, transformBuffer->getAllocatedBuffer().buffer, static_cast<u32>(transformCopies.size()), transformCopies.data());
+		}
+		if (!infoCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, upload->getAllocatedBuffer().buffer, objectBuffer->getAllocatedBuffer().buffer, static_cast<u32>(infoCopies.size()), infoCopies.data());
+		}
+
+		pendingTransforms.clear();
+		pendingInfos.clear();
+	}
+
+	void IndirectRenderSystem::prepare(FrameInfo& frameInfo) {
+		if (objectCount == 0) return;
+
+		VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+		int frameIndex = frameInfo.frameIndex;
+
+		if (pyramidGenerations[frameIndex] != depthPyramid.getGeneration()) {
+			writePyramidDescriptors(frameIndex);
+		}
+
+		// the last frame in this slot has retired, so its counters from the last use are complete
+		auto& stats = statsBuffers[frameIndex];
+		stats->invalidate();
+		GpuCullStats lastStats = *static_cast<GpuCullStats*>(stats->getMappedMemory());
+		frameInfo.stats.occludedObjects += lastStats.occluded;
+		frameInfo.stats.disoccludedObjects += lastStats.disoccluded;
+
+		uploadPendingChanges(commandBuffer, frameIndex);
+
+		if (useDrawCount) {
+			vkCmdFillBuffer(commandBuffer, countBuffers[frameIndex]->getAllocatedBuffer().buffer, 0, VK_WHOLE_SIZE, 0);
+		}
+		vkCmdFillBuffer(commandBuffer, stats->getAllocatedBuffer().buffer, 0, VK_WHOLE_SIZE, 0);
+
+		// uploads and the count reset must land before the compute pass and the vertex shaders read them
+		VkMemoryBarrier uploadBarrier{};
+		uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		uploadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+		// written before the pyramid is rebuilt, so the first phase still sees the frame it came from
+		Frustum frustum = frameInfo.camera.getFrustum();
+
+		GpuCullData cullData{};
+		for (int i = 0; i < Frustum::Plane::Count; i++) {
+			cullData.frustumPlanes[i] = frustum.planes[i];
+		}
+		cullData.viewProjection = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+		cullData.pyramidViewProjection = depthPyramid.getViewProjection();
+		cullData.pyramidInfo = glm::vec4(
+			static_cast<float>(depthPyramid.getExtent().width),
+			static_cast<float>(depthPyramid.getExtent().height),
+			static_cast<float>(depthPyramid.getMipCount()),
+			0.0f);
+		cullDataBuffers[frameIndex]->writeToBuffer(&cullData);
+		cullDataBuffers[frameIndex]->flush();
+
+		dispatch(frameInfo, PHASE_VISIBLE, occlusionCulling && depthPyramid.isValid());
+
+		// culled on the GPU, so only the candidate count is known here
+		frameInfo.stats.gpuDrivenObjects += objectCount;
+	}
+
+	void IndirectRenderSystem::prepareDisoccluded(FrameInfo& frameInfo) {
+		assert(occlusionCulling && "The second culling phase needs occlusion culling enabled");
+		if (objectCount == 0) return;
+
+		// the first phase's occlusion results are read back here
+		VkMemoryBarrier resultBarrier{};
+		resultBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		resultBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		resultBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(frameInfo.commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &resultBarrier, 0, nullptr, 0, nullptr);
+
+		dispatch(frameInfo, PHASE_DISOCCLUDED, true);
+	}
+
+	void IndirectRenderSystem::dispatch(FrameInfo& frameInfo, Phase phase, bool testOcclusion) {
+		FveCommandRecorder recorder{ frameInfo.commandBuffer, frameInfo.recordTotals };
+
+		pipeline->bind(recorder);
+		recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipelineLayout,
+			0,
+			1,
+			&cullSets[frameInfo.frameIndex]);
+
+		PushConstants push{};
+		push.objectCount = objectCount;
+		push.groupCount = static_cast<u32>(groups.size());
+		push.compact = useDrawCount ? 1 : 0;
+		push.phase = phase;
+		push.occlusion = testOcclusion ? 1 : 0;
+		recorder.pushConstants(pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push);
+
+		recorder.dispatch((objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+		// the counters are read on the host once the frame has retired, the wait alone doesn't make them visible
+		VkMemoryBarrier statsBarrier{};
+		statsBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		statsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		statsBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(frameInfo.commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &statsBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void IndirectRenderSystem::render(FrameInfo& frameInfo) {
+		if (objectCount == 0) return;
+		FveGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "indirect draws" };
+		recordDraws(frameInfo, PHASE_VISIBLE);
+	}
+
+	void IndirectRenderSystem::renderDisoccluded(FrameInfo& frameInfo) {
+		if (objectCount == 0) return;
+		FveGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "disoccluded draws" };
+		recordDraws(frameInfo, PHASE_DISOCCLUDED);
+	}
+
+	void IndirectRenderSystem::renderDepth(FrameInfo& frameInfo, VkPipeline depthPipeline, VkPipelineLayout depthLayout) {
+		if (objectCount == 0) return;
+		recordDepthDraws(frameInfo, PHASE_VISIBLE, depthPipeline, depthLayout);
+	}
+
+	void IndirectRenderSystem::renderDisoccludedDepth(FrameInfo& frameInfo, VkPipeline depthPipeline, VkPipelineLayout depthLayout) {
+		if (objectCount == 0) return;
+		recordDepthDraws(frameInfo, PHASE_DISOCCLUDED, depthPipeline, depthLayout);
+	}
+
+	void IndirectRenderSystem::recordDepthDraws(FrameInfo& frameInfo, Phase phase, VkPipeline depthPipeline, VkPipelineLayout depthLayout) {
+		FveCommandRecorder recorder{ frameInfo.commandBuffer, frameInfo.recordTotals };
+
+		// depth needs neither materials nor textures, so one pipeline and one pair of sets cover every group
+		VkDescriptorSet sets[] = { frameInfo.globalDescriptorSet, transformSet };
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline);
+		recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+			depthLayout,
+			0,
+			2,
+			sets);
+
+		Mesh* lastMesh = nullptr;
+		for (u32 groupIndex = 0; groupIndex < groups.size(); groupIndex++) {
+			const DrawGroup& group = groups[groupIndex];
+			if (group.mesh != lastMesh) {
+				group.mesh->bindPositions(recorder);
+				lastMesh = group.mesh;
+			}
+			drawGroup(recorder, frameInfo.frameIndex, phase, groupIndex);
+		}
+	}
+
+	void IndirectRenderSystem::recordDraws(FrameInfo& frameInfo, Phase phase) {
+		FveCommandRecorder recorder{ frameInfo.commandBuffer, frameInfo.recordTotals };
+
+		VkPipeline lastPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout lastLayout = VK_NULL_HANDLE;
+		VkDescriptorSet lastSet = VK_NULL_HANDLE;
+
+		for (u32 groupIndex = 0; groupIndex < groups.size(); groupIndex++) {
+			const DrawGroup& group = groups[groupIndex];
+			const Material& material = *group.material;
+
+			if (material.pipeline != lastPipeline) {
+				recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+				lastPipeline = material.pipeline;
+			}
+
+			if (material.pipelineLayout != lastLayout) {
+				recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+					material.pipelineLayout,
+					1,
+					1,
+					&transformSet);
+				lastLayout = material.pipelineLayout;
+				lastSet = VK_NULL_HANDLE;
+			}
+
+			VkDescriptorSet set = group.textured ? frameInfo.texturedDescriptorSet : frameInfo.globalDescriptorSet;
+			if (set != lastSet) {
+				recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
+					material.pipelineLayout,
+					0,
+					1,
+					&set);
+				lastSet = set;
+			}
+
+			group.mesh->bind(recorder);
+			drawGroup(recorder, frameInfo.frameIndex, phase, groupIndex);
+		}
+	}
+
+	void IndirectRenderSystem::drawGroup(FveCommandRecorder& recorder, int frameIndex, Phase phase, u32 groupIndex) {
+		const DrawGroup& group = groups[groupIndex];
+
+		VkBuffer commands = commandBuffers[frameIndex]->getAllocatedBuffer().buffer;
+		VkBuffer counts = countBuffers[frameIndex]->getAllocatedBuffer().buffer;
+		const u32 stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		// each phase owns its own half of the command and count buffers
+		const u32 commandBase = phase * objectCount;
+		const u32 countBase = phase * static_cast<u32>(groups.size());
+
+		VkDeviceSize offset = (commandBase + group.firstCommand) * stride;
+		if (useDrawCount) {
+			recorder.drawIndexedIndirectCount(commands, offset, counts, (countBase + groupIndex) * sizeof(u32), group.commandCount, stride);
+		}
+		else if (device.supportsMultiDrawIndirect()) {
+			recorder.drawIndexedIndirect(commands, offset, group.commandCount, stride);
+		}
+		else {
+			// without multiDrawIndirect every indirect draw is limited to a single command
+			for (u32 i = 0; i < group.commandCount; i++) {
+				recorder.drawIndexedIndirect(commands, offset + i * stride, 1, stride);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "../../core/fve_defines.hpp"
+#include "../../core/vulkan/fve_device.hpp"
+#include "../../core/vulkan/fve_buffer.hpp"
+#include "../../core/vulkan/fve_descriptors.hpp"
+#include "../../core/vulkan/fve_pipeline.hpp"
+#include "fve_game_object.hpp"
+#include "../fve_frame_info.hpp"
+#include "../fve_frustum.hpp"
+#include "../fve_depth_pyramid.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fve {
+
+	// per object record read by the draw generation shader, mirrors ObjectInfo in indirect_draw.comp (std430)
+	struct GpuObjectInfo {
+		glm::vec4 boundingSphere{ 0.0f }; // mesh space, w is the radius
+		u32 firstIndex = 0;
+		u32 indexCount = 0;
+		i32 vertexOffset = 0;
+		u32 materialIndex = 0;
+		u32 drawGroup = 0;
+		u32 flags = 0;
+		u32 padding[2]{};
+	};
+
+	STATIC_ASSERT(sizeof(GpuObjectInfo) == 48, "GpuObjectInfo must match the std430 layout of ObjectInfo.");
+
+	// per frame culling inputs, mirrors CullData in indirect_draw.comp (std140)
+	struct GpuCullData {
+		glm::vec4 frustumPlanes[Frustum::Plane::Count];
+		glm::mat4 viewProjection{ 1.0f };
+		glm::mat4 pyramidViewProjection{ 1.0f }; // the frame the depth pyramid was built from
+		glm::vec4 pyramidInfo{ 0.0f }; // xy level 0 size, z level count
+	};
+
+	STATIC_ASSERT(sizeof(GpuCullData) == 240, "GpuCullData must match the std140 layout of CullData.");
+
+	// counters written by the culling passes, read back once the frame has retired
+	struct GpuCullStats {
+		u32 occluded = 0;
+		u32 disoccluded = 0;
+	};
+
+	// range of command slots owned by one (material, mesh, descriptor set) combination
+	struct GpuDrawGroup {
+		u32 firstCommand = 0;
+		u32 commandCount = 0;
+	};
+
+	/*
+	 * GPU-driven path for opaque, indexed objects whose material has an instanced variant.
+	 *
+	 * Objects are uploaded once into persistent device local buffers, sorted so that every draw
+	 * group owns a contiguous range of object slots. Each frame a compute pass walks the object
+	 * buffer, tests every bounding sphere against the camera frustum and writes one
+	 * VkDrawIndexedIndirectCommand per visible object, with firstInstance pointing back at the
+	 * object's transform. The groups are then issued with
+	 * vkCmdDrawIndexedIndirectCount, or with fixed-count indirect draws where a zero instance
+	 * count disables a slot when the device lacks drawIndirectCount.
+	 *
+	 * With occlusion culling the frame is drawn in two phases. The first pass also tests every
+	 * object against the depth pyramid of the previous frame and draws only what was visible there.
+	 * The pyramid is then rebuilt from that depth, and a second pass retests the objects the first
+	 * one rejected, drawing the ones that have become visible since.
+	 *
+	 * The CPU only records per-group work and the transforms of objects that moved, so its frame
+	 * cost no longer depends on how many objects are drawn.
+	 */
+	class IndirectRenderSystem {
+	public:
+		static constexpr u32 OBJECT_ACTIVE = 1u << 0;
+
+		// must match local_size_x in indirect_draw.comp
+		static constexpr u32 WORKGROUP_SIZE = 64;
+
+		IndirectRenderSystem(FveDevice& device, u32 frameCount, VkDescriptorSetLayout instanceSetLayout, FveDepthPyramid& depthPyramid);
+		~IndirectRenderSystem();
+
+		IndirectRenderSystem(const IndirectRenderSystem&) = delete;
+		IndirectRenderSystem& operator=(const IndirectRenderSystem&) = delete;
+
+		// every indirect command needs a non zero firstInstance to find its transform
+		static bool isSupported(FveDevice& device) { return device.supportsDrawIndirectFirstInstance(); }
+
+		// uploads every eligible object and marks it gpuDriven, must not be called while frames are in flight
+		void registerObjects(FveGameObject::Map& gameObjects);
+
+		// queues a transform upload for a registered object that moved
+		void updateObject(FveGameObject& obj);
+		void setObjectActive(FveGameObject& obj, bool active);
+
+		void setOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+		bool isOcclusionCullingEnabled() const { return occlusionCulling; }
+
+		// records pending uploads and the draw generation dispatch, must be called outside the render pass.
+		// the indirect draws have to be ordered after it by the caller, see getDrawCommands()
+		void prepare(FrameInfo& frameInfo);
+
+		// issues the indirect draws generated by prepare()
+		void render(FrameInfo& frameInfo);
+
+		// retests the objects prepare() found occluded against the rebuilt depth pyramid,
+		// must be called outside the render pass and only with occlusion culling enabled
+		void prepareDisoccluded(FrameInfo& frameInfo);
+
+		// issues the draws generated by prepareDisoccluded()
+		void renderDisoccluded(FrameInfo& frameInfo);
+
+		// commands generated for a frame slot, the draw counts are written and read alongside them
+		VkBuffer getDrawCommands(int frameIndex) const { return commandBuffers[frameIndex]->getAllocatedBuffer().buffer; }
+
+		// same draws as render() and renderDisoccluded(), depth only from the position streams. the pipeline
+		// layout must take the global set at set 0 and the instance set layout at set 1
+		void renderDepth(FrameInfo& frameInfo, VkPipeline depthPipeline, VkPipelineLayout depthLayout);
+		void renderDisoccludedDepth(FrameInfo& frameInfo, VkPipeline depthPipeline, VkPipelineLayout depthLayout);
+
+		u32 getObjectCount() const { return objectCount; }
+		u32 getGroupCount() const { return static_cast<u32>(groups.size()); }
+
+	private:
+		struct DrawGroup {
+			Material* material;
+			Mesh* mesh;
+			bool textured;
+			u32 firstCommand;
+			u32 commandCount;
+		};
+
+		enum Phase : u32 {
+			PHASE_VISIBLE = 0,
+			PHASE_DISOCCLUDED = 1,
+			PHASE_COUNT = 2
+		};
+
+		struct PushConstants {
+			u32 objectCount;
+			u32 groupCount;
+			u32 compact;
+			u32 phase;
+			u32 occlusion;
+		};
+
+		void createDescriptorLayouts();
+		void createPipelineLayout();
+		void createBuffers();
+		void writeDescriptorSets();
+		void writePyramidDescriptors(int frameIndex);
+		void uploadPendingChanges(VkCommandBuffer commandBuffer, int frameIndex);
+		void dispatch(FrameInfo& frameInfo, Phase phase, bool testOcclusion);
+		void recordDraws(FrameInfo& frameInfo, Phase phase);
+		void recordDepthDraws(FrameInfo& frameInfo, Phase phase, VkPipeline depthPipeline, VkPipelineLayout depthLayout);
+		void drawGroup(FveCommandRecorder& recorder, int frameIndex, Phase phase, u32 groupIndex);
+
+		template<typename T>
+		void uploadToDevice(FveBuffer& target, const std::vector<T>& data);
+
+		FveDevice& device;
+		// frames in flight, everything per frame is kept this many times
+		u32 frameCount;
+		VkDescriptorSetLayout instanceSetLayout;
+		FveDepthPyramid& depthPyramid;
+
+		std::unique_ptr<FveDescriptorPool> descriptorPool;
+		std::unique_ptr<FveDescriptorSetLayout> cullSetLayout;
+		VkPipelineLayout pipelineLayout;
+		std::unique_ptr<FveComputePipeline> pipeline;
+
+		// persistent, written at registration and by pending uploads
+		std::unique_ptr<FveBuffer> objectBuffer;
+		std::unique_ptr<FveBuffer> transformBuffer;
+		std::unique_ptr<FveBuffer> groupBuffer;
+
+		// rewritten every frame by the compute pass, one half per phase
+		std::vector<std::unique_ptr<FveBuffer>> commandBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> countBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> uploadBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> cullDataBuffers;
+		std::vector<std::unique_ptr<FveBuffer>> occludedBuffers; // objects the first phase left to the second
+		std::vector<std::unique_ptr<FveBuffer>> statsBuffers;
+
+		std::vector<VkDescriptorSet> cullSets;
+		VkDescriptorSet transformSet = VK_NULL_HANDLE;
+
+		std::vector<DrawGroup> groups;
+		std::vector<GpuObjectInfo> objectInfos;
+		std::unordered_map<FveGameObject::id_t, u32> objectSlots;
+
+		std::vector<std::pair<u32, InstanceData>> pendingTransforms;
+		std::vector<u32> pendingInfos;
+
+		u32 objectCount = 0;
+		// pyramid each frame's cull set points at
+		std::vector<u32> pyramidGenerations;
+		bool useDrawCount = false;
+		bool occlusionCulling = true;
+	};
+
+}
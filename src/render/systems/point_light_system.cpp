@@ -1,4 +1,6 @@
 #include "point_light_system.hpp"
+#include "../../core/vulkan/fve_memory.hpp"
+#include "../../core/utils/fve_logger.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -9,130 +11,184 @@
 #include <stdexcept>
 #include <array>
 #include <cassert>
-#include <map>
+#include <cstring>
 
 namespace fve {
 
-	struct PointLightPushConstants {
-		glm::vec4 position{};
-		glm::vec4 color{};
-		float radius;
-	};
-
-	PointLightSystem::PointLightSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : device{ device } {
+	PointLightSystem::PointLightSystem(FveDevice& device, u32 frameCount, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) : device{ device }, frameCount{ frameCount } {
+		createBillboardBuffers();
 		createPipelineLayout(globalSetLayout);
-		createPipeline(renderPass);
+		queuePipeline(renderPass, pipelineQueue, variant);
 	}
 
 	PointLightSystem::~PointLightSystem() {
 		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
 	}
 
-	void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(PointLightPushConstants);
+	void PointLightSystem::createBillboardBuffers() {
+		billboardPool = FveDescriptorPool::Builder(device)
+			.setMaxSets(frameCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount)
+			.build();
+		billboardSetLayout = FveDescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+			.build();
+
+		// sized for every light the light buffer can hold, so it never has to grow
+		billboardBuffers.resize(frameCount);
+		billboardSets.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++) {
+			billboardBuffers[i] = std::make_unique<FveBuffer>(
+				fveAllocator,
+				device,
+				sizeof(LightBillboard),
+				MAX_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"lightBillboardBuffer");
+			billboardBuffers[i]->map();
+
+			auto bufferInfo = billboardBuffers[i]->descriptorInfo();
+			FveDescriptorWriter(*billboardSetLayout, *billboardPool)
+				.writeBuffer(0, &bufferInfo)
+				.build(billboardSets[i]);
+		}
+	}
 
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+	void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout, billboardSetLayout->getDescriptorSetLayout() };
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
 		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
 		}
 	}
 
-	void PointLightSystem::createPipeline(VkRenderPass renderPass) {
+	void PointLightSystem::queuePipeline(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) {
 
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-		PipelineConfigInfo pipelineConfig{};
-		FvePipeline::defaultPipelineConfigInfo(pipelineConfig);
-		FvePipeline::enableAlphaBlending(pipelineConfig);
-		pipelineConfig.bindingDescriptions.clear();
-		pipelineConfig.attributeDescriptions.clear();
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		pipeline = std::make_unique<FvePipeline>(
-			device,
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		FvePipeline::enableAlphaBlending(*pipelineConfig);
+		pipelineConfig->bindingDescriptions.clear();
+		pipelineConfig->attributeDescriptions.clear();
+		pipelineConfig->renderPass = renderPass;
+		pipelineConfig->pipelineLayout = pipelineLayout;
+		pipelineConfig->variant = billboardVariant(variant);
+		pipelineHandle = pipelineQueue.add(
 			"shaders/point_light.vert.spv",
 			"shaders/point_light.frag.spv",
-			pipelineConfig,
+			std::move(pipelineConfig),
 			"pointlightmaterial");
 	}
 
-	void PointLightSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo) {
+	void PointLightSystem::waitForPipelines(FvePipelineQueue& pipelineQueue) {
+		pipeline = pipelineQueue.wait(pipelineHandle);
+		activePipeline = pipeline->getBasePipeline();
+	}
+
+	void PointLightSystem::requestShaderVariant(const ShaderVariant& variant, FvePipelineQueue& pipelineQueue) {
+		variantHandle = pipelineQueue.addVariant(*pipeline, billboardVariant(variant));
+	}
+
+	bool PointLightSystem::isShaderVariantReady(FvePipelineQueue& pipelineQueue) {
+		return pipelineQueue.isReady(variantHandle);
+	}
+
+	void PointLightSystem::applyShaderVariant(FvePipelineQueue& pipelineQueue) {
+		activePipeline = pipelineQueue.getVariant(variantHandle);
+	}
+
+	ShaderVariant PointLightSystem::billboardVariant(const ShaderVariant& variant) {
+		// blended pipelines ignore depthEqual, clearing it spares compiling an identical variant on toggle
+		ShaderVariant result = variant;
+		result.depthEqual = VK_FALSE;
+		return result;
+	}
+
+	void PointLightSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo, FveLightClusters& lightClusters) {
 
 		auto rotateLight = glm::rotate(glm::mat4(1.0f), frameInfo.frameTime, { 0.0f, -1.0f, 0.0f });
 
+		PointLight* lights = lightClusters.getLights(frameInfo.frameIndex);
+		const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+
+		billboards.clear();
+		sortItems.clear();
+
 		int lightIndex = 0;
+		u32 skippedLights = 0;
 		for (auto& kv : frameInfo.gameObjects) {
 			auto& obj = kv.second;
 			if (obj.pointLight == nullptr) continue;
 
-			assert(lightIndex < MAX_LIGHTS && "Too many point lights!");
+			// the light and billboard buffers hold MAX_LIGHTS, the rest are neither shaded nor drawn
+			if (lightIndex >= MAX_LIGHTS) {
+				skippedLights++;
+				continue;
+			}
 
 			// update light position
 			obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.0f));
 
-			// copy light to ubo
-			ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.0f);
-			ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
+			// copy light to the light buffer
+			lights[lightIndex].position = glm::vec4(obj.transform.translation, FveLightClusters::lightRange(obj.pointLight->lightIntensity));
+			lights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
 			lightIndex++;
+
+			// positive floats order like their bit patterns, inverted so the farthest light is drawn first
+			auto offset = cameraPosition - obj.transform.translation;
+			float distSquared = glm::dot(offset, offset);
+			u32 distBits;
+			std::memcpy(&distBits, &distSquared, sizeof(distBits));
+
+			sortItems.push_back({ static_cast<u64>(~distBits), static_cast<u32>(billboards.size()) });
+			billboards.push_back({ glm::vec4(obj.transform.translation, obj.transform.scale.x), glm::vec4(obj.color, obj.pointLight->lightIntensity) });
 		}
 		ubo.numLights = lightIndex;
 
-	}
+		// a lasting overflow is reported once, when it starts
+		if (skippedLights > 0 && !lightsSkipped) {
+			FVE_CORE_WARN("Too many point lights, {0} over the limit of {1} are skipped", skippedLights, MAX_LIGHTS);
+		}
+		lightsSkipped = skippedLights > 0;
 
-	void PointLightSystem::render(FrameInfo& frameInfo) {
-		// sort lights
-		std::map<float, FveGameObject::id_t> sorted;
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
-			if (obj.pointLight == nullptr) continue;
+		// stable, so lights at the same distance keep a consistent order between frames
+		radixSort(sortItems, sortScratch);
 
-			// calculate distance
-			auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
-			float distSquared = glm::dot(offset, offset);
-			sorted[distSquared] = obj.getId();
+		auto& billboardBuffer = billboardBuffers[frameInfo.frameIndex];
+		LightBillboard* sorted = static_cast<LightBillboard*>(billboardBuffer->getMappedMemory());
+		for (size_t i = 0; i < sortItems.size(); i++) {
+			sorted[i] = billboards[sortItems[i].index];
 		}
+		if (!billboards.empty()) {
+			billboardBuffer->flush(sizeof(LightBillboard) * billboards.size());
+		}
+
+	}
+
+	void PointLightSystem::render(FrameInfo& frameInfo) {
+		if (billboards.empty()) return;
+		FveGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "point lights" };
+		FveCommandRecorder recorder{ frameInfo.commandBuffer, frameInfo.recordTotals };
 
-		pipeline->bind(frameInfo.commandBuffer);
+		recorder.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, activePipeline);
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
+		VkDescriptorSet descriptorSets[] = { frameInfo.globalDescriptorSet, billboardSets[frameInfo.frameIndex] };
+		recorder.bindDescriptorSets(VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
 			0,
-			1,
-			&frameInfo.globalDescriptorSet,
-			0,
-			nullptr);
-
-		// iterate through sorted map in reverse order
-		for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-			// use object id to find the light
-			auto& obj = frameInfo.gameObjects.at(it->second);
-
-			PointLightPushConstants push{};
-			push.position = glm::vec4(obj.transform.translation, 1.0f);
-			push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-			push.radius = obj.transform.scale.x;
-
-			vkCmdPushConstants(
-				frameInfo.commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(PointLightPushConstants),
-				&push
-			);
-			vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-		}
+			2,
+			descriptorSets);
+
+		// six vertices per quad, one instance per light in back-to-front order
+		recorder.draw(6, static_cast<u32>(billboards.size()), 0, 0);
 	}
 
-}
\ No newline at end of file
+}
@@ -1,37 +1,86 @@
 #pragma once
 
 #include "../../core/vulkan/fve_device.hpp"
+#include "../../core/vulkan/fve_buffer.hpp"
+#include "../../core/vulkan/fve_descriptors.hpp"
+#include "../../core/utils/fve_sort.hpp"
 #include "../../fve_game_object.hpp"
 #include "../../core/vulkan/fve_pipeline.hpp"
+#include "../../core/vulkan/fve_pipeline_queue.hpp"
 #include "../fve_camera.hpp"
 #include "../fve_frame_info.hpp"
+#include "../fve_light_clusters.hpp"
 
 #include <memory>
 #include <vector>
 
 namespace fve {
 
+	/*
+	 * Draws every point light as a camera facing billboard in one instanced draw.
+	 *
+	 * update() collects the lights, sorts them back-to-front with a radix sort over their squared
+	 * distance to the camera and writes them to a per-frame storage buffer bound at set 1, which the
+	 * vertex shader indexes with gl_InstanceIndex.
+	 */
 	class PointLightSystem {
 	public:
 
-		PointLightSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		// the pipeline is only queued here, waitForPipelines() must be called before the first frame
+		PointLightSystem(FveDevice& device, u32 frameCount, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant);
 		~PointLightSystem();
 
-		void update(FrameInfo& frameInfo, GlobalUbo &ubo);
+		void waitForPipelines(FvePipelineQueue& pipelineQueue);
+
+		// the billboards only care about fog. the current pipeline keeps drawing until applyShaderVariant()
+		void requestShaderVariant(const ShaderVariant& variant, FvePipelineQueue& pipelineQueue);
+		// whether the requested variant is compiled, never blocks
+		bool isShaderVariantReady(FvePipelineQueue& pipelineQueue);
+		// the requested variant must be ready
+		void applyShaderVariant(FvePipelineQueue& pipelineQueue);
+
+		// moves the lights, writes them to the frame's light buffer for clustering and
+		// fills the frame's billboard buffer in draw order
+		void update(FrameInfo& frameInfo, GlobalUbo &ubo, FveLightClusters& lightClusters);
 		void render(FrameInfo& frameInfo);
 
 	private:
+		// mirrors LightBillboard in point_light.vert (std430)
+		struct LightBillboard {
+			glm::vec4 position{}; // w is the billboard radius
+			glm::vec4 color{}; // w is intensity
+		};
+
 		FveDevice& device;
+		// frames in flight, everything per frame is kept this many times
+		u32 frameCount;
 
 		std::unique_ptr<FvePipeline> pipeline;
+		VkPipeline activePipeline = VK_NULL_HANDLE;
 		VkPipelineLayout pipelineLayout;
+		FvePipelineQueue::Handle pipelineHandle;
+		FvePipelineQueue::Handle variantHandle;
 
+		std::unique_ptr<FveDescriptorPool> billboardPool;
+		std::unique_ptr<FveDescriptorSetLayout> billboardSetLayout;
+		std::vector<std::unique_ptr<FveBuffer>> billboardBuffers;
+		std::vector<VkDescriptorSet> billboardSets;
+
+		// this frame's billboards in game object order, and their sorted order
+		std::vector<LightBillboard> billboards;
+		std::vector<SortItem> sortItems;
+		std::vector<SortItem> sortScratch;
+		// whether the last update had more lights than MAX_LIGHTS
+		bool lightsSkipped = false;
 
 		PointLightSystem(const PointLightSystem&) = delete;
 		PointLightSystem& operator=(const PointLightSystem&) = delete;
 
+		static ShaderVariant billboardVariant(const ShaderVariant& variant);
+
+		void createBillboardBuffers();
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-		void createPipeline(VkRenderPass renderPass);
+		void queuePipeline(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant);
 	};
 
 }
\ No newline at end of file
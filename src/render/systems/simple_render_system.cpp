@@ -1,4 +1,5 @@
 #include "simple_render_system.hpp"
+#include "../../assets/fve_assets.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -12,27 +13,22 @@
 
 namespace fve {
 
-	struct SimplePushConstantData {
-		alignas(16) glm::mat4 modelMatrix{ 1.0f };
-		alignas(16) glm::mat4 normalMatrix{ 1.0f };
-	};
-
-	SimpleRenderSystem::SimpleRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : device{ device } {
-		createPipelineLayout(globalSetLayout);
-		createPipeline(renderPass);
+	SimpleRenderSystem::SimpleRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) : device{ device } {
+		pipelineLayout = createPipelineLayout({ globalSetLayout });
+		instancedPipelineLayout = createPipelineLayout({ globalSetLayout, instanceSetLayout });
+		queuePipelines(renderPass, pipelineQueue, variant);
 	}
 
 	SimpleRenderSystem::~SimpleRenderSystem() {
 		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device.device(), instancedPipelineLayout, nullptr);
 	}
 
-	void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+	VkPipelineLayout SimpleRenderSystem::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts) {
 		VkPushConstantRange pushConstantRange;
 		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
-
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+		pushConstantRange.size = sizeof(ObjectPushConstants);
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -40,41 +36,71 @@ namespace fve {
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
 		pipelineLayoutInfo.pushConstantRangeCount = 1;
 		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+
+		VkPipelineLayout layout;
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
 		}
+		return layout;
 	}
 
-	void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+	void SimpleRenderSystem::queuePipelines(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) {
 
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-		PipelineConfigInfo pipelineConfig{};
-		FvePipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		pipeline = std::make_unique<FvePipeline>(
-			device,
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		pipelineConfig->renderPass = renderPass;
+		pipelineConfig->pipelineLayout = pipelineLayout;
+		pipelineConfig->variant = variant;
+
+		// same fragment stage, transforms come from the instance buffer
+		auto instancedConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*instancedConfig);
+		instancedConfig->renderPass = renderPass;
+		instancedConfig->pipelineLayout = instancedPipelineLayout;
+		instancedConfig->variant = variant;
+
+		pipelineHandle = pipelineQueue.add(
 			"shaders/simple_shader.vert.spv",
 			"shaders/simple_shader.frag.spv",
-			pipelineConfig,
+			std::move(pipelineConfig),
 			"defaultmaterial");
+		instancedPipelineHandle = pipelineQueue.add(
+			"shaders/simple_shader_instanced.vert.spv",
+			"shaders/simple_shader.frag.spv",
+			std::move(instancedConfig),
+			"defaultmaterial_instanced");
 	}
 
-	void SimpleRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-		pipeline->bind(frameInfo.commandBuffer);
+	void SimpleRenderSystem::waitForPipelines(FvePipelineQueue& pipelineQueue) {
+		pipeline = pipelineQueue.wait(pipelineHandle);
+		instancedPipeline = pipelineQueue.wait(instancedPipelineHandle);
+
+		material = fveAssets.getMaterial("defaultmaterial");
+		material->instancedVariant = fveAssets.getMaterial("defaultmaterial_instanced");
+	}
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0,
-			1,
-			&frameInfo.globalDescriptorSet,
-			0,
-			nullptr);
+	void SimpleRenderSystem::requestShaderVariant(const ShaderVariant& variant, FvePipelineQueue& pipelineQueue) {
+		variantHandle = pipelineQueue.addVariant(*pipeline, variant);
+		instancedVariantHandle = pipelineQueue.addVariant(*instancedPipeline, variant);
+	}
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
+	bool SimpleRenderSystem::isShaderVariantReady(FvePipelineQueue& pipelineQueue) {
+		return pipelineQueue.isReady(variantHandle) && pipelineQueue.isReady(instancedVariantHandle);
+	}
+
+	void SimpleRenderSystem::applyShaderVariant(FvePipelineQueue& pipelineQueue) {
+		fveAssets.getMaterial("defaultmaterial")->pipeline = pipelineQueue.getVariant(variantHandle);
+		fveAssets.getMaterial("defaultmaterial_instanced")->pipeline = pipelineQueue.getVariant(instancedVariantHandle);
+	}
+
+	void SimpleRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
+		const glm::mat4& view = frameInfo.camera.getView();
+
+		// the scene BVH already rejected everything outside the frustum
+		for (auto id : frameInfo.visibleObjects) {
+			auto& obj = frameInfo.gameObjects.at(id);
 
 			// skip objects with no model
 			if (obj.model == nullptr) continue;
@@ -82,13 +108,16 @@ namespace fve {
 			// skip textured objects
 			if (obj.texture != nullptr) continue;
 
-			SimplePushConstantData push{};
+			// the indirect render system already draws it
+			if (obj.gpuDriven) continue;
+
+			ObjectPushConstants push{};
 			push.modelMatrix = obj.transform.mat4();
 			push.normalMatrix = obj.transform.normalMatrix();
 
-			vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
-			obj.model->bind(frameInfo.commandBuffer);
-			obj.model->draw(frameInfo.commandBuffer);
+			float viewDepth = (view * glm::vec4(obj.transform.translation, 1.0f)).z;
+
+			frameInfo.renderQueue.submit(material, frameInfo.globalDescriptorSet, &obj.model->getMesh(), push, viewDepth);
 		}
 	}
 
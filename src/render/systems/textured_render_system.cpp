@@ -1,4 +1,5 @@
 #include "textured_render_system.hpp"
+#include "../../assets/fve_assets.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -12,27 +13,22 @@
 
 namespace fve {
 
-	struct SimplePushConstantData {
-		alignas(16) glm::mat4 modelMatrix{ 1.0f };
-		alignas(16) glm::mat4 normalMatrix{ 1.0f };
-	};
-
-	TexturedRenderSystem::TexturedRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : device{ device } {
-		createPipelineLayout(globalSetLayout);
-		createPipeline(renderPass);
+	TexturedRenderSystem::TexturedRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) : device{ device } {
+		pipelineLayout = createPipelineLayout({ globalSetLayout });
+		instancedPipelineLayout = createPipelineLayout({ globalSetLayout, instanceSetLayout });
+		queuePipelines(renderPass, pipelineQueue, variant);
 	}
 
 	TexturedRenderSystem::~TexturedRenderSystem() {
 		vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device.device(), instancedPipelineLayout, nullptr);
 	}
 
-	void TexturedRenderSystem::createPipelineLayout(VkDescriptorSetLayout descriptorSetLayout) {
+	VkPipelineLayout TexturedRenderSystem::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts) {
 		VkPushConstantRange pushConstantRange;
 		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
-
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ descriptorSetLayout };
+		pushConstantRange.size = sizeof(ObjectPushConstants);
 
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -40,65 +36,85 @@ namespace fve {
 		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
 		pipelineLayoutInfo.pushConstantRangeCount = 1;
 		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+
+		VkPipelineLayout layout;
+		if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
 		}
+		return layout;
 	}
 
-	void TexturedRenderSystem::createPipeline(VkRenderPass renderPass) {
+	void TexturedRenderSystem::queuePipelines(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant) {
 
 		assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-		PipelineConfigInfo pipelineConfig{};
-		FvePipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = pipelineLayout;
-		pipeline = std::make_unique<FvePipeline>(
-			device,
+		auto pipelineConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*pipelineConfig);
+		pipelineConfig->renderPass = renderPass;
+		pipelineConfig->pipelineLayout = pipelineLayout;
+		pipelineConfig->variant = variant;
+
+		// same fragment stage, transforms come from the instance buffer
+		auto instancedConfig = std::make_unique<PipelineConfigInfo>();
+		FvePipeline::defaultPipelineConfigInfo(*instancedConfig);
+		instancedConfig->renderPass = renderPass;
+		instancedConfig->pipelineLayout = instancedPipelineLayout;
+		instancedConfig->variant = variant;
+
+		pipelineHandle = pipelineQueue.add(
 			"shaders/textured_shader.vert.spv",
 			"shaders/textured_shader.frag.spv",
-			pipelineConfig,
+			std::move(pipelineConfig),
 			"texturedmaterial");
+		instancedPipelineHandle = pipelineQueue.add(
+			"shaders/textured_shader_instanced.vert.spv",
+			"shaders/textured_shader.frag.spv",
+			std::move(instancedConfig),
+			"texturedmaterial_instanced");
 	}
 
-	void TexturedRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-		pipeline->bind(frameInfo.commandBuffer);
+	void TexturedRenderSystem::waitForPipelines(FvePipelineQueue& pipelineQueue) {
+		pipeline = pipelineQueue.wait(pipelineHandle);
+		instancedPipeline = pipelineQueue.wait(instancedPipelineHandle);
+
+		fveAssets.getMaterial("texturedmaterial")->instancedVariant = fveAssets.getMaterial("texturedmaterial_instanced");
+	}
 
-		vkCmdBindDescriptorSets(frameInfo.commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0,
-			1,
-			&frameInfo.texturedDescriptorSet,
-			0,
-			nullptr);
+	void TexturedRenderSystem::requestShaderVariant(const ShaderVariant& variant, FvePipelineQueue& pipelineQueue) {
+		variantHandle = pipelineQueue.addVariant(*pipeline, variant);
+		instancedVariantHandle = pipelineQueue.addVariant(*instancedPipeline, variant);
+	}
 
-		// track mesh/material usage
-		Mesh* lastMesh = nullptr;
-		Material* lastMaterial = nullptr;
+	bool TexturedRenderSystem::isShaderVariantReady(FvePipelineQueue& pipelineQueue) {
+		return pipelineQueue.isReady(variantHandle) && pipelineQueue.isReady(instancedVariantHandle);
+	}
 
-		for (auto& kv : frameInfo.gameObjects) {
-			auto& obj = kv.second;
+	void TexturedRenderSystem::applyShaderVariant(FvePipelineQueue& pipelineQueue) {
+		fveAssets.getMaterial("texturedmaterial")->pipeline = pipelineQueue.getVariant(variantHandle);
+		fveAssets.getMaterial("texturedmaterial_instanced")->pipeline = pipelineQueue.getVariant(instancedVariantHandle);
+	}
+
+	void TexturedRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
+		const glm::mat4& view = frameInfo.camera.getView();
+
+		// the scene BVH already rejected everything outside the frustum
+		for (auto id : frameInfo.visibleObjects) {
+			auto& obj = frameInfo.gameObjects.at(id);
 
 			// skip objects with no model or no texture
 			if (obj.model == nullptr) continue;
 			if (obj.texture == nullptr) continue;
 
-			//only bind the pipeline if it doesn't match with the already bound one
-			if (&obj.model->getMaterial() != lastMaterial) {
-
-				vkCmdBindPipeline(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.model->getMaterial().pipeline);
-				lastMaterial = &obj.model->getMaterial();
-			}
+			// the indirect render system already draws it
+			if (obj.gpuDriven) continue;
 
-
-			SimplePushConstantData push{};
+			ObjectPushConstants push{};
 			push.modelMatrix = obj.transform.mat4();
 			push.normalMatrix = obj.transform.normalMatrix();
 
-			vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
-			obj.model->bind(frameInfo.commandBuffer);
-			obj.model->draw(frameInfo.commandBuffer);
+			float viewDepth = (view * glm::vec4(obj.transform.translation, 1.0f)).z;
+
+			frameInfo.renderQueue.submit(&obj.model->getMaterial(), frameInfo.texturedDescriptorSet, &obj.model->getMesh(), push, viewDepth);
 		}
 	}
 
@@ -3,6 +3,7 @@
 #include "../../core/vulkan/fve_device.hpp"
 #include "fve_game_object.hpp"
 #include "../../core/vulkan/fve_pipeline.hpp"
+#include "../../core/vulkan/fve_pipeline_queue.hpp"
 #include "../fve_camera.hpp"
 #include "../fve_frame_info.hpp"
 
@@ -14,23 +15,40 @@ namespace fve {
 	class TexturedRenderSystem {
 	public:
 
-		TexturedRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		// pipelines are only queued here, waitForPipelines() must be called before the first frame
+		TexturedRenderSystem(FveDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout instanceSetLayout, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant);
 		~TexturedRenderSystem();
 
+		void waitForPipelines(FvePipelineQueue& pipelineQueue);
+
+		// queues the variant's pipelines, the materials keep drawing with the current ones until applyShaderVariant()
+		void requestShaderVariant(const ShaderVariant& variant, FvePipelineQueue& pipelineQueue);
+		// whether the requested variant is compiled, never blocks
+		bool isShaderVariantReady(FvePipelineQueue& pipelineQueue);
+		// switches the materials over, the requested variant must be ready
+		void applyShaderVariant(FvePipelineQueue& pipelineQueue);
+
+		// submits every textured object to the frame's render queue
 		void renderGameObjects(FrameInfo& frameInfo);
 
 	private:
 		FveDevice& device;
 
 		std::unique_ptr<FvePipeline> pipeline;
+		std::unique_ptr<FvePipeline> instancedPipeline;
 		VkPipelineLayout pipelineLayout;
+		VkPipelineLayout instancedPipelineLayout;
+		FvePipelineQueue::Handle pipelineHandle;
+		FvePipelineQueue::Handle instancedPipelineHandle;
+		FvePipelineQueue::Handle variantHandle;
+		FvePipelineQueue::Handle instancedVariantHandle;
 
 
 		TexturedRenderSystem(const TexturedRenderSystem&) = delete;
 		TexturedRenderSystem& operator=(const TexturedRenderSystem&) = delete;
 
-		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-		void createPipeline(VkRenderPass renderPass);
+		VkPipelineLayout createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts);
+		void queuePipelines(VkRenderPass renderPass, FvePipelineQueue& pipelineQueue, const ShaderVariant& variant);
 	};
 
 }
\ No newline at end of file